@@ -0,0 +1,114 @@
+#include "arena_resource.h"
+
+#include <algorithm>
+#include <new>
+
+namespace {
+
+size_t RoundUp(size_t value, size_t multiple) {
+    return (value + multiple - 1) / multiple * multiple;
+}
+
+} // namespace
+
+ArenaResource::ArenaResource(std::pmr::memory_resource* upstream)
+        : upstream_(upstream) {
+}
+
+ArenaResource::~ArenaResource() {
+    Release();
+}
+
+void ArenaResource::Release() {
+    while (chunks_ != nullptr) {
+        Chunk* const next = chunks_->next;
+        upstream_->deallocate(chunks_, chunks_->size, alignof(std::max_align_t));
+        chunks_ = next;
+    }
+    while (large_blocks_ != nullptr) {
+        LargeBlock* const next = large_blocks_->next;
+        upstream_->deallocate(large_blocks_, GetLargeHeaderSize(large_blocks_->alignment) + large_blocks_->size,
+                              std::max(large_blocks_->alignment, alignof(LargeBlock)));
+        large_blocks_ = next;
+    }
+    chunk_count_ = 0;
+    large_block_count_ = 0;
+    next_chunk_size_ = MIN_CHUNK_SIZE;
+    current_ = nullptr;
+    end_ = nullptr;
+    free_lists_.fill(nullptr);
+}
+
+size_t ArenaResource::GetUpstreamBlockCount() const {
+    return chunk_count_ + large_block_count_;
+}
+
+void* ArenaResource::do_allocate(size_t bytes, size_t alignment) {
+    if (!IsSmall(bytes, alignment)) {
+        const size_t header_size = GetLargeHeaderSize(alignment);
+        auto* const block = static_cast<LargeBlock*>(upstream_->allocate(header_size + bytes, std::max(alignment, alignof(LargeBlock))));
+        *block = {nullptr, large_blocks_, bytes, alignment};
+        if (large_blocks_ != nullptr) {
+            large_blocks_->previous = block;
+        }
+        large_blocks_ = block;
+        ++large_block_count_;
+        return reinterpret_cast<std::byte*>(block) + header_size;
+    }
+
+    const size_t size = RoundUp(std::max<size_t>(bytes, 1), SIZE_CLASS_GRANULARITY);
+    FreeBlock*& free_list = free_lists_[size / SIZE_CLASS_GRANULARITY - 1];
+    if (free_list != nullptr) {
+        FreeBlock* const block = free_list;
+        free_list = block->next;
+        return block;
+    }
+    if (static_cast<size_t>(end_ - current_) < size) {
+        AddChunk(size);
+    }
+    void* const block = current_;
+    current_ += size;
+    return block;
+}
+
+void ArenaResource::do_deallocate(void* pointer, size_t bytes, size_t alignment) {
+    if (!IsSmall(bytes, alignment)) {
+        auto* const block = reinterpret_cast<LargeBlock*>(static_cast<std::byte*>(pointer) - GetLargeHeaderSize(alignment));
+        (block->previous != nullptr ? block->previous->next : large_blocks_) = block->next;
+        if (block->next != nullptr) {
+            block->next->previous = block->previous;
+        }
+        --large_block_count_;
+        upstream_->deallocate(block, GetLargeHeaderSize(alignment) + block->size, std::max(alignment, alignof(LargeBlock)));
+        return;
+    }
+
+    const size_t size = RoundUp(std::max<size_t>(bytes, 1), SIZE_CLASS_GRANULARITY);
+    FreeBlock*& free_list = free_lists_[size / SIZE_CLASS_GRANULARITY - 1];
+    free_list = new (pointer) FreeBlock{free_list};
+}
+
+bool ArenaResource::do_is_equal(const std::pmr::memory_resource& other) const noexcept {
+    return this == &other;
+}
+
+bool ArenaResource::IsSmall(size_t bytes, size_t alignment) {
+    return bytes <= MAX_SMALL_BLOCK_SIZE && alignment <= SIZE_CLASS_GRANULARITY;
+}
+
+size_t ArenaResource::GetLargeHeaderSize(size_t alignment) {
+    return RoundUp(sizeof(LargeBlock), std::max(alignment, alignof(LargeBlock)));
+}
+
+void ArenaResource::AddChunk(size_t min_size) {
+    // The chunk header takes the first granule, so the blocks after it stay aligned
+    const size_t header_size = RoundUp(sizeof(Chunk), SIZE_CLASS_GRANULARITY);
+    const size_t size = std::max(next_chunk_size_, header_size + min_size);
+    auto* const chunk = static_cast<Chunk*>(upstream_->allocate(size, alignof(std::max_align_t)));
+    *chunk = {chunks_, size};
+    chunks_ = chunk;
+    ++chunk_count_;
+    next_chunk_size_ = std::min(next_chunk_size_ * 2, MAX_CHUNK_SIZE);
+    current_ = reinterpret_cast<std::byte*>(chunk) + header_size;
+    end_ = reinterpret_cast<std::byte*>(chunk) + size;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <memory_resource>
+
+// Memory for structures that are built up and thrown away as a whole. Blocks of up to MAX_SMALL_BLOCK_SIZE bytes
+// are carved out of chunks that double in size up to MAX_CHUNK_SIZE; freed ones go to a free list of their size
+// class and are handed out again. Larger blocks come from 'upstream' one by one.
+// Release returns everything to 'upstream' with one free per chunk and large block, without visiting the blocks
+// handed out. So objects whose memory is all in the arena may be abandoned instead of destroyed, see SearchServer::Clear.
+// Not thread-safe.
+class ArenaResource : public std::pmr::memory_resource {
+public:
+    explicit ArenaResource(std::pmr::memory_resource* upstream = std::pmr::get_default_resource());
+
+    ArenaResource(const ArenaResource&) = delete;
+    ArenaResource& operator=(const ArenaResource&) = delete;
+
+    ~ArenaResource() override;
+
+    // Frees all memory at once, every block handed out becomes invalid
+    void Release();
+
+    // Chunks and large blocks held from 'upstream', the number of frees Release makes
+    [[nodiscard]] size_t GetUpstreamBlockCount() const;
+
+private:
+    static const size_t SIZE_CLASS_GRANULARITY = 16;
+    static const size_t MAX_SMALL_BLOCK_SIZE = 4096;
+    static const size_t MIN_CHUNK_SIZE = 16 * 1024;
+    static const size_t MAX_CHUNK_SIZE = 1024 * 1024;
+
+    struct Chunk {
+        Chunk* next;
+        size_t size;
+    };
+
+    // Header in front of a large block
+    struct LargeBlock {
+        LargeBlock* previous;
+        LargeBlock* next;
+        size_t size;
+        size_t alignment;
+    };
+
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    std::pmr::memory_resource* upstream_;
+    Chunk* chunks_ = nullptr;
+    size_t chunk_count_ = 0;
+    size_t next_chunk_size_ = MIN_CHUNK_SIZE;
+    // Unused rest of the newest chunk
+    std::byte* current_ = nullptr;
+    std::byte* end_ = nullptr;
+    LargeBlock* large_blocks_ = nullptr;
+    size_t large_block_count_ = 0;
+    std::array<FreeBlock*, MAX_SMALL_BLOCK_SIZE / SIZE_CLASS_GRANULARITY> free_lists_{};
+
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void* pointer, size_t bytes, size_t alignment) override;
+    [[nodiscard]] bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+
+    [[nodiscard]] static bool IsSmall(size_t bytes, size_t alignment);
+    // Bytes from the start of a large block's allocation to the memory handed out
+    [[nodiscard]] static size_t GetLargeHeaderSize(size_t alignment);
+
+    void AddChunk(size_t min_size);
+};
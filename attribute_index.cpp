@@ -0,0 +1,319 @@
+#include "attribute_index.h"
+
+#include <algorithm>
+#include <iterator>
+
+namespace {
+
+// A container turns into a bitset beyond this many ids, and back into an array at half of it,
+// so a container near the limit doesn't switch on every change
+const size_t MAX_ARRAY_SIZE = 4096;
+const size_t BITSET_WORDS = 65536 / 64;
+
+const size_t STATUS_COUNT = static_cast<size_t>(DocumentStatus::REMOVED) + 1;
+
+uint16_t GetKey(int document_id) {
+    return static_cast<uint16_t>(static_cast<uint32_t>(document_id) >> 16);
+}
+
+uint16_t GetLow(int document_id) {
+    return static_cast<uint16_t>(document_id & 0xFFFF);
+}
+
+DocumentBitmap Unite(const std::vector<const DocumentBitmap*>& bitmaps) {
+    DocumentBitmap documents;
+    for (const DocumentBitmap* bitmap : bitmaps) {
+        documents.UniteWith(*bitmap);
+    }
+    return documents;
+}
+
+} // namespace
+
+DocumentBitmap::Container::Container(uint16_t key, std::pmr::memory_resource* resource)
+        : key(key)
+        , values(resource)
+        , bits(resource) {
+}
+
+bool DocumentBitmap::Container::Contains(uint16_t low) const {
+    if (bits.empty()) {
+        return std::binary_search(values.begin(), values.end(), low);
+    }
+    return (bits[low / 64] >> (low % 64)) & 1;
+}
+
+void DocumentBitmap::Container::ToBitset() {
+    bits.assign(BITSET_WORDS, 0);
+    for (const uint16_t low : values) {
+        bits[low / 64] |= uint64_t{1} << (low % 64);
+    }
+    std::pmr::vector<uint16_t>(values.get_allocator()).swap(values);
+}
+
+void DocumentBitmap::Container::ToArray() {
+    values.clear();
+    values.reserve(size);
+    for (size_t word = 0; word < bits.size(); ++word) {
+        for (uint64_t word_bits = bits[word]; word_bits != 0; word_bits &= word_bits - 1) {
+            values.push_back(static_cast<uint16_t>(word * 64 + __builtin_ctzll(word_bits)));
+        }
+    }
+    std::pmr::vector<uint64_t>(bits.get_allocator()).swap(bits);
+}
+
+DocumentBitmap::DocumentBitmap(std::pmr::memory_resource* resource)
+        : containers_(resource) {
+}
+
+void DocumentBitmap::Add(int document_id) {
+    const uint16_t key = GetKey(document_id);
+    const uint16_t low = GetLow(document_id);
+    auto it = std::lower_bound(containers_.begin(), containers_.end(), key, [](const Container& container, uint16_t key) {
+        return container.key < key;
+    });
+    if (it == containers_.end() || it->key != key) {
+        it = containers_.insert(it, Container(key, containers_.get_allocator().resource()));
+    }
+    Container& container = *it;
+    if (container.Contains(low)) {
+        return;
+    }
+    if (container.bits.empty() && container.values.size() == MAX_ARRAY_SIZE) {
+        container.ToBitset();
+    }
+    if (container.bits.empty()) {
+        container.values.insert(std::lower_bound(container.values.begin(), container.values.end(), low), low);
+    } else {
+        container.bits[low / 64] |= uint64_t{1} << (low % 64);
+    }
+    ++container.size;
+    ++size_;
+}
+
+void DocumentBitmap::Remove(int document_id) {
+    const uint16_t low = GetLow(document_id);
+    const Container* found = FindContainer(GetKey(document_id));
+    if (found == nullptr || !found->Contains(low)) {
+        return;
+    }
+    const auto it = containers_.begin() + (found - containers_.data());
+    if (it->bits.empty()) {
+        it->values.erase(std::lower_bound(it->values.begin(), it->values.end(), low));
+    } else {
+        it->bits[low / 64] &= ~(uint64_t{1} << (low % 64));
+    }
+    --it->size;
+    --size_;
+    if (it->size == 0) {
+        containers_.erase(it);
+    } else if (!it->bits.empty() && it->size <= MAX_ARRAY_SIZE / 2) {
+        it->ToArray();
+    }
+}
+
+bool DocumentBitmap::Contains(int document_id) const {
+    const Container* container = FindContainer(GetKey(document_id));
+    return container != nullptr && container->Contains(GetLow(document_id));
+}
+
+size_t DocumentBitmap::size() const {
+    return size_;
+}
+
+bool DocumentBitmap::empty() const {
+    return size_ == 0;
+}
+
+void DocumentBitmap::IntersectWith(const DocumentBitmap& other) {
+    auto output = containers_.begin();
+    size_ = 0;
+    for (auto it = containers_.begin(); it != containers_.end(); ++it) {
+        const Container* other_container = other.FindContainer(it->key);
+        if (other_container == nullptr) {
+            continue;
+        }
+        Container& container = *it;
+        if (!container.bits.empty() && !other_container->bits.empty()) {
+            container.size = 0;
+            for (size_t word = 0; word < BITSET_WORDS; ++word) {
+                container.bits[word] &= other_container->bits[word];
+                container.size += __builtin_popcountll(container.bits[word]);
+            }
+            if (container.size <= MAX_ARRAY_SIZE) {
+                container.ToArray();
+            }
+        } else if (!container.bits.empty()) {
+            // The sparse side decides which ids are left
+            container.values.clear();
+            std::copy_if(other_container->values.begin(), other_container->values.end(), std::back_inserter(container.values),
+                         [&container](uint16_t low) {
+                return container.Contains(low);
+            });
+            std::pmr::vector<uint64_t>(container.bits.get_allocator()).swap(container.bits);
+            container.size = container.values.size();
+        } else {
+            container.values.erase(std::remove_if(container.values.begin(), container.values.end(), [other_container](uint16_t low) {
+                return !other_container->Contains(low);
+            }), container.values.end());
+            container.size = container.values.size();
+        }
+        if (container.size > 0) {
+            size_ += container.size;
+            if (output != it) {
+                *output = std::move(container);
+            }
+            ++output;
+        }
+    }
+    containers_.erase(output, containers_.end());
+}
+
+void DocumentBitmap::UniteWith(const DocumentBitmap& other) {
+    auto it = containers_.begin();
+    for (const Container& other_container : other.containers_) {
+        it = std::lower_bound(it, containers_.end(), other_container.key, [](const Container& container, uint16_t key) {
+            return container.key < key;
+        });
+        if (it == containers_.end() || it->key != other_container.key) {
+            it = containers_.insert(it, Container(other_container.key, containers_.get_allocator().resource()));
+        }
+        Container& container = *it;
+        size_ -= container.size;
+        if (container.bits.empty() && other_container.bits.empty()
+            && container.values.size() + other_container.values.size() <= MAX_ARRAY_SIZE) {
+            std::pmr::vector<uint16_t> values(container.values.get_allocator());
+            values.reserve(container.values.size() + other_container.values.size());
+            std::set_union(container.values.begin(), container.values.end(), other_container.values.begin(),
+                           other_container.values.end(), std::back_inserter(values));
+            container.values.swap(values);
+            container.size = container.values.size();
+        } else {
+            if (container.bits.empty()) {
+                container.ToBitset();
+            }
+            if (other_container.bits.empty()) {
+                for (const uint16_t low : other_container.values) {
+                    container.bits[low / 64] |= uint64_t{1} << (low % 64);
+                }
+            } else {
+                for (size_t word = 0; word < BITSET_WORDS; ++word) {
+                    container.bits[word] |= other_container.bits[word];
+                }
+            }
+            container.size = 0;
+            for (const uint64_t word : container.bits) {
+                container.size += __builtin_popcountll(word);
+            }
+            if (container.size <= MAX_ARRAY_SIZE / 2) {
+                container.ToArray();
+            }
+        }
+        size_ += container.size;
+        ++it;
+    }
+}
+
+const DocumentBitmap::Container* DocumentBitmap::FindContainer(uint16_t key) const {
+    const auto it = std::lower_bound(containers_.begin(), containers_.end(), key, [](const Container& container, uint16_t key) {
+        return container.key < key;
+    });
+    if (it == containers_.end() || it->key != key) {
+        return nullptr;
+    }
+    return &*it;
+}
+
+bool DocumentFilter::operator()(int, DocumentStatus status, int rating) const {
+    return (statuses.empty() || std::find(statuses.begin(), statuses.end(), status) != statuses.end())
+           && (!min_rating || rating >= *min_rating) && (!max_rating || rating <= *max_rating);
+}
+
+AttributeIndex::AttributeIndex(std::pmr::memory_resource* resource)
+        : resource_(resource)
+        , status_documents_(resource)
+        , rating_documents_(resource) {
+    for (size_t i = 0; i < STATUS_COUNT; ++i) {
+        status_documents_.emplace_back(resource);
+    }
+}
+
+void AttributeIndex::AddDocument(int document_id, DocumentStatus status, int rating) {
+    status_documents_.at(static_cast<size_t>(status)).Add(document_id);
+    rating_documents_.try_emplace(rating, resource_).first->second.Add(document_id);
+}
+
+void AttributeIndex::RemoveDocument(int document_id, DocumentStatus status, int rating) {
+    status_documents_.at(static_cast<size_t>(status)).Remove(document_id);
+    const auto it = rating_documents_.find(rating);
+    if (it != rating_documents_.end()) {
+        it->second.Remove(document_id);
+        if (it->second.empty()) {
+            rating_documents_.erase(it);
+        }
+    }
+}
+
+DocumentBitmap AttributeIndex::Select(const DocumentFilter& filter) const {
+    const std::vector<const DocumentBitmap*> status_bitmaps = GetStatusBitmaps(filter);
+    if (!filter.min_rating && !filter.max_rating) {
+        return Unite(status_bitmaps);
+    }
+    const std::vector<const DocumentBitmap*> rating_bitmaps = GetRatingBitmaps(filter);
+    if (filter.statuses.empty()) {
+        return Unite(rating_bitmaps);
+    }
+    const bool is_status_smaller = CountByStatus(filter) <= CountByRating(filter);
+    const DocumentBitmap smaller = Unite(is_status_smaller ? status_bitmaps : rating_bitmaps);
+    DocumentBitmap documents;
+    for (const DocumentBitmap* bitmap : is_status_smaller ? rating_bitmaps : status_bitmaps) {
+        DocumentBitmap part = smaller;
+        part.IntersectWith(*bitmap);
+        documents.UniteWith(part);
+    }
+    return documents;
+}
+
+size_t AttributeIndex::CountByStatus(const DocumentFilter& filter) const {
+    // A status listed twice is counted twice, the count only has to be an upper bound
+    size_t count = 0;
+    for (const DocumentBitmap* bitmap : GetStatusBitmaps(filter)) {
+        count += bitmap->size();
+    }
+    return count;
+}
+
+size_t AttributeIndex::CountByRating(const DocumentFilter& filter) const {
+    size_t count = 0;
+    for (const DocumentBitmap* bitmap : GetRatingBitmaps(filter)) {
+        count += bitmap->size();
+    }
+    return count;
+}
+
+std::vector<const DocumentBitmap*> AttributeIndex::GetStatusBitmaps(const DocumentFilter& filter) const {
+    std::vector<const DocumentBitmap*> bitmaps;
+    if (filter.statuses.empty()) {
+        for (const DocumentBitmap& status_documents : status_documents_) {
+            bitmaps.push_back(&status_documents);
+        }
+    } else {
+        for (const DocumentStatus status : filter.statuses) {
+            bitmaps.push_back(&status_documents_.at(static_cast<size_t>(status)));
+        }
+    }
+    return bitmaps;
+}
+
+std::vector<const DocumentBitmap*> AttributeIndex::GetRatingBitmaps(const DocumentFilter& filter) const {
+    std::vector<const DocumentBitmap*> bitmaps;
+    if (filter.min_rating && filter.max_rating && *filter.min_rating > *filter.max_rating) {
+        return bitmaps;
+    }
+    // Ratings are ordered, the range is a run of neighbouring bitmaps
+    const auto end = filter.max_rating ? rating_documents_.upper_bound(*filter.max_rating) : rating_documents_.end();
+    for (auto it = filter.min_rating ? rating_documents_.lower_bound(*filter.min_rating) : rating_documents_.begin(); it != end; ++it) {
+        bitmaps.push_back(&it->second);
+    }
+    return bitmaps;
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include "document.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory_resource>
+#include <optional>
+#include <vector>
+
+// Set of document ids split like a roaring bitmap: ids sharing the upper 16 bits go to one container,
+// a sorted array of the lower bits while it holds at most 4096 of them and a 65536 bit bitset beyond that.
+// Sparse and dense sets both stay compact, and intersecting a small set with a large one costs the small one.
+class DocumentBitmap {
+public:
+    explicit DocumentBitmap(std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+    // Ids must not be negative
+    void Add(int document_id);
+    void Remove(int document_id);
+
+    [[nodiscard]] bool Contains(int document_id) const;
+    [[nodiscard]] size_t size() const;
+    [[nodiscard]] bool empty() const;
+
+    // Keeps the ids present in both
+    void IntersectWith(const DocumentBitmap& other);
+    // Adds the ids of 'other'
+    void UniteWith(const DocumentBitmap& other);
+
+    // Calls 'func(document_id)' in ascending order
+    template <typename Func>
+    void ForEach(Func func) const {
+        for (const Container& container : containers_) {
+            const int high = static_cast<int>(container.key) << 16;
+            if (container.bits.empty()) {
+                for (const uint16_t low : container.values) {
+                    func(high | low);
+                }
+                continue;
+            }
+            for (size_t word = 0; word < container.bits.size(); ++word) {
+                for (uint64_t bits = container.bits[word]; bits != 0; bits &= bits - 1) {
+                    func(high | static_cast<int>(word * 64 + __builtin_ctzll(bits)));
+                }
+            }
+        }
+    }
+
+private:
+    struct Container {
+        explicit Container(uint16_t key, std::pmr::memory_resource* resource);
+
+        uint16_t key;
+        // Sorted lower bits while the container is sparse, otherwise empty
+        std::pmr::vector<uint16_t> values;
+        // 1024 words once the container is dense, otherwise empty
+        std::pmr::vector<uint64_t> bits;
+        size_t size = 0;
+
+        [[nodiscard]] bool Contains(uint16_t low) const;
+        void ToBitset();
+        void ToArray();
+    };
+
+    // Sorted by key
+    std::pmr::vector<Container> containers_;
+    size_t size_ = 0;
+
+    [[nodiscard]] const Container* FindContainer(uint16_t key) const;
+};
+
+// Declarative restriction on the documents a query may return. Unlike an opaque predicate it is answered
+// from the attribute index, so a selective filter doesn't have to visit every posting of the query words.
+struct DocumentFilter {
+    // Empty allows every status
+    std::vector<DocumentStatus> statuses;
+    std::optional<int> min_rating;
+    std::optional<int> max_rating;
+
+    // The same condition as a predicate of FindTopDocuments
+    bool operator()(int document_id, DocumentStatus status, int rating) const;
+};
+
+// Documents by status, one bitmap per status, and by rating, a bitmap per distinct rating ordered by rating
+class AttributeIndex {
+public:
+    explicit AttributeIndex(std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+    void AddDocument(int document_id, DocumentStatus status, int rating);
+    // 'status' and 'rating' must be the ones the document was added with
+    void RemoveDocument(int document_id, DocumentStatus status, int rating);
+
+    // Documents passing 'filter'. The bitmaps of the smaller side of the filter, statuses or ratings, are united
+    // and intersected with each bitmap of the other side, so the cost follows the smaller side.
+    [[nodiscard]] DocumentBitmap Select(const DocumentFilter& filter) const;
+
+    // Documents with one of the statuses of 'filter' (all of them if it lists none) and documents with a rating
+    // in its range, counted without building the sets. Select returns at most the smaller of the two.
+    [[nodiscard]] size_t CountByStatus(const DocumentFilter& filter) const;
+    [[nodiscard]] size_t CountByRating(const DocumentFilter& filter) const;
+
+private:
+    std::pmr::memory_resource* resource_;
+    std::pmr::vector<DocumentBitmap> status_documents_;
+    std::pmr::map<int, DocumentBitmap> rating_documents_;
+
+    // Bitmaps of the statuses of 'filter', of every status if it lists none
+    [[nodiscard]] std::vector<const DocumentBitmap*> GetStatusBitmaps(const DocumentFilter& filter) const;
+    // Bitmaps of the ratings within the range of 'filter'
+    [[nodiscard]] std::vector<const DocumentBitmap*> GetRatingBitmaps(const DocumentFilter& filter) const;
+};
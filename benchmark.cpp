@@ -0,0 +1,227 @@
+#include "benchmark.h"
+#include "search_server.h"
+#include "remove_duplicates.h"
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+class WordGenerator {
+public:
+    WordGenerator(size_t vocabulary_size, unsigned seed)
+            : random_(seed) {
+        std::vector<double> weights(vocabulary_size);
+        for (size_t rank = 0; rank < vocabulary_size; ++rank) {
+            weights[rank] = 1.0 / (rank + 1);
+        }
+        distribution_ = std::discrete_distribution<size_t>(weights.begin(), weights.end());
+    }
+
+    std::string GenerateText(size_t word_count) {
+        std::string text;
+        for (size_t i = 0; i < word_count; ++i) {
+            if (i > 0) {
+                text += ' ';
+            }
+            text += 'w';
+            text += std::to_string(distribution_(random_));
+        }
+        return text;
+    }
+
+private:
+    std::mt19937 random_;
+    std::discrete_distribution<size_t> distribution_;
+};
+
+double SecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+std::optional<double> PerOperation(const std::optional<uint64_t>& value, size_t operations) {
+    if (!value || operations == 0) {
+        return std::nullopt;
+    }
+    return static_cast<double>(*value) / operations;
+}
+
+// Times 'body' that makes 'operations' calls, and reads the counters around it if there are any
+template <typename Body>
+std::optional<OperationProfile> Measure(PerfCounters* counters, size_t operations, double& seconds, Body body) {
+    if (counters != nullptr) {
+        counters->Start();
+    }
+    const auto start = std::chrono::steady_clock::now();
+    body();
+    seconds = SecondsSince(start);
+    if (counters == nullptr) {
+        return std::nullopt;
+    }
+    OperationProfile profile;
+    profile.operations = operations;
+    profile.counters = counters->Stop();
+    return profile;
+}
+
+void PrintProfile(std::ostream& output, const std::string& name, double seconds,
+                  const std::optional<OperationProfile>& profile) {
+    const auto print_value = [&output](const std::optional<double>& value) {
+        if (value) {
+            output << *value;
+        } else {
+            output << "n/a";
+        }
+    };
+    output << name << ": " << seconds << " s";
+    if (profile) {
+        output << ", IPC = ";
+        print_value(profile->counters.GetInstructionsPerCycle());
+        output << ", cache misses per call = ";
+        print_value(profile->GetCacheMissesPerOperation());
+        output << ", branch misses per call = ";
+        print_value(profile->GetBranchMissesPerOperation());
+    }
+    output << '\n';
+}
+
+struct Corpus {
+    std::vector<std::string> documents;
+    std::vector<std::string> queries;
+};
+
+Corpus GenerateCorpus(const BenchmarkOptions& options) {
+    WordGenerator generator(options.vocabulary_size, options.seed);
+    std::mt19937 duplicate_random(options.seed);
+    std::bernoulli_distribution is_duplicate(options.duplicate_share);
+    Corpus corpus;
+    corpus.documents.reserve(options.document_count);
+    for (size_t i = 0; i < options.document_count; ++i) {
+        if (i > 0 && is_duplicate(duplicate_random)) {
+            corpus.documents.push_back(corpus.documents[std::uniform_int_distribution<size_t>(0, i - 1)(duplicate_random)]);
+        } else {
+            corpus.documents.push_back(generator.GenerateText(options.words_per_document));
+        }
+    }
+    corpus.queries.reserve(options.query_count);
+    for (size_t i = 0; i < options.query_count; ++i) {
+        corpus.queries.push_back(generator.GenerateText(options.words_per_query));
+    }
+    return corpus;
+}
+
+void AddDocuments(SearchServer& server, const std::vector<std::string>& documents) {
+    for (size_t i = 0; i < documents.size(); ++i) {
+        server.AddDocument(static_cast<int>(i), documents[i], DocumentStatus::ACTUAL, { static_cast<int>(i % 10) });
+    }
+}
+
+AllocationRun RunAllocations(const Corpus& corpus, bool arena_allocation) {
+    IndexOptions index_options;
+    index_options.arena_allocation = arena_allocation;
+    AllocationRun run;
+    auto server = std::make_unique<SearchServer>(std::string("w0 w1"), index_options);
+    server->SetDurationLog(nullptr);
+    auto start = std::chrono::steady_clock::now();
+    AddDocuments(*server, corpus.documents);
+    run.build_seconds = SecondsSince(start);
+    start = std::chrono::steady_clock::now();
+    for (const std::string& query : corpus.queries) {
+        run.found_documents += server->FindTopDocuments(query).size();
+    }
+    run.query_seconds = SecondsSince(start);
+    run.memory = server->GetMemoryStats().GetTotal();
+    start = std::chrono::steady_clock::now();
+    server.reset();
+    run.teardown_seconds = SecondsSince(start);
+    return run;
+}
+
+// Keeps the fastest time of every phase
+void KeepFastest(AllocationRun& best, const AllocationRun& run) {
+    best.build_seconds = std::min(best.build_seconds, run.build_seconds);
+    best.query_seconds = std::min(best.query_seconds, run.query_seconds);
+    best.teardown_seconds = std::min(best.teardown_seconds, run.teardown_seconds);
+}
+
+void PrintAllocationRun(std::ostream& output, const std::string& name, const AllocationRun& run) {
+    output << name << ": build = " << run.build_seconds << " s, "
+        << "queries = " << run.query_seconds << " s, "
+        << "teardown = " << run.teardown_seconds << " s, "
+        << "memory = " << run.memory << '\n';
+}
+
+} // namespace
+
+std::optional<double> OperationProfile::GetCacheMissesPerOperation() const {
+    return PerOperation(counters.cache_misses, operations);
+}
+
+std::optional<double> OperationProfile::GetBranchMissesPerOperation() const {
+    return PerOperation(counters.branch_misses, operations);
+}
+
+BenchmarkResult RunBenchmark(const BenchmarkOptions& options, std::ostream& output) {
+    const auto [documents, queries] = GenerateCorpus(options);
+
+    std::unique_ptr<PerfCounters> counters;
+    if (options.profile) {
+        counters = std::make_unique<PerfCounters>();
+        if (!counters->IsAvailable()) {
+            output << "profiling skipped: " << counters->GetError() << '\n';
+            counters.reset();
+        }
+    }
+
+    BenchmarkResult result;
+    SearchServer server(std::string("w0 w1"));
+    server.SetDurationLog(nullptr);
+    result.add_profile = Measure(counters.get(), documents.size(), result.add_seconds, [&] {
+        AddDocuments(server, documents);
+    });
+    result.query_profile = Measure(counters.get(), queries.size(), result.query_seconds, [&] {
+        for (const std::string& query : queries) {
+            result.found_documents += server.FindTopDocuments(query).size();
+        }
+    });
+    result.memory = server.GetMemoryStats();
+    result.remove_duplicates_profile = Measure(counters.get(), documents.size(), result.remove_duplicates_seconds, [&] {
+        RemoveDuplicates(server, nullptr);
+    });
+    result.removed_duplicates = documents.size() - server.GetDocumentCount();
+
+    output << "documents = " << options.document_count << ", "
+        << "queries = " << options.query_count << ", "
+        << "duplicates removed = " << result.removed_duplicates << '\n';
+    PrintProfile(output, "AddDocument", result.add_seconds, result.add_profile);
+    PrintProfile(output, "FindTopDocuments", result.query_seconds, result.query_profile);
+    PrintProfile(output, "RemoveDuplicates", result.remove_duplicates_seconds, result.remove_duplicates_profile);
+    output << result.memory << std::endl;
+    return result;
+}
+
+AllocationBenchmarkResult RunAllocationBenchmark(const BenchmarkOptions& options, std::ostream& output) {
+    const Corpus corpus = GenerateCorpus(options);
+    AllocationBenchmarkResult result;
+    for (size_t round = 0; round < std::max<size_t>(options.allocation_rounds, 1); ++round) {
+        for (const bool arena_allocation : {round % 2 == 1, round % 2 == 0}) {
+            AllocationRun& best = arena_allocation ? result.arena : result.heap;
+            const AllocationRun run = RunAllocations(corpus, arena_allocation);
+            if (round == 0) {
+                best = run;
+            } else {
+                KeepFastest(best, run);
+            }
+        }
+    }
+    output << "documents = " << options.document_count << ", "
+        << "queries = " << options.query_count << '\n';
+    PrintAllocationRun(output, "heap", result.heap);
+    PrintAllocationRun(output, "arena", result.arena);
+    output.flush();
+    return result;
+}
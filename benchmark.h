@@ -0,0 +1,75 @@
+#pragma once
+
+#include "memory_stats.h"
+#include "perf_counters.h"
+
+#include <cstddef>
+#include <iostream>
+#include <optional>
+
+struct BenchmarkOptions {
+    size_t document_count = 50000;
+    size_t words_per_document = 40;
+    // Words are drawn from this many distinct ones with Zipf-like frequencies
+    size_t vocabulary_size = 20000;
+    size_t query_count = 500;
+    size_t words_per_query = 3;
+    // Share of documents that repeat an earlier one, RemoveDuplicates has something to find
+    double duplicate_share = 0.05;
+    unsigned seed = 42;
+    // Reads hardware counters around every benchmarked operation
+    bool profile = false;
+    // RunAllocationBenchmark runs each allocation mode this many times, alternating which one goes first
+    size_t allocation_rounds = 4;
+};
+
+// Hardware counters of one benchmarked operation over all its calls
+struct OperationProfile {
+    size_t operations = 0;
+    HardwareCounters counters;
+
+    [[nodiscard]] std::optional<double> GetCacheMissesPerOperation() const;
+    [[nodiscard]] std::optional<double> GetBranchMissesPerOperation() const;
+};
+
+struct BenchmarkResult {
+    double add_seconds = 0;
+    double query_seconds = 0;
+    double remove_duplicates_seconds = 0;
+    size_t found_documents = 0;
+    size_t removed_duplicates = 0;
+    // Index before the duplicates are removed
+    MemoryStats memory;
+    // Filled when profiling was asked for and the counters are available
+    std::optional<OperationProfile> add_profile;
+    std::optional<OperationProfile> query_profile;
+    std::optional<OperationProfile> remove_duplicates_profile;
+};
+
+/// Indexes a synthetic corpus, runs random queries against it, removes the duplicates and prints
+/// the timings and the memory used by the index. With 'profile' set every operation also gets
+/// its IPC, cache misses and branch misses; profiling is skipped with a note if the counters are unavailable.
+/// @param <output> Receives the report; per-query timing lines of the server are suppressed
+BenchmarkResult RunBenchmark(const BenchmarkOptions& options = {}, std::ostream& output = std::cout);
+
+struct AllocationRun {
+    double build_seconds = 0;
+    double query_seconds = 0;
+    // Destroying the server after the queries
+    double teardown_seconds = 0;
+    size_t found_documents = 0;
+    // What the index structures hold once built
+    StructureMemoryStats memory;
+};
+
+struct AllocationBenchmarkResult {
+    AllocationRun heap;
+    AllocationRun arena;
+};
+
+/// Builds, queries and destroys the synthetic index of RunBenchmark with the structures allocating from the heap
+/// and from the server's arena (IndexOptions::arena_allocation), 'allocation_rounds' times each. The modes take
+/// turns going first, so neither always inherits the heap warmed up by the other; every phase keeps its fastest round.
+/// Duplicates are kept and profiling is ignored.
+/// @param <output> Receives the timings of both modes
+AllocationBenchmarkResult RunAllocationBenchmark(const BenchmarkOptions& options = {}, std::ostream& output = std::cout);
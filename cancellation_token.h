@@ -0,0 +1,42 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+
+class OperationCancelled : public std::runtime_error {
+public:
+    OperationCancelled() : std::runtime_error("Operation was cancelled") {
+    }
+};
+
+// Copies share the same flag. A default constructed token is never cancelled and costs nothing to check.
+class CancellationToken {
+public:
+    CancellationToken() = default;
+
+    static CancellationToken Create() {
+        CancellationToken token;
+        token.cancelled_ = std::make_shared<std::atomic<bool>>(false);
+        return token;
+    }
+
+    void Cancel() const {
+        if (cancelled_) {
+            cancelled_->store(true, std::memory_order_relaxed);
+        }
+    }
+
+    [[nodiscard]] bool IsCancelled() const {
+        return cancelled_ && cancelled_->load(std::memory_order_relaxed);
+    }
+
+    void ThrowIfCancelled() const {
+        if (IsCancelled()) {
+            throw OperationCancelled();
+        }
+    }
+
+private:
+    std::shared_ptr<std::atomic<bool>> cancelled_;
+};
@@ -0,0 +1,501 @@
+#include "corpus_loader.h"
+
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <stdexcept>
+#include <utility>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define SEARCH_SERVER_HAS_MMAP 1
+#endif
+
+namespace {
+
+const size_t STREAM_CHUNK_SIZE = 16 << 20;
+
+struct CorpusRecord {
+    int id = 0;
+    DocumentStatus status = DocumentStatus::ACTUAL;
+    std::vector<int> ratings;
+    // Points into the file content or, for JSON text with escapes, into 'unescaped_text'
+    std::string_view text;
+    std::string unescaped_text;
+};
+
+// Read-only mapping of a whole file, empty if the file can't be mapped
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path) {
+#ifdef SEARCH_SERVER_HAS_MMAP
+        const int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return;
+        }
+        struct stat file_stat{};
+        if (fstat(fd, &file_stat) == 0 && S_ISREG(file_stat.st_mode) && file_stat.st_size > 0) {
+            void* data = mmap(nullptr, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data != MAP_FAILED) {
+                madvise(data, file_stat.st_size, MADV_SEQUENTIAL);
+                data_ = static_cast<const char*>(data);
+                size_ = file_stat.st_size;
+            }
+        }
+        close(fd);
+#endif
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() {
+#ifdef SEARCH_SERVER_HAS_MMAP
+        if (data_ != nullptr) {
+            munmap(const_cast<char*>(data_), size_);
+        }
+#endif
+    }
+
+    [[nodiscard]] bool IsMapped() const {
+        return data_ != nullptr;
+    }
+
+    [[nodiscard]] std::string_view GetContent() const {
+        return {data_, size_};
+    }
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+[[noreturn]] void ThrowMalformed(size_t line_number, const std::string& reason) {
+    throw std::invalid_argument("Corpus line " + std::to_string(line_number) + ": " + reason);
+}
+
+int ParseInt(std::string_view text, size_t line_number) {
+    int value = 0;
+    const auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+    if (error != std::errc() || end != text.data() + text.size()) {
+        ThrowMalformed(line_number, "'" + std::string(text) + "' is not a number");
+    }
+    return value;
+}
+
+DocumentStatus ParseStatus(std::string_view text, size_t line_number) {
+    static const std::pair<std::string_view, DocumentStatus> statuses[] = {
+            {"ACTUAL", DocumentStatus::ACTUAL},
+            {"IRRELEVANT", DocumentStatus::IRRELEVANT},
+            {"BANNED", DocumentStatus::BANNED},
+            {"REMOVED", DocumentStatus::REMOVED},
+    };
+    for (size_t i = 0; i < std::size(statuses); ++i) {
+        if (text == statuses[i].first || text == std::to_string(i)) {
+            return statuses[i].second;
+        }
+    }
+    ThrowMalformed(line_number, "unknown document status '" + std::string(text) + "'");
+}
+
+void ParseRatings(std::string_view text, size_t line_number, std::vector<int>& ratings) {
+    ratings.clear();
+    while (!text.empty()) {
+        const size_t separator = text.find_first_of(" ,");
+        if (separator != 0) {
+            ratings.push_back(ParseInt(text.substr(0, separator), line_number));
+        }
+        if (separator == std::string_view::npos) {
+            break;
+        }
+        text.remove_prefix(separator + 1);
+    }
+}
+
+void ParseTsvRecord(std::string_view line, size_t line_number, CorpusRecord& record) {
+    std::string_view fields[3];
+    for (std::string_view& field : fields) {
+        const size_t tab = line.find('\t');
+        if (tab == std::string_view::npos) {
+            ThrowMalformed(line_number, "expected 4 tab-separated fields");
+        }
+        field = line.substr(0, tab);
+        line.remove_prefix(tab + 1);
+    }
+    record.id = ParseInt(fields[0], line_number);
+    record.status = ParseStatus(fields[1], line_number);
+    ParseRatings(fields[2], line_number, record.ratings);
+    record.text = line;
+}
+
+// Just enough JSON for flat records: string, integer and integer array values
+class JsonRecordParser {
+public:
+    // Unescaped strings are kept in 'text_storage' for the text and in 'scratch' for keys and statuses,
+    // so the record text stays intact while the rest of the line is parsed
+    JsonRecordParser(std::string_view line, size_t line_number, std::string& text_storage, std::string& scratch)
+            : line_(line), line_number_(line_number), text_storage_(text_storage), scratch_(scratch) {
+    }
+
+    void Parse(CorpusRecord& record) {
+        bool has_id = false;
+        bool has_text = false;
+        record.status = DocumentStatus::ACTUAL;
+        record.ratings.clear();
+
+        Expect('{');
+        if (Peek() == '}') {
+            ++pos_;
+        } else {
+            while (true) {
+                const std::string_view key = ParseString(scratch_);
+                Expect(':');
+                if (key == "id") {
+                    record.id = ParseInt(ParseNumber(), line_number_);
+                    has_id = true;
+                } else if (key == "status") {
+                    record.status = Peek() == '"' ? ParseStatus(ParseString(scratch_), line_number_)
+                                                  : ParseStatus(ParseNumber(), line_number_);
+                } else if (key == "ratings") {
+                    ParseNumberArray(record.ratings);
+                } else if (key == "text") {
+                    record.text = ParseString(text_storage_);
+                    has_text = true;
+                } else {
+                    ThrowMalformed(line_number_, "unexpected key '" + std::string(key) + "'");
+                }
+                if (Peek() == ',') {
+                    ++pos_;
+                    continue;
+                }
+                Expect('}');
+                break;
+            }
+        }
+        if (!has_id || !has_text) {
+            ThrowMalformed(line_number_, "'id' and 'text' are required");
+        }
+    }
+
+private:
+    std::string_view line_;
+    size_t pos_ = 0;
+    size_t line_number_;
+    std::string& text_storage_;
+    std::string& scratch_;
+
+    char Peek() {
+        while (pos_ < line_.size() && (line_[pos_] == ' ' || line_[pos_] == '\t')) {
+            ++pos_;
+        }
+        return pos_ < line_.size() ? line_[pos_] : '\0';
+    }
+
+    void Expect(char c) {
+        if (Peek() != c) {
+            ThrowMalformed(line_number_, std::string("expected '") + c + "'");
+        }
+        ++pos_;
+    }
+
+    std::string_view ParseNumber() {
+        Peek();
+        const size_t begin = pos_;
+        while (pos_ < line_.size() && (line_[pos_] == '-' || (line_[pos_] >= '0' && line_[pos_] <= '9'))) {
+            ++pos_;
+        }
+        return line_.substr(begin, pos_ - begin);
+    }
+
+    void ParseNumberArray(std::vector<int>& numbers) {
+        Expect('[');
+        if (Peek() == ']') {
+            ++pos_;
+            return;
+        }
+        while (true) {
+            numbers.push_back(ParseInt(ParseNumber(), line_number_));
+            if (Peek() == ',') {
+                ++pos_;
+                continue;
+            }
+            Expect(']');
+            return;
+        }
+    }
+
+    // Returns a view into the line unless the string has escapes, then into 'unescaped'
+    std::string_view ParseString(std::string& unescaped) {
+        Expect('"');
+        const size_t begin = pos_;
+        const size_t end = line_.find_first_of("\"\\", pos_);
+        if (end == std::string_view::npos) {
+            ThrowMalformed(line_number_, "unterminated string");
+        }
+        if (line_[end] == '"') {
+            pos_ = end + 1;
+            return line_.substr(begin, end - begin);
+        }
+
+        unescaped.assign(line_.substr(begin, end - begin));
+        pos_ = end;
+        while (pos_ < line_.size() && line_[pos_] != '"') {
+            if (line_[pos_] != '\\') {
+                unescaped.push_back(line_[pos_++]);
+                continue;
+            }
+            if (++pos_ == line_.size()) {
+                break;
+            }
+            const char escaped = line_[pos_++];
+            switch (escaped) {
+                case 'n': unescaped.push_back('\n'); break;
+                case 't': unescaped.push_back('\t'); break;
+                case 'r': unescaped.push_back('\r'); break;
+                case 'b': unescaped.push_back('\b'); break;
+                case 'f': unescaped.push_back('\f'); break;
+                case 'u': AppendCodePoint(unescaped); break;
+                default: unescaped.push_back(escaped); break;
+            }
+        }
+        Expect('"');
+        return unescaped;
+    }
+
+    // Reads the 4 hex digits after '\\u'
+    unsigned ParseCodeUnit() {
+        if (pos_ + 4 > line_.size()) {
+            ThrowMalformed(line_number_, "truncated \\u escape");
+        }
+        unsigned code = 0;
+        const auto [end, error] = std::from_chars(line_.data() + pos_, line_.data() + pos_ + 4, code, 16);
+        if (error != std::errc() || end != line_.data() + pos_ + 4) {
+            ThrowMalformed(line_number_, "invalid \\u escape");
+        }
+        pos_ += 4;
+        return code;
+    }
+
+    // Appends the code point as UTF-8, characters beyond the BMP come as a '\\uD8xx\\uDCxx' surrogate pair
+    void AppendCodePoint(std::string& unescaped) {
+        unsigned code = ParseCodeUnit();
+        if (code >= 0xDC00 && code <= 0xDFFF) {
+            ThrowMalformed(line_number_, "unpaired surrogate in \\u escape");
+        }
+        if (code >= 0xD800 && code <= 0xDBFF) {
+            if (line_.substr(pos_, 2) != "\\u") {
+                ThrowMalformed(line_number_, "unpaired surrogate in \\u escape");
+            }
+            pos_ += 2;
+            const unsigned low = ParseCodeUnit();
+            if (low < 0xDC00 || low > 0xDFFF) {
+                ThrowMalformed(line_number_, "unpaired surrogate in \\u escape");
+            }
+            code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+        }
+        if (code < 0x80) {
+            unescaped.push_back(static_cast<char>(code));
+        } else if (code < 0x800) {
+            unescaped.push_back(static_cast<char>(0xC0 | (code >> 6)));
+            unescaped.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+        } else if (code < 0x10000) {
+            unescaped.push_back(static_cast<char>(0xE0 | (code >> 12)));
+            unescaped.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+            unescaped.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+        } else {
+            unescaped.push_back(static_cast<char>(0xF0 | (code >> 18)));
+            unescaped.push_back(static_cast<char>(0x80 | ((code >> 12) & 0x3F)));
+            unescaped.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+            unescaped.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+        }
+    }
+};
+
+// Parses complete lines of 'content' and adds them to the server in batches. The records of a batch
+// are tokenized in parallel on the shared thread pool and then added in file order.
+class CorpusParser {
+public:
+    CorpusParser(SearchServer& search_server, CorpusFormat format, const CorpusProgressCallback& progress,
+                 size_t batch_size, size_t bytes_total)
+            : search_server_(search_server), format_(format), progress_(progress)
+            , batch_size_(std::max<size_t>(batch_size, 1)) {
+        progress_state_.bytes_total = bytes_total;
+    }
+
+    void ParseLines(std::string_view content) {
+        while (!content.empty()) {
+            const size_t line_end = content.find('\n');
+            std::string_view line = content.substr(0, line_end);
+            content.remove_prefix(line_end == std::string_view::npos ? content.size() : line_end + 1);
+            progress_state_.bytes_done += line.size() + (line_end == std::string_view::npos ? 0 : 1);
+            ++line_number_;
+
+            if (!line.empty() && line.back() == '\r') {
+                line.remove_suffix(1);
+            }
+            if (!line.empty()) {
+                ParseLine(line);
+            }
+        }
+        // Texts point into 'content', which the caller may reuse
+        AddBatch();
+    }
+
+    void Finish() {
+        if (documents_in_batch_ > 0) {
+            ReportProgress();
+        }
+    }
+
+    [[nodiscard]] size_t GetDocumentCount() const {
+        return progress_state_.documents;
+    }
+
+private:
+    SearchServer& search_server_;
+    CorpusFormat format_;
+    const CorpusProgressCallback& progress_;
+    size_t batch_size_;
+    CorpusLoadProgress progress_state_;
+    size_t documents_in_batch_ = 0;
+    size_t line_number_ = 0;
+    // Records are reused from batch to batch, a deque keeps them in place so views into 'unescaped_text' stay valid
+    std::deque<CorpusRecord> batch_;
+    size_t batch_count_ = 0;
+    std::string unescaped_scratch_;
+
+    void ParseLine(std::string_view line) {
+        if (batch_count_ == batch_.size()) {
+            batch_.emplace_back();
+        }
+        CorpusRecord& record = batch_[batch_count_];
+        try {
+            if (format_ == CorpusFormat::TSV) {
+                ParseTsvRecord(line, line_number_, record);
+            } else {
+                JsonRecordParser(line, line_number_, record.unescaped_text, unescaped_scratch_).Parse(record);
+            }
+        } catch (...) {
+            // The records before a malformed one are still added
+            AddBatch();
+            throw;
+        }
+        if (++batch_count_ == batch_size_) {
+            AddBatch();
+        }
+    }
+
+    void AddBatch() {
+        const size_t count = std::exchange(batch_count_, 0);
+        if (count == 0) {
+            return;
+        }
+        std::vector<TokenizedDocument> word_freqs(count);
+        std::vector<std::exception_ptr> errors(count);
+        ThreadPool::GetShared().ParallelFor(count, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                try {
+                    word_freqs[i] = search_server_.ComputeWordFrequencies(batch_[i].text);
+                } catch (...) {
+                    errors[i] = std::current_exception();
+                }
+            }
+        });
+        // A record that fails stops the load at its place in the file, as AddDocument would
+        for (size_t i = 0; i < count; ++i) {
+            if (errors[i]) {
+                std::rethrow_exception(errors[i]);
+            }
+            AddRecord(batch_[i], word_freqs[i]);
+        }
+    }
+
+    void AddRecord(const CorpusRecord& record, const TokenizedDocument& word_freqs) {
+        search_server_.AddTokenizedDocument(record.id, word_freqs, record.status, record.ratings);
+        ++progress_state_.documents;
+        if (++documents_in_batch_ == batch_size_) {
+            ReportProgress();
+        }
+    }
+
+    void ReportProgress() {
+        documents_in_batch_ = 0;
+        if (progress_) {
+            progress_(progress_state_);
+        }
+    }
+};
+
+} // namespace
+
+double CorpusLoadStats::GetMegabytesPerSecond() const {
+    return seconds > 0 ? bytes / seconds / (1 << 20) : 0;
+}
+
+double CorpusLoadStats::GetDocumentsPerSecond() const {
+    return seconds > 0 ? documents / seconds : 0;
+}
+
+CorpusLoadStats LoadCorpus(SearchServer& search_server, const std::string& path, CorpusFormat format,
+                           const CorpusProgressCallback& progress, size_t batch_size) {
+    const auto start_time = std::chrono::steady_clock::now();
+    CorpusLoadStats stats;
+
+    const MappedFile mapped_file(path);
+    if (mapped_file.IsMapped()) {
+        const std::string_view content = mapped_file.GetContent();
+        CorpusParser parser(search_server, format, progress, batch_size, content.size());
+        parser.ParseLines(content);
+        parser.Finish();
+        stats.documents = parser.GetDocumentCount();
+        stats.bytes = content.size();
+    } else {
+        std::ifstream input(path, std::ios::binary);
+        if (!input) {
+            throw std::runtime_error("Cannot open corpus file '" + path + "'");
+        }
+        // Chunks are cut at the last line break, the incomplete line is moved to the next chunk
+        CorpusParser parser(search_server, format, progress, batch_size, 0);
+        std::string buffer;
+        size_t carried = 0;
+        while (input) {
+            buffer.resize(carried + STREAM_CHUNK_SIZE);
+            input.read(buffer.data() + carried, STREAM_CHUNK_SIZE);
+            const size_t filled = carried + static_cast<size_t>(input.gcount());
+            stats.bytes += static_cast<size_t>(input.gcount());
+            const std::string_view content(buffer.data(), filled);
+            // At the end of the file whatever is left is the last line
+            size_t complete = filled;
+            if (input) {
+                const size_t last_line_end = content.rfind('\n');
+                complete = last_line_end == std::string_view::npos ? 0 : last_line_end + 1;
+            }
+            parser.ParseLines(content.substr(0, complete));
+            carried = filled - complete;
+            std::memmove(buffer.data(), buffer.data() + complete, carried);
+        }
+        parser.Finish();
+        stats.documents = parser.GetDocumentCount();
+    }
+
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+    return stats;
+}
+
+std::ostream& operator<<(std::ostream& output, const CorpusLoadStats& stats) {
+    output << "{ "
+        << "documents = " << stats.documents << ", "
+        << "bytes = " << stats.bytes << ", "
+        << "seconds = " << stats.seconds << ", "
+        << "MB/s = " << stats.GetMegabytesPerSecond() << ", "
+        << "documents/s = " << stats.GetDocumentsPerSecond()
+        << " }";
+
+    return output;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "search_server.h"
+
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Input formats, one document per line:
+// TSV:   <id>\t<status>\t<ratings separated by spaces or commas>\t<text>
+// JSONL: {"id": 1, "status": "ACTUAL", "ratings": [7, 2, 7], "text": "funny pet"}
+// Status is either a DocumentStatus name or its numeric value.
+enum class CorpusFormat {
+    TSV,
+    JSONL,
+};
+
+struct CorpusLoadProgress {
+    size_t documents = 0;
+    size_t bytes_done = 0;
+    size_t bytes_total = 0;
+};
+
+struct CorpusLoadStats {
+    size_t documents = 0;
+    size_t bytes = 0;
+    double seconds = 0;
+
+    [[nodiscard]] double GetMegabytesPerSecond() const;
+    [[nodiscard]] double GetDocumentsPerSecond() const;
+};
+
+using CorpusProgressCallback = std::function<void(const CorpusLoadProgress&)>;
+
+const size_t CORPUS_LOAD_BATCH_SIZE = 4096;
+
+/// Loads documents from a corpus file into 'search_server'. The file is memory-mapped when possible
+/// and read in large chunks otherwise; document text is tokenized without copying. Records are parsed
+/// in batches of 'batch_size', a batch is tokenized in parallel on ThreadPool::GetShared() and added
+/// in file order, so the result is the same as calling AddDocument line by line. When a record fails,
+/// the records before it are loaded.
+/// @param <progress> Called after every batch of 'batch_size' documents, may be empty
+/// @return Number of loaded documents and bytes, time spent
+/// Throws std::runtime_error if the file can't be read and std::invalid_argument on malformed records
+CorpusLoadStats LoadCorpus(SearchServer& search_server, const std::string& path, CorpusFormat format,
+                           const CorpusProgressCallback& progress = {}, size_t batch_size = CORPUS_LOAD_BATCH_SIZE);
+
+std::ostream& operator<<(std::ostream& output, const CorpusLoadStats& stats);
@@ -0,0 +1,203 @@
+#include "durable_search_server.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <stdexcept>
+#include <system_error>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+// Documents tokenized by one recovery task
+const size_t REPLAY_CHUNK_SIZE = 256;
+
+void SyncPath(const std::string& path) {
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0 || fsync(fd) != 0) {
+        const int error = errno;
+        if (fd >= 0) {
+            close(fd);
+        }
+        throw std::system_error(error, std::generic_category(), "Can't sync " + path);
+    }
+    close(fd);
+}
+
+} // namespace
+
+DurableSearchServer::DurableSearchServer(const std::string& directory, const IndexOptions& options)
+        : snapshot_path_((std::filesystem::path(directory) / "snapshot").string())
+        , log_path_((std::filesystem::path(directory) / "wal").string())
+        , server_(options) {
+    const auto start = std::chrono::steady_clock::now();
+    std::filesystem::create_directories(directory);
+
+    const uint64_t snapshot_sequence_number = LoadSnapshot();
+    std::vector<LogRecord> records = WriteAheadLog::Recover(log_path_);
+    // A crash between saving a snapshot and emptying the log leaves records the snapshot already has
+    records.erase(std::remove_if(records.begin(), records.end(), [snapshot_sequence_number](const LogRecord& record) {
+        return record.sequence_number <= snapshot_sequence_number;
+    }), records.end());
+    const uint64_t last_sequence_number = records.empty() ? snapshot_sequence_number : records.back().sequence_number;
+    recovery_stats_.snapshot_documents = server_.GetDocumentCount();
+    recovery_stats_.replayed_records = records.size();
+    Replay(std::move(records));
+
+    log_ = std::make_unique<WriteAheadLog>(log_path_, last_sequence_number);
+    recovery_stats_.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void DurableSearchServer::AddDocument(int document_id, std::string_view document, DocumentStatus status,
+                                      const std::vector<int>& ratings) {
+    LogRecord record;
+    record.type = LogRecordType::ADD_DOCUMENT;
+    record.document_id = document_id;
+    record.status = status;
+    record.ratings = ratings;
+    record.text = document;
+    ApplyAndLog(std::move(record), [&] {
+        server_.AddDocument(document_id, document, status, ratings);
+    });
+}
+
+void DurableSearchServer::RemoveDocument(int document_id) {
+    LogRecord record;
+    record.type = LogRecordType::REMOVE_DOCUMENT;
+    record.document_id = document_id;
+    ApplyAndLog(std::move(record), [&] {
+        server_.RemoveDocument(document_id);
+    });
+}
+
+void DurableSearchServer::SetStopWords(const std::string& text) {
+    LogRecord record;
+    record.type = LogRecordType::SET_STOP_WORDS;
+    record.text = text;
+    ApplyAndLog(std::move(record), [&] {
+        server_.SetStopWords(text);
+    });
+}
+
+void DurableSearchServer::Checkpoint() {
+    std::lock_guard lock(write_mutex_);
+    // The snapshot would make the changes of the failed fsync durable after their callers saw an error
+    ThrowIfLogFailed();
+    const uint64_t sequence_number = log_->GetLastSequenceNumber();
+    const std::string temporary_path = snapshot_path_ + ".tmp";
+    {
+        std::ofstream output(temporary_path, std::ios::binary | std::ios::trunc);
+        output.write(reinterpret_cast<const char*>(&sequence_number), sizeof(sequence_number));
+        server_.SaveSnapshot(output);
+        output.close();
+        if (!output) {
+            throw std::runtime_error("Can't write snapshot " + temporary_path);
+        }
+    }
+    SyncPath(temporary_path);
+    // Rename is atomic, a crash leaves either the old snapshot or the new one
+    std::filesystem::rename(temporary_path, snapshot_path_);
+    SyncPath(std::filesystem::path(snapshot_path_).parent_path().string());
+    log_->Truncate();
+}
+
+const SearchServer& DurableSearchServer::GetServer() const {
+    return server_;
+}
+
+const RecoveryStats& DurableSearchServer::GetRecoveryStats() const {
+    return recovery_stats_;
+}
+
+uint64_t DurableSearchServer::GetSyncCount() const {
+    return log_->GetSyncCount();
+}
+
+template <typename Change>
+void DurableSearchServer::ApplyAndLog(LogRecord record, Change change) {
+    uint64_t sequence_number = 0;
+    {
+        // Changes are applied and logged in the same order. A change that throws is not logged.
+        std::lock_guard lock(write_mutex_);
+        ThrowIfLogFailed();
+        change();
+        sequence_number = log_->Append(record);
+    }
+    // Waiting outside the lock lets other threads append their changes to the same fsync
+    log_->WaitDurable(sequence_number);
+}
+
+void DurableSearchServer::ThrowIfLogFailed() const {
+    if (log_->IsFailed()) {
+        throw std::runtime_error("Write-ahead log has failed, no more changes are accepted");
+    }
+}
+
+uint64_t DurableSearchServer::LoadSnapshot() {
+    std::ifstream input(snapshot_path_, std::ios::binary);
+    if (!input) {
+        return 0;
+    }
+    uint64_t sequence_number = 0;
+    if (!input.read(reinterpret_cast<char*>(&sequence_number), sizeof(sequence_number))) {
+        throw std::invalid_argument("Snapshot is truncated");
+    }
+    server_.LoadSnapshot(input);
+    return sequence_number;
+}
+
+void DurableSearchServer::Replay(std::vector<LogRecord> records) {
+    for (size_t begin = 0; begin < records.size();) {
+        if (records[begin].type == LogRecordType::SET_STOP_WORDS) {
+            server_.SetStopWords(records[begin].text);
+            ++begin;
+            continue;
+        }
+
+        // Until the next stop words change the documents are tokenized the same way,
+        // so they are tokenized in parallel and then added in log order
+        size_t end = begin;
+        while (end < records.size() && records[end].type != LogRecordType::SET_STOP_WORDS) {
+            ++end;
+        }
+        // The words point into 'records', which outlive the whole replay
+        std::vector<std::future<std::vector<TokenizedDocument>>> tokenized;
+        for (size_t chunk = begin; chunk < end; chunk += REPLAY_CHUNK_SIZE) {
+            const size_t chunk_end = std::min(end, chunk + REPLAY_CHUNK_SIZE);
+            tokenized.push_back(ThreadPool::GetShared().Submit([this, &records, chunk, chunk_end] {
+                std::vector<TokenizedDocument> word_freqs;
+                for (size_t i = chunk; i < chunk_end; ++i) {
+                    if (records[i].type == LogRecordType::ADD_DOCUMENT) {
+                        word_freqs.push_back(server_.ComputeWordFrequencies(records[i].text));
+                    }
+                }
+                return word_freqs;
+            }));
+        }
+        // Tasks refer to 'records', all of them have to finish before anything throws
+        for (const auto& future : tokenized) {
+            future.wait();
+        }
+
+        for (size_t chunk = begin, chunk_index = 0; chunk < end; chunk += REPLAY_CHUNK_SIZE, ++chunk_index) {
+            const std::vector<TokenizedDocument> word_freqs = tokenized[chunk_index].get();
+            size_t next_word_freqs = 0;
+            for (size_t i = chunk; i < std::min(end, chunk + REPLAY_CHUNK_SIZE); ++i) {
+                const LogRecord& record = records[i];
+                if (record.type == LogRecordType::ADD_DOCUMENT) {
+                    server_.AddTokenizedDocument(record.document_id, word_freqs[next_word_freqs++],
+                                                 record.status, record.ratings);
+                } else {
+                    server_.RemoveDocument(record.document_id);
+                }
+            }
+        }
+        begin = end;
+    }
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "search_server.h"
+#include "write_ahead_log.h"
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct RecoveryStats {
+    size_t snapshot_documents = 0;
+    size_t replayed_records = 0;
+    double seconds = 0;
+};
+
+// SearchServer whose changes survive a crash. Every change is applied, appended to
+// '<directory>/wal' and fsynced before the call returns; Checkpoint saves '<directory>/snapshot'
+// and empties the log. On construction the snapshot is loaded and the log replayed on top of it.
+// Changes may come from several threads, searches must not run concurrently with them.
+// If writing or syncing the log fails, the calls waiting for that fsync throw, but their changes
+// stay visible in memory and are lost on restart. From then on every change and Checkpoint throws
+// without touching the index, reopening the directory brings back the durable state.
+class DurableSearchServer {
+public:
+    explicit DurableSearchServer(const std::string& directory, const IndexOptions& options = {});
+
+    void AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+    void RemoveDocument(int document_id);
+    void SetStopWords(const std::string& text);
+
+    // Saves a snapshot of the current state and empties the log
+    void Checkpoint();
+
+    [[nodiscard]] const SearchServer& GetServer() const;
+    [[nodiscard]] const RecoveryStats& GetRecoveryStats() const;
+    // Number of fsyncs of the log, concurrent changes share them
+    [[nodiscard]] uint64_t GetSyncCount() const;
+
+private:
+    template <typename Change>
+    void ApplyAndLog(LogRecord record, Change change);
+
+    // Throws std::runtime_error once the log has failed, memory and disk would drift apart otherwise
+    void ThrowIfLogFailed() const;
+
+    uint64_t LoadSnapshot();
+    void Replay(std::vector<LogRecord> records);
+
+    std::string snapshot_path_;
+    std::string log_path_;
+    SearchServer server_;
+    RecoveryStats recovery_stats_;
+    std::mutex write_mutex_;
+    std::unique_ptr<WriteAheadLog> log_;
+};
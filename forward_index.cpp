@@ -0,0 +1,84 @@
+#include "forward_index.h"
+
+#include <algorithm>
+
+namespace {
+
+// Holes are left alone while the arena is this small
+const size_t MIN_GARBAGE_TO_COMPACT = 1024;
+
+} // namespace
+
+ForwardIndex::ForwardIndex(std::pmr::memory_resource* resource)
+        : arena_(resource)
+        , documents_(resource) {
+}
+
+void ForwardIndex::AddDocument(int document_id, const std::vector<std::pair<TermId, double>>& term_freqs) {
+    documents_.emplace(document_id, Entries{arena_.size(), term_freqs.size()});
+    for (const auto& [term, term_freq] : term_freqs) {
+        arena_.push_back({term, term_freq});
+    }
+}
+
+void ForwardIndex::RemoveDocument(int document_id) {
+    const auto it = documents_.find(document_id);
+    if (it == documents_.end()) {
+        return;
+    }
+    garbage_size_ += it->second.size;
+    documents_.erase(it);
+    if (documents_.empty()) {
+        std::pmr::vector<TermFrequency>(arena_.get_allocator()).swap(arena_);
+        garbage_size_ = 0;
+    } else if (garbage_size_ >= MIN_GARBAGE_TO_COMPACT && garbage_size_ * 2 > arena_.size()) {
+        Compact();
+    }
+}
+
+bool ForwardIndex::ContainsDocument(int document_id) const {
+    return documents_.count(document_id) > 0;
+}
+
+std::pair<const TermFrequency*, const TermFrequency*> ForwardIndex::GetTermFrequencies(int document_id) const {
+    const auto it = documents_.find(document_id);
+    if (it == documents_.end()) {
+        return {nullptr, nullptr};
+    }
+    const TermFrequency* begin = arena_.data() + it->second.offset;
+    return {begin, begin + it->second.size};
+}
+
+bool ForwardIndex::HasTerm(int document_id, TermId term) const {
+    return FindEntry(document_id, term) != nullptr;
+}
+
+std::optional<double> ForwardIndex::FindTermFrequency(int document_id, TermId term) const {
+    const TermFrequency* entry = FindEntry(document_id, term);
+    if (entry == nullptr) {
+        return std::nullopt;
+    }
+    return entry->term_freq;
+}
+
+const TermFrequency* ForwardIndex::FindEntry(int document_id, TermId term) const {
+    const Entries& entries = documents_.at(document_id);
+    const TermFrequency* begin = arena_.data() + entries.offset;
+    const TermFrequency* end = begin + entries.size;
+    const TermFrequency* it = std::lower_bound(begin, end, term, [](const TermFrequency& entry, TermId value) {
+        return entry.term < value;
+    });
+    return it != end && it->term == term ? it : nullptr;
+}
+
+void ForwardIndex::Compact() {
+    std::pmr::vector<TermFrequency> arena(arena_.get_allocator());
+    arena.reserve(arena_.size() - garbage_size_);
+    for (auto& [document_id, entries] : documents_) {
+        const size_t offset = arena.size();
+        arena.insert(arena.end(), arena_.begin() + entries.offset, arena_.begin() + entries.offset + entries.size);
+        entries.offset = offset;
+    }
+    arena_.swap(arena);
+    garbage_size_ = 0;
+}
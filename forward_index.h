@@ -0,0 +1,131 @@
+#pragma once
+
+#include "index_segment.h"
+#include "term_dictionary.h"
+
+#include <cstddef>
+#include <iterator>
+#include <memory_resource>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+struct TermFrequency {
+    TermId term;
+    double term_freq;
+};
+
+// Term frequencies of all documents in one contiguous arena, every document's entries sorted by term id.
+// Removed documents leave holes that are compacted away once they make up half of the arena.
+class ForwardIndex {
+public:
+    explicit ForwardIndex(std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+    // 'term_freqs' must be sorted by term without repeats, the document must not be in the index
+    void AddDocument(int document_id, const std::vector<std::pair<TermId, double>>& term_freqs);
+
+    void RemoveDocument(int document_id);
+
+    [[nodiscard]] bool ContainsDocument(int document_id) const;
+
+    // Empty for unknown documents. Valid until the index is modified.
+    [[nodiscard]] std::pair<const TermFrequency*, const TermFrequency*> GetTermFrequencies(int document_id) const;
+
+    // Throws std::out_of_range for unknown documents
+    [[nodiscard]] bool HasTerm(int document_id, TermId term) const;
+
+    // Empty if the document doesn't contain 'term'. Throws std::out_of_range for unknown documents.
+    [[nodiscard]] std::optional<double> FindTermFrequency(int document_id, TermId term) const;
+
+private:
+    struct Entries {
+        size_t offset;
+        size_t size;
+    };
+
+    std::pmr::vector<TermFrequency> arena_;
+    std::pmr::unordered_map<int, Entries> documents_;
+    // Arena entries of removed documents
+    size_t garbage_size_ = 0;
+
+    [[nodiscard]] const TermFrequency* FindEntry(int document_id, TermId term) const;
+
+    void Compact();
+};
+
+// Read-only view of a document's words and their term frequencies, ordered by term id.
+// Yields std::pair<std::string_view, double>; valid until the server is modified.
+class WordFrequencies {
+public:
+    class Iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = std::pair<std::string_view, double>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = value_type;
+
+        Iterator() = default;
+
+        Iterator(const TermFrequency* entry, const TermDictionary* dictionary)
+                : entry_(entry), dictionary_(dictionary) {
+        }
+
+        value_type operator*() const {
+            return {dictionary_->GetWord(entry_->term), entry_->term_freq};
+        }
+
+        Iterator& operator++() {
+            ++entry_;
+            return *this;
+        }
+
+        Iterator operator++(int) {
+            Iterator previous = *this;
+            ++entry_;
+            return previous;
+        }
+
+        bool operator==(const Iterator& other) const {
+            return entry_ == other.entry_;
+        }
+
+        bool operator!=(const Iterator& other) const {
+            return entry_ != other.entry_;
+        }
+
+    private:
+        const TermFrequency* entry_ = nullptr;
+        const TermDictionary* dictionary_ = nullptr;
+    };
+
+    WordFrequencies() = default;
+
+    // 'dictionary' maps term ids to words
+    WordFrequencies(std::pair<const TermFrequency*, const TermFrequency*> entries, const TermDictionary* dictionary)
+            : begin_(entries.first), end_(entries.second), dictionary_(dictionary) {
+    }
+
+    [[nodiscard]] Iterator begin() const {
+        return {begin_, dictionary_};
+    }
+
+    [[nodiscard]] Iterator end() const {
+        return {end_, dictionary_};
+    }
+
+    [[nodiscard]] size_t size() const {
+        return end_ - begin_;
+    }
+
+    [[nodiscard]] bool empty() const {
+        return begin_ == end_;
+    }
+
+private:
+    const TermFrequency* begin_ = nullptr;
+    const TermFrequency* end_ = nullptr;
+    const TermDictionary* dictionary_ = nullptr;
+};
@@ -0,0 +1,421 @@
+#include "index_segment.h"
+
+#include <algorithm>
+#include <queue>
+
+namespace {
+
+bool ByDocumentId(const Posting& lhs, const Posting& rhs) {
+    return lhs.document_id < rhs.document_id;
+}
+
+} // namespace
+
+bool IsHigherImpact(const ImpactPosting& lhs, const ImpactPosting& rhs) {
+    if (lhs.term_freq != rhs.term_freq) {
+        return lhs.term_freq > rhs.term_freq;
+    }
+    if (lhs.rating != rhs.rating) {
+        return lhs.rating > rhs.rating;
+    }
+    return lhs.document_id < rhs.document_id;
+}
+
+ImpactCursor::ImpactCursor(const SealedSegment& segment, const uint32_t* order_begin, const uint32_t* order_end,
+                           const DeletedDocuments& deleted)
+        : segment_(&segment)
+        , position_(order_begin)
+        , end_(order_end)
+        , deleted_(&deleted) {
+    Load();
+}
+
+ImpactCursor::ImpactCursor(std::vector<ImpactPosting> postings)
+        : postings_(std::move(postings)) {
+    Load();
+}
+
+bool ImpactCursor::IsDone() const {
+    return is_done_;
+}
+
+const ImpactPosting& ImpactCursor::GetPosting() const {
+    return current_;
+}
+
+void ImpactCursor::Next() {
+    if (segment_ != nullptr) {
+        ++position_;
+    } else {
+        ++next_posting_;
+    }
+    Load();
+}
+
+void ImpactCursor::SkipTermFrequency() {
+    const double term_freq = current_.term_freq;
+    if (segment_ != nullptr) {
+        position_ = std::partition_point(position_, end_, [this, term_freq](uint32_t posting_index) {
+            return segment_->postings_[posting_index].term_freq >= term_freq;
+        });
+    } else {
+        next_posting_ = std::partition_point(postings_.begin() + next_posting_, postings_.end(), [term_freq](const ImpactPosting& posting) {
+            return posting.term_freq >= term_freq;
+        }) - postings_.begin();
+    }
+    Load();
+}
+
+void ImpactCursor::Load() {
+    if (segment_ == nullptr) {
+        is_done_ = next_posting_ == postings_.size();
+        if (!is_done_) {
+            current_ = postings_[next_posting_];
+        }
+        return;
+    }
+    while (position_ != end_ && !deleted_->empty() && deleted_->count(segment_->postings_[*position_].document_id)) {
+        ++position_;
+    }
+    is_done_ = position_ == end_;
+    if (!is_done_) {
+        current_ = segment_->GetImpactPosting(*position_);
+    }
+}
+
+bool PostingRange::Contains(int document_id) const {
+    const Posting* it = std::lower_bound(begin_, end_, Posting{document_id, 0}, ByDocumentId);
+    return it != end_ && it->document_id == document_id;
+}
+
+const Posting* GallopTo(const Posting* first, const Posting* last, int document_id) {
+    if (first == last || first->document_id >= document_id) {
+        return first;
+    }
+    // 'first' stays before the answer, which lies within the next 'step' postings
+    ptrdiff_t step = 1;
+    while (step < last - first && first[step].document_id < document_id) {
+        first += step;
+        step *= 2;
+    }
+    return std::lower_bound(first + 1, first + std::min(step + 1, last - first), Posting{document_id, 0}, ByDocumentId);
+}
+
+MergedImpactCursor::MergedImpactCursor(std::vector<ImpactCursor> cursors)
+        : cursors_(std::move(cursors)) {
+    cursors_.erase(std::remove_if(cursors_.begin(), cursors_.end(), [](const ImpactCursor& cursor) {
+        return cursor.IsDone();
+    }), cursors_.end());
+    SelectCurrent();
+}
+
+bool MergedImpactCursor::IsDone() const {
+    return cursors_.empty();
+}
+
+const ImpactPosting& MergedImpactCursor::GetPosting() const {
+    return cursors_[current_].GetPosting();
+}
+
+void MergedImpactCursor::Next() {
+    cursors_[current_].Next();
+    if (cursors_[current_].IsDone()) {
+        cursors_.erase(cursors_.begin() + current_);
+    }
+    SelectCurrent();
+}
+
+void MergedImpactCursor::SkipTermFrequency() {
+    const double term_freq = GetPosting().term_freq;
+    for (ImpactCursor& cursor : cursors_) {
+        if (cursor.GetPosting().term_freq == term_freq) {
+            cursor.SkipTermFrequency();
+        }
+    }
+    cursors_.erase(std::remove_if(cursors_.begin(), cursors_.end(), [](const ImpactCursor& cursor) {
+        return cursor.IsDone();
+    }), cursors_.end());
+    SelectCurrent();
+}
+
+void MergedImpactCursor::SelectCurrent() {
+    // Only a few segments, a linear scan is cheaper than a heap
+    current_ = 0;
+    for (size_t i = 1; i < cursors_.size(); ++i) {
+        if (IsHigherImpact(cursors_[i].GetPosting(), cursors_[current_].GetPosting())) {
+            current_ = i;
+        }
+    }
+}
+
+SealedSegment::SealedSegment(std::pmr::vector<int> document_ids, std::pmr::vector<int> document_ratings, std::pmr::vector<TermId> term_ids,
+                             std::pmr::vector<uint32_t> posting_offsets, std::pmr::vector<Posting> postings, bool build_impact_order)
+        : document_ids_(std::move(document_ids))
+        , document_ratings_(std::move(document_ratings))
+        , term_ids_(std::move(term_ids))
+        , posting_offsets_(std::move(posting_offsets))
+        , postings_(std::move(postings))
+        , impact_order_(postings_.get_allocator().resource()) {
+    if (!build_impact_order) {
+        return;
+    }
+    std::vector<int> posting_ratings(postings_.size());
+    for (size_t i = 0; i < postings_.size(); ++i) {
+        posting_ratings[i] = GetRating(postings_[i].document_id);
+    }
+    impact_order_.resize(postings_.size());
+    for (size_t term_index = 0; term_index < term_ids_.size(); ++term_index) {
+        const auto begin = impact_order_.begin() + posting_offsets_[term_index];
+        const auto end = impact_order_.begin() + posting_offsets_[term_index + 1];
+        for (uint32_t i = posting_offsets_[term_index]; i < posting_offsets_[term_index + 1]; ++i) {
+            impact_order_[i] = i;
+        }
+        std::sort(begin, end, [this, &posting_ratings](uint32_t lhs, uint32_t rhs) {
+            return IsHigherImpact({postings_[lhs].document_id, posting_ratings[lhs], postings_[lhs].term_freq},
+                                  {postings_[rhs].document_id, posting_ratings[rhs], postings_[rhs].term_freq});
+        });
+    }
+}
+
+std::shared_ptr<const SealedSegment> SealedSegment::Merge(const std::vector<Source>& sources, std::pmr::memory_resource* resource,
+                                                          bool build_impact_order) {
+    std::vector<std::pair<int, int>> documents;
+    for (const Source& source : sources) {
+        const SealedSegment& segment = *source.segment;
+        for (size_t i = 0; i < segment.document_ids_.size(); ++i) {
+            if (!source.deleted->count(segment.document_ids_[i])) {
+                documents.emplace_back(segment.document_ids_[i], segment.document_ratings_[i]);
+            }
+        }
+    }
+    std::sort(documents.begin(), documents.end());
+    std::pmr::vector<int> document_ids(resource);
+    std::pmr::vector<int> document_ratings(resource);
+    document_ids.reserve(documents.size());
+    document_ratings.reserve(documents.size());
+    for (const auto& [document_id, rating] : documents) {
+        document_ids.push_back(document_id);
+        document_ratings.push_back(rating);
+    }
+
+    // k-way merge of the sorted term lists, one cursor per source
+    std::vector<size_t> cursors(sources.size(), 0);
+    const auto greater_term = [&](size_t lhs, size_t rhs) {
+        return sources[lhs].segment->term_ids_[cursors[lhs]] > sources[rhs].segment->term_ids_[cursors[rhs]];
+    };
+    std::priority_queue<size_t, std::vector<size_t>, decltype(greater_term)> heap(greater_term);
+    for (size_t i = 0; i < sources.size(); ++i) {
+        if (!sources[i].segment->term_ids_.empty()) {
+            heap.push(i);
+        }
+    }
+
+    std::pmr::vector<TermId> term_ids(resource);
+    std::pmr::vector<uint32_t> posting_offsets(resource);
+    std::pmr::vector<Posting> postings(resource);
+    while (!heap.empty()) {
+        const size_t first = heap.top();
+        const TermId term = sources[first].segment->term_ids_[cursors[first]];
+        const size_t term_begin = postings.size();
+        while (!heap.empty() && sources[heap.top()].segment->term_ids_[cursors[heap.top()]] == term) {
+            const size_t top = heap.top();
+            heap.pop();
+            const SealedSegment& segment = *sources[top].segment;
+            const size_t term_index = cursors[top];
+            for (uint32_t i = segment.posting_offsets_[term_index]; i < segment.posting_offsets_[term_index + 1]; ++i) {
+                if (!sources[top].deleted->count(segment.postings_[i].document_id)) {
+                    postings.push_back(segment.postings_[i]);
+                }
+            }
+            if (++cursors[top] < segment.term_ids_.size()) {
+                heap.push(top);
+            }
+        }
+        // Terms left without postings are dropped
+        if (postings.size() > term_begin) {
+            std::sort(postings.begin() + term_begin, postings.end(), ByDocumentId);
+            term_ids.push_back(term);
+            posting_offsets.push_back(static_cast<uint32_t>(term_begin));
+        }
+    }
+    posting_offsets.push_back(static_cast<uint32_t>(postings.size()));
+
+    return std::allocate_shared<SealedSegment>(std::pmr::polymorphic_allocator<SealedSegment>(resource),
+                                                     std::move(document_ids), std::move(document_ratings), std::move(term_ids),
+                                                     std::move(posting_offsets), std::move(postings), build_impact_order);
+}
+
+PostingRange SealedSegment::FindPostings(TermId term) const {
+    const auto it = std::lower_bound(term_ids_.begin(), term_ids_.end(), term);
+    if (it == term_ids_.end() || *it != term) {
+        return {};
+    }
+    const size_t index = it - term_ids_.begin();
+    return {postings_.data() + posting_offsets_[index], postings_.data() + posting_offsets_[index + 1]};
+}
+
+ImpactCursor SealedSegment::GetImpactCursor(TermId term, const DeletedDocuments& deleted) const {
+    const auto it = std::lower_bound(term_ids_.begin(), term_ids_.end(), term);
+    if (it == term_ids_.end() || *it != term) {
+        return ImpactCursor(std::vector<ImpactPosting>{});
+    }
+    const size_t index = it - term_ids_.begin();
+    if (!impact_order_.empty()) {
+        return ImpactCursor(*this, impact_order_.data() + posting_offsets_[index],
+                            impact_order_.data() + posting_offsets_[index + 1], deleted);
+    }
+    std::vector<ImpactPosting> postings;
+    for (uint32_t i = posting_offsets_[index]; i < posting_offsets_[index + 1]; ++i) {
+        if (!deleted.count(postings_[i].document_id)) {
+            postings.push_back(GetImpactPosting(i));
+        }
+    }
+    std::sort(postings.begin(), postings.end(), IsHigherImpact);
+    return ImpactCursor(std::move(postings));
+}
+
+bool SealedSegment::ContainsDocument(int document_id) const {
+    return std::binary_search(document_ids_.begin(), document_ids_.end(), document_id);
+}
+
+int SealedSegment::GetRating(int document_id) const {
+    return document_ratings_[std::lower_bound(document_ids_.begin(), document_ids_.end(), document_id) - document_ids_.begin()];
+}
+
+size_t SealedSegment::GetDocumentCount() const {
+    return document_ids_.size();
+}
+
+size_t SealedSegment::GetPostingCount() const {
+    return postings_.size();
+}
+
+ImpactPosting SealedSegment::GetImpactPosting(uint32_t posting_index) const {
+    const Posting& posting = postings_[posting_index];
+    return {posting.document_id, GetRating(posting.document_id), posting.term_freq};
+}
+
+WriteSegment::WriteSegment(std::pmr::memory_resource* resource)
+        : postings_(resource)
+        , document_ratings_(resource)
+        , deleted_(resource) {
+}
+
+void WriteSegment::AddDocument(int document_id, const std::vector<std::pair<TermId, double>>& term_freqs, int rating) {
+    // The postings of a deleted document with the same id have to go first
+    if (deleted_.count(document_id)) {
+        Vacuum();
+    }
+    document_ratings_.emplace(document_id, rating);
+    for (const auto& [term, term_freq] : term_freqs) {
+        std::pmr::vector<Posting>& term_postings = postings_[term];
+        // Documents usually come with increasing ids, then this is an append
+        const auto it = std::upper_bound(term_postings.begin(), term_postings.end(), Posting{document_id, 0}, ByDocumentId);
+        term_postings.insert(it, Posting{document_id, term_freq});
+    }
+}
+
+bool WriteSegment::RemoveDocument(int document_id) {
+    if (!document_ratings_.count(document_id)) {
+        return false;
+    }
+    return deleted_.insert(document_id).second;
+}
+
+void WriteSegment::Vacuum() {
+    if (deleted_.empty()) {
+        return;
+    }
+    for (auto term_it = postings_.begin(); term_it != postings_.end();) {
+        std::pmr::vector<Posting>& term_postings = term_it->second;
+        term_postings.erase(std::remove_if(term_postings.begin(), term_postings.end(), [this](const Posting& posting) {
+            return deleted_.count(posting.document_id) > 0;
+        }), term_postings.end());
+        if (term_postings.empty()) {
+            term_it = postings_.erase(term_it);
+        } else {
+            ++term_it;
+        }
+    }
+    for (const int document_id : deleted_) {
+        document_ratings_.erase(document_id);
+    }
+    deleted_.clear();
+}
+
+PostingRange WriteSegment::FindPostings(TermId term) const {
+    const auto it = postings_.find(term);
+    if (it == postings_.end()) {
+        return {};
+    }
+    return {it->second.data(), it->second.data() + it->second.size()};
+}
+
+ImpactCursor WriteSegment::GetImpactCursor(TermId term) const {
+    std::vector<ImpactPosting> postings;
+    for (const Posting& posting : FindPostings(term)) {
+        if (!deleted_.count(posting.document_id)) {
+            postings.push_back({posting.document_id, document_ratings_.at(posting.document_id), posting.term_freq});
+        }
+    }
+    std::sort(postings.begin(), postings.end(), IsHigherImpact);
+    return ImpactCursor(std::move(postings));
+}
+
+const DeletedDocuments& WriteSegment::GetDeletedDocuments() const {
+    return deleted_;
+}
+
+bool WriteSegment::ContainsDocument(int document_id) const {
+    return document_ratings_.count(document_id) > 0 && !deleted_.count(document_id);
+}
+
+size_t WriteSegment::GetDocumentCount() const {
+    return document_ratings_.size();
+}
+
+size_t WriteSegment::GetPostingCount() const {
+    size_t posting_count = 0;
+    for (const auto& [term, term_postings] : postings_) {
+        posting_count += term_postings.size();
+    }
+    return posting_count;
+}
+
+std::shared_ptr<const SealedSegment> WriteSegment::Seal(bool build_impact_order) {
+    Vacuum();
+    std::pmr::memory_resource* resource = postings_.get_allocator().resource();
+    std::pmr::vector<TermId> term_ids(resource);
+    term_ids.reserve(postings_.size());
+    for (const auto& [term, _] : postings_) {
+        term_ids.push_back(term);
+    }
+    std::sort(term_ids.begin(), term_ids.end());
+
+    std::pmr::vector<uint32_t> posting_offsets(resource);
+    posting_offsets.reserve(term_ids.size() + 1);
+    std::pmr::vector<Posting> postings(resource);
+    postings.reserve(GetPostingCount());
+    for (const TermId term : term_ids) {
+        posting_offsets.push_back(static_cast<uint32_t>(postings.size()));
+        const std::pmr::vector<Posting>& term_postings = postings_.at(term);
+        postings.insert(postings.end(), term_postings.begin(), term_postings.end());
+    }
+    posting_offsets.push_back(static_cast<uint32_t>(postings.size()));
+
+    std::pmr::vector<int> document_ids(resource);
+    std::pmr::vector<int> document_ratings(resource);
+    document_ids.reserve(document_ratings_.size());
+    document_ratings.reserve(document_ratings_.size());
+    for (const auto& [document_id, rating] : document_ratings_) {
+        document_ids.push_back(document_id);
+        document_ratings.push_back(rating);
+    }
+
+    auto segment = std::allocate_shared<SealedSegment>(std::pmr::polymorphic_allocator<SealedSegment>(resource),
+                                                             std::move(document_ids), std::move(document_ratings), std::move(term_ids),
+                                                             std::move(posting_offsets), std::move(postings), build_impact_order);
+    postings_.clear();
+    document_ratings_.clear();
+    return segment;
+}
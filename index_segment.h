@@ -0,0 +1,251 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <map>
+#include <memory_resource>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+using TermId = uint32_t;
+
+struct Posting {
+    int document_id;
+    double term_freq;
+};
+
+// Contiguous run of postings sorted by document id
+class PostingRange {
+public:
+    PostingRange() = default;
+
+    PostingRange(const Posting* begin, const Posting* end)
+            : begin_(begin), end_(end) {
+    }
+
+    [[nodiscard]] const Posting* begin() const {
+        return begin_;
+    }
+
+    [[nodiscard]] const Posting* end() const {
+        return end_;
+    }
+
+    [[nodiscard]] size_t size() const {
+        return end_ - begin_;
+    }
+
+    [[nodiscard]] bool empty() const {
+        return begin_ == end_;
+    }
+
+    [[nodiscard]] bool Contains(int document_id) const;
+
+private:
+    const Posting* begin_ = nullptr;
+    const Posting* end_ = nullptr;
+};
+
+using DeletedDocuments = std::pmr::unordered_set<int>;
+
+struct ImpactPosting {
+    int document_id;
+    int rating;
+    double term_freq;
+};
+
+// Impact order: decreasing term frequency, then decreasing rating, then increasing document id.
+// For a single-word query it is the order of the search results.
+bool IsHigherImpact(const ImpactPosting& lhs, const ImpactPosting& rhs);
+
+class SealedSegment;
+
+// Walks the live postings of one term in one segment in impact order
+class ImpactCursor {
+public:
+    // Over the impact order stored in 'segment', 'order' indexes its posting array
+    ImpactCursor(const SealedSegment& segment, const uint32_t* order_begin, const uint32_t* order_end,
+                 const DeletedDocuments& deleted);
+
+    // Over postings already in impact order, none of them deleted
+    explicit ImpactCursor(std::vector<ImpactPosting> postings);
+
+    [[nodiscard]] bool IsDone() const;
+
+    // Requires !IsDone()
+    [[nodiscard]] const ImpactPosting& GetPosting() const;
+
+    void Next();
+
+    // Skips the postings left with the term frequency of the current one
+    void SkipTermFrequency();
+
+private:
+    const SealedSegment* segment_ = nullptr;
+    const uint32_t* position_ = nullptr;
+    const uint32_t* end_ = nullptr;
+    const DeletedDocuments* deleted_ = nullptr;
+    std::vector<ImpactPosting> postings_;
+    size_t next_posting_ = 0;
+    ImpactPosting current_{};
+    bool is_done_ = false;
+
+    // Moves to the first live posting at or after the position
+    void Load();
+};
+
+// Impact order across segments: the cursor with the highest current posting goes first
+class MergedImpactCursor {
+public:
+    explicit MergedImpactCursor(std::vector<ImpactCursor> cursors);
+
+    [[nodiscard]] bool IsDone() const;
+
+    // Requires !IsDone()
+    [[nodiscard]] const ImpactPosting& GetPosting() const;
+
+    void Next();
+
+    // Skips the postings left in all segments with the term frequency of the current one
+    void SkipTermFrequency();
+
+private:
+    std::vector<ImpactCursor> cursors_;
+    size_t current_ = 0;
+
+    void SelectCurrent();
+};
+
+// First posting in [first, last) with document id not less than 'document_id'. Probes at doubling
+// distances before the binary search, so short skips cost O(log(skip)) instead of O(log(last - first)).
+const Posting* GallopTo(const Posting* first, const Posting* last, int document_id);
+
+// Calls 'callback(const std::vector<const Posting*>& matched)' for every document present in all 'lists',
+// in increasing document id order; matched[i] is its posting in lists[i]. The shortest list drives the
+// intersection and the others are galloped through, so the cost is proportional to the shortest list.
+// 'should_continue()' is asked before every posting of the shortest list, the intersection stops at false.
+template <typename Callback, typename Predicate>
+void IntersectPostings(const std::vector<PostingRange>& lists, Callback callback, Predicate should_continue) {
+    if (lists.empty()) {
+        return;
+    }
+    std::vector<size_t> order(lists.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&lists](size_t lhs, size_t rhs) {
+        return lists[lhs].size() < lists[rhs].size();
+    });
+
+    std::vector<const Posting*> matched(lists.size());
+    for (size_t i = 0; i < lists.size(); ++i) {
+        matched[i] = lists[i].begin();
+    }
+    for (const Posting& candidate : lists[order[0]]) {
+        if (!should_continue()) {
+            return;
+        }
+        matched[order[0]] = &candidate;
+        bool is_common = true;
+        for (size_t i = 1; i < order.size() && is_common; ++i) {
+            const PostingRange& list = lists[order[i]];
+            matched[order[i]] = GallopTo(matched[order[i]], list.end(), candidate.document_id);
+            if (matched[order[i]] == list.end()) {
+                return;
+            }
+            is_common = matched[order[i]]->document_id == candidate.document_id;
+        }
+        if (is_common) {
+            callback(matched);
+        }
+    }
+}
+
+template <typename Callback>
+void IntersectPostings(const std::vector<PostingRange>& lists, Callback callback) {
+    IntersectPostings(lists, callback, [] {
+        return true;
+    });
+}
+
+// Immutable compact segment: sorted term ids, each with a slice of one flat posting array.
+// Optionally every slice also has an impact order, a permutation of its postings.
+class SealedSegment {
+public:
+    struct Source {
+        const SealedSegment* segment;
+        const DeletedDocuments* deleted;
+    };
+
+    // The segment keeps its data in the memory resource of 'postings'.
+    // 'document_ratings' go with the sorted 'document_ids'.
+    SealedSegment(std::pmr::vector<int> document_ids, std::pmr::vector<int> document_ratings, std::pmr::vector<TermId> term_ids,
+                  std::pmr::vector<uint32_t> posting_offsets, std::pmr::vector<Posting> postings, bool build_impact_order);
+
+    // Combines segments into one allocated from 'resource', dropping the deleted documents
+    static std::shared_ptr<const SealedSegment> Merge(const std::vector<Source>& sources, std::pmr::memory_resource* resource,
+                                                      bool build_impact_order);
+
+    [[nodiscard]] PostingRange FindPostings(TermId term) const;
+
+    // Live postings of 'term' in impact order. Without a stored order they are sorted on the spot.
+    [[nodiscard]] ImpactCursor GetImpactCursor(TermId term, const DeletedDocuments& deleted) const;
+
+    [[nodiscard]] bool ContainsDocument(int document_id) const;
+    // Requires ContainsDocument
+    [[nodiscard]] int GetRating(int document_id) const;
+    [[nodiscard]] size_t GetDocumentCount() const;
+    [[nodiscard]] size_t GetPostingCount() const;
+
+private:
+    friend class ImpactCursor;
+
+    std::pmr::vector<int> document_ids_;
+    std::pmr::vector<int> document_ratings_;
+    std::pmr::vector<TermId> term_ids_;
+    std::pmr::vector<uint32_t> posting_offsets_;
+    std::pmr::vector<Posting> postings_;
+    // Posting indexes, slice by slice in impact order; empty if not built
+    std::pmr::vector<uint32_t> impact_order_;
+
+    [[nodiscard]] ImpactPosting GetImpactPosting(uint32_t posting_index) const;
+};
+
+// Mutable segment receiving new documents until it is sealed
+class WriteSegment {
+public:
+    // Postings and sealed segments are allocated from 'resource'
+    explicit WriteSegment(std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+    // 'term_freqs' must not repeat terms
+    void AddDocument(int document_id, const std::vector<std::pair<TermId, double>>& term_freqs, int rating = 0);
+
+    // Only marks the document deleted, its postings stay until Vacuum.
+    // Returns false if the document is not in this segment.
+    bool RemoveDocument(int document_id);
+
+    // Drops the postings of deleted documents
+    void Vacuum();
+
+    // Postings may belong to deleted documents
+    [[nodiscard]] PostingRange FindPostings(TermId term) const;
+    // Live postings of 'term', sorted into impact order on every call
+    [[nodiscard]] ImpactCursor GetImpactCursor(TermId term) const;
+    [[nodiscard]] const DeletedDocuments& GetDeletedDocuments() const;
+    [[nodiscard]] bool ContainsDocument(int document_id) const;
+    // Deleted documents are counted until Vacuum
+    [[nodiscard]] size_t GetDocumentCount() const;
+    [[nodiscard]] size_t GetPostingCount() const;
+
+    // Moves the live contents into a new sealed segment, leaving this one empty
+    std::shared_ptr<const SealedSegment> Seal(bool build_impact_order);
+
+private:
+    std::pmr::unordered_map<TermId, std::pmr::vector<Posting>> postings_;
+    // Document id to rating
+    std::pmr::map<int, int> document_ratings_;
+    DeletedDocuments deleted_;
+};
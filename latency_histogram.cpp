@@ -0,0 +1,106 @@
+#include "latency_histogram.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Values below 2^EXACT_BITS have a counter each, above it every power of two gets 2^(EXACT_BITS - 1) counters
+const unsigned EXACT_BITS = 7;
+const uint64_t EXACT_LIMIT = uint64_t{1} << EXACT_BITS;
+const uint64_t SUB_BUCKET_COUNT = EXACT_LIMIT / 2;
+const size_t COUNTER_COUNT = EXACT_LIMIT + (64 - EXACT_BITS) * SUB_BUCKET_COUNT;
+
+unsigned GetHighestBit(uint64_t value) {
+    return 63 - static_cast<unsigned>(__builtin_clzll(value));
+}
+
+} // namespace
+
+LatencyHistogram::LatencyHistogram()
+        : counts_(COUNTER_COUNT, 0) {
+}
+
+void LatencyHistogram::Record(Duration value) {
+    const uint64_t nanoseconds = value.count() > 0 ? static_cast<uint64_t>(value.count()) : 0;
+    ++counts_[GetIndex(nanoseconds)];
+    ++count_;
+    min_ = std::min(min_, nanoseconds);
+    max_ = std::max(max_, nanoseconds);
+    sum_ += nanoseconds;
+}
+
+void LatencyHistogram::Merge(const LatencyHistogram& other) {
+    for (size_t i = 0; i < counts_.size(); ++i) {
+        counts_[i] += other.counts_[i];
+    }
+    count_ += other.count_;
+    min_ = std::min(min_, other.min_);
+    max_ = std::max(max_, other.max_);
+    sum_ += other.sum_;
+}
+
+uint64_t LatencyHistogram::GetCount() const {
+    return count_;
+}
+
+LatencyHistogram::Duration LatencyHistogram::GetMin() const {
+    return Duration(count_ == 0 ? 0 : min_);
+}
+
+LatencyHistogram::Duration LatencyHistogram::GetMax() const {
+    return Duration(max_);
+}
+
+LatencyHistogram::Duration LatencyHistogram::GetMean() const {
+    return Duration(count_ == 0 ? 0 : static_cast<int64_t>(std::llround(sum_ / count_)));
+}
+
+LatencyHistogram::Duration LatencyHistogram::GetPercentile(double percentile) const {
+    if (count_ == 0) {
+        return Duration(0);
+    }
+    const double clamped = std::clamp(percentile, 0.0, 100.0);
+    const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(clamped / 100.0 * count_)));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < counts_.size(); ++i) {
+        seen += counts_[i];
+        if (seen >= rank) {
+            // The bucket bound may lie above anything recorded
+            return Duration(std::min(GetHighestValue(i), max_));
+        }
+    }
+    return Duration(max_);
+}
+
+void LatencyHistogram::Print(std::ostream& output) const {
+    for (const double percentile : { 50.0, 90.0, 99.0, 99.9, 99.99, 100.0 }) {
+        output << "p" << percentile << " = "
+            << std::chrono::duration<double, std::micro>(GetPercentile(percentile)).count() << " us\n";
+    }
+    output << "count = " << count_ << ", "
+        << "mean = " << std::chrono::duration<double, std::micro>(GetMean()).count() << " us" << std::endl;
+}
+
+size_t LatencyHistogram::GetIndex(uint64_t value) {
+    if (value < EXACT_LIMIT) {
+        return value;
+    }
+    const unsigned highest_bit = GetHighestBit(value);
+    const unsigned shift = highest_bit - (EXACT_BITS - 1);
+    // Top EXACT_BITS bits of the value, in [SUB_BUCKET_COUNT, EXACT_LIMIT)
+    const uint64_t sub_bucket = value >> shift;
+    return EXACT_LIMIT + (highest_bit - EXACT_BITS) * SUB_BUCKET_COUNT + (sub_bucket - SUB_BUCKET_COUNT);
+}
+
+uint64_t LatencyHistogram::GetHighestValue(size_t index) {
+    if (index < EXACT_LIMIT) {
+        return index;
+    }
+    const size_t offset = index - EXACT_LIMIT;
+    const unsigned highest_bit = static_cast<unsigned>(offset / SUB_BUCKET_COUNT) + EXACT_BITS;
+    const unsigned shift = highest_bit - (EXACT_BITS - 1);
+    const uint64_t sub_bucket = offset % SUB_BUCKET_COUNT + SUB_BUCKET_COUNT;
+    // Every value sharing the top bits, the lowest bits all set
+    return (sub_bucket << shift) | ((uint64_t{1} << shift) - 1);
+}
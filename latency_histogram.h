@@ -0,0 +1,44 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+// Log-linear histogram of durations in the spirit of HdrHistogram: values below 128 ns are counted
+// exactly, larger ones in 64 sub-buckets per power of two, so every value is known within 1/64 (1.6%).
+// Recording is O(1) and the memory is fixed (about 30 KB); histograms of several threads can be added up.
+// Not thread-safe.
+class LatencyHistogram {
+public:
+    using Duration = std::chrono::nanoseconds;
+
+    LatencyHistogram();
+
+    void Record(Duration value);
+
+    // Adds the counts of 'other'
+    void Merge(const LatencyHistogram& other);
+
+    [[nodiscard]] uint64_t GetCount() const;
+    [[nodiscard]] Duration GetMin() const;
+    [[nodiscard]] Duration GetMax() const;
+    [[nodiscard]] Duration GetMean() const;
+
+    // Highest value of the bucket holding the given percentile in [0, 100], zero if empty
+    [[nodiscard]] Duration GetPercentile(double percentile) const;
+
+    // Percentile table from the median to the maximum, one line per percentile
+    void Print(std::ostream& output) const;
+
+private:
+    std::vector<uint64_t> counts_;
+    uint64_t count_ = 0;
+    uint64_t min_ = UINT64_MAX;
+    uint64_t max_ = 0;
+    // Long double keeps the sum exact well past the range of a day in nanoseconds
+    long double sum_ = 0;
+
+    static size_t GetIndex(uint64_t value);
+    static uint64_t GetHighestValue(size_t index);
+};
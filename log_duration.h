@@ -13,22 +13,30 @@ class LogDuration {
 public:
     using Clock = std::chrono::steady_clock;
 
-    LogDuration(const std::string& id, std::ostream& os = std::cerr) : id_(id) , os_(os) {
+    LogDuration(const std::string& id, std::ostream& os = std::cerr) : id_(id) , os_(&os) {
+    }
+
+    // Logs nothing if 'os' is null
+    LogDuration(const std::string& id, std::ostream* os) : id_(id) , os_(os) {
     }
 
     ~LogDuration() {
         using namespace std::chrono;
         using namespace std::literals;
 
+        if (os_ == nullptr) {
+            return;
+        }
+
         const auto end_time = Clock::now();
         const auto dur = end_time - start_time_;
 
-        const std::string output_id = (&os_ == &std::cout) ? "Operation time" : id_;
-        os_ << output_id << ": "s << duration_cast<milliseconds>(dur).count() << " ms"s << std::endl;
+        const std::string output_id = (os_ == &std::cout) ? "Operation time" : id_;
+        *os_ << output_id << ": "s << duration_cast<milliseconds>(dur).count() << " ms"s << std::endl;
     }
 
 private:
     const std::string id_;
     const Clock::time_point start_time_ = Clock::now();
-    std::ostream& os_;
-};
\ No newline at end of file
+    std::ostream* os_;
+};
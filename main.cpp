@@ -7,6 +7,7 @@
 #include "read_input_functions.h"
 #include "remove_duplicates.h"
 #include "test_example_functions.h"
+#include "benchmark.h"
 
 using namespace std;
 
@@ -47,4 +48,5 @@ int main() {
     cout << "After duplicates removed: "s << search_server.GetDocumentCount() << endl;
 
 //    TestSearchServer();
+//    RunBenchmark();
 }
\ No newline at end of file
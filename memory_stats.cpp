@@ -0,0 +1,70 @@
+#include "memory_stats.h"
+
+TrackingMemoryResource::TrackingMemoryResource(std::pmr::memory_resource* upstream)
+        : upstream_(upstream) {
+}
+
+size_t TrackingMemoryResource::GetBytes() const {
+    return bytes_.load(std::memory_order_relaxed);
+}
+
+size_t TrackingMemoryResource::GetAllocationCount() const {
+    return allocations_.load(std::memory_order_relaxed);
+}
+
+void* TrackingMemoryResource::do_allocate(size_t bytes, size_t alignment) {
+    void* pointer = upstream_->allocate(bytes, alignment);
+    bytes_.fetch_add(bytes, std::memory_order_relaxed);
+    allocations_.fetch_add(1, std::memory_order_relaxed);
+    return pointer;
+}
+
+void TrackingMemoryResource::do_deallocate(void* pointer, size_t bytes, size_t alignment) {
+    upstream_->deallocate(pointer, bytes, alignment);
+    bytes_.fetch_sub(bytes, std::memory_order_relaxed);
+    allocations_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+bool TrackingMemoryResource::do_is_equal(const std::pmr::memory_resource& other) const noexcept {
+    return this == &other;
+}
+
+double MemoryStats::GetAveragePostingsPerTerm() const {
+    return distinct_terms == 0 ? 0 : static_cast<double>(total_postings) / distinct_terms;
+}
+
+StructureMemoryStats MemoryStats::GetTotal() const {
+    StructureMemoryStats total;
+    for (const StructureMemoryStats* structure : { &stop_words, &term_dictionary, &inverted_index,
+                                                   &forward_index, &documents, &document_ids, &attributes }) {
+        total.bytes += structure->bytes;
+        total.allocations += structure->allocations;
+    }
+    return total;
+}
+
+std::ostream& operator<<(std::ostream& output, const StructureMemoryStats& stats) {
+    output << "{ "
+        << "bytes = " << stats.bytes << ", "
+        << "allocations = " << stats.allocations
+        << " }";
+
+    return output;
+}
+
+std::ostream& operator<<(std::ostream& output, const MemoryStats& stats) {
+    output << "stop words:       " << stats.stop_words << '\n'
+        << "term dictionary:  " << stats.term_dictionary << '\n'
+        << "inverted index:   " << stats.inverted_index << '\n'
+        << "forward index:    " << stats.forward_index << '\n'
+        << "documents:        " << stats.documents << '\n'
+        << "document ids:     " << stats.document_ids << '\n'
+        << "attributes:       " << stats.attributes << '\n'
+        << "total:            " << stats.GetTotal() << '\n'
+        << "distinct terms = " << stats.distinct_terms << ", "
+        << "postings = " << stats.total_postings << ", "
+        << "postings per term = " << stats.GetAveragePostingsPerTerm() << ", "
+        << "arena blocks = " << stats.arena_blocks;
+
+    return output;
+}
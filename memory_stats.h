@@ -0,0 +1,59 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <iostream>
+#include <memory_resource>
+
+// Passes allocations on to 'upstream' and counts what is currently allocated through it.
+// Thread-safe as long as 'upstream' is.
+class TrackingMemoryResource : public std::pmr::memory_resource {
+public:
+    explicit TrackingMemoryResource(std::pmr::memory_resource* upstream = std::pmr::new_delete_resource());
+
+    [[nodiscard]] size_t GetBytes() const;
+    [[nodiscard]] size_t GetAllocationCount() const;
+
+private:
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void* pointer, size_t bytes, size_t alignment) override;
+    [[nodiscard]] bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+
+    std::pmr::memory_resource* upstream_;
+    std::atomic<size_t> bytes_{0};
+    std::atomic<size_t> allocations_{0};
+};
+
+struct StructureMemoryStats {
+    size_t bytes = 0;
+    // Live allocations, one per node for node-based containers
+    size_t allocations = 0;
+};
+
+struct MemoryStats {
+    StructureMemoryStats stop_words;
+    // Term ids, document counts and the sorted dictionary for prefix lookups
+    StructureMemoryStats term_dictionary;
+    // Segments with postings
+    StructureMemoryStats inverted_index;
+    // Words of every document with their frequencies
+    StructureMemoryStats forward_index;
+    // Ratings and statuses
+    StructureMemoryStats documents;
+    StructureMemoryStats document_ids;
+    // Status and rating bitmaps
+    StructureMemoryStats attributes;
+
+    // Chunks and large blocks of the arena (IndexOptions::arena_allocation), what destroying or clearing the server frees
+    size_t arena_blocks = 0;
+
+    size_t distinct_terms = 0;
+    // Postings stored in the index, including those of removed documents not yet merged away
+    size_t total_postings = 0;
+
+    [[nodiscard]] double GetAveragePostingsPerTerm() const;
+    [[nodiscard]] StructureMemoryStats GetTotal() const;
+};
+
+std::ostream& operator<<(std::ostream& output, const StructureMemoryStats& stats);
+std::ostream& operator<<(std::ostream& output, const MemoryStats& stats);
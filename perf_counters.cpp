@@ -0,0 +1,191 @@
+#include "perf_counters.h"
+
+#include <cerrno>
+#include <cstring>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+#ifdef __linux__
+struct CounterConfig {
+    uint32_t type;
+    uint64_t config;
+};
+
+// In the order of the HardwareCounters fields
+const CounterConfig COUNTER_CONFIGS[] = {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+};
+
+int OpenCounter(const CounterConfig& counter, int group_fd) {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = counter.type;
+    attr.config = counter.config;
+    attr.disabled = group_fd < 0 ? 1 : 0;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID | PERF_FORMAT_TOTAL_TIME_ENABLED
+                       | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, PERF_FLAG_FD_CLOEXEC));
+}
+#endif
+
+std::optional<uint64_t>& GetCounter(HardwareCounters& counters, size_t index) {
+    switch (index) {
+        case 0:
+            return counters.cycles;
+        case 1:
+            return counters.instructions;
+        case 2:
+            return counters.cache_misses;
+        default:
+            return counters.branch_misses;
+    }
+}
+
+void PrintCounter(std::ostream& output, const std::optional<uint64_t>& value) {
+    if (value) {
+        output << *value;
+    } else {
+        output << "n/a";
+    }
+}
+
+} // namespace
+
+std::optional<double> HardwareCounters::GetInstructionsPerCycle() const {
+    if (!cycles || !instructions || *cycles == 0) {
+        return std::nullopt;
+    }
+    return static_cast<double>(*instructions) / *cycles;
+}
+
+PerfCounters::PerfCounters() {
+    fds_.fill(-1);
+#ifdef __linux__
+    int leader_fd = -1;
+    for (size_t i = 0; i < COUNTER_COUNT; ++i) {
+        fds_[i] = OpenCounter(COUNTER_CONFIGS[i], leader_fd);
+        if (fds_[i] >= 0 && ioctl(fds_[i], PERF_EVENT_IOC_ID, &ids_[i]) != 0) {
+            close(fds_[i]);
+            fds_[i] = -1;
+        }
+        if (fds_[i] < 0) {
+            // Without a leader nothing can be counted, a missing member only leaves its value empty
+            if (leader_fd < 0 && error_.empty()) {
+                error_ = std::string("perf_event_open failed: ") + std::strerror(errno);
+            }
+            continue;
+        }
+        if (leader_fd < 0) {
+            leader_fd = fds_[i];
+            error_.clear();
+        }
+    }
+#else
+    error_ = "perf_event_open is only available on Linux";
+#endif
+}
+
+PerfCounters::~PerfCounters() {
+#ifdef __linux__
+    for (const int fd : fds_) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+#endif
+}
+
+bool PerfCounters::IsAvailable() const {
+    for (const int fd : fds_) {
+        if (fd >= 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+const std::string& PerfCounters::GetError() const {
+    return error_;
+}
+
+void PerfCounters::Start() {
+#ifdef __linux__
+    for (const int fd : fds_) {
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+            return;
+        }
+    }
+#endif
+}
+
+HardwareCounters PerfCounters::Stop() {
+    HardwareCounters counters;
+#ifdef __linux__
+    int leader_fd = -1;
+    for (const int fd : fds_) {
+        if (fd >= 0) {
+            leader_fd = fd;
+            break;
+        }
+    }
+    if (leader_fd < 0) {
+        return counters;
+    }
+    ioctl(leader_fd, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+    // { nr, time_enabled, time_running, { value, id } * nr }
+    std::vector<uint64_t> buffer(3 + 2 * COUNTER_COUNT);
+    const ssize_t size = read(leader_fd, buffer.data(), buffer.size() * sizeof(uint64_t));
+    if (size < static_cast<ssize_t>(3 * sizeof(uint64_t))) {
+        return counters;
+    }
+    const uint64_t count = buffer[0];
+    const uint64_t time_enabled = buffer[1];
+    const uint64_t time_running = buffer[2];
+    if (time_running == 0) {
+        // The counters never got onto the PMU
+        return counters;
+    }
+    const double scale = static_cast<double>(time_enabled) / time_running;
+    for (uint64_t value_index = 0; value_index < count && value_index < COUNTER_COUNT; ++value_index) {
+        const uint64_t value = buffer[3 + 2 * value_index];
+        const uint64_t id = buffer[4 + 2 * value_index];
+        for (size_t i = 0; i < COUNTER_COUNT; ++i) {
+            if (fds_[i] >= 0 && ids_[i] == id) {
+                GetCounter(counters, i) = static_cast<uint64_t>(value * scale);
+            }
+        }
+    }
+#endif
+    return counters;
+}
+
+std::ostream& operator<<(std::ostream& output, const HardwareCounters& counters) {
+    output << "{ cycles = ";
+    PrintCounter(output, counters.cycles);
+    output << ", instructions = ";
+    PrintCounter(output, counters.instructions);
+    output << ", cache misses = ";
+    PrintCounter(output, counters.cache_misses);
+    output << ", branch misses = ";
+    PrintCounter(output, counters.branch_misses);
+    output << " }";
+
+    return output;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <iostream>
+#include <optional>
+#include <string>
+
+// Counter values of one measured interval. A counter the CPU or the kernel doesn't provide stays empty.
+struct HardwareCounters {
+    std::optional<uint64_t> cycles;
+    std::optional<uint64_t> instructions;
+    std::optional<uint64_t> cache_misses;
+    std::optional<uint64_t> branch_misses;
+
+    // Instructions per cycle, empty without both counters
+    [[nodiscard]] std::optional<double> GetInstructionsPerCycle() const;
+};
+
+// Linux perf_event_open counters of the calling thread: cycles, instructions, last level cache misses
+// and branch misses, user space only. Work done by other threads, e.g. the thread pool, is not counted.
+// When the kernel refuses the counters (no PMU in a VM, perf_event_paranoid, seccomp) IsAvailable is false
+// and Stop returns empty values.
+class PerfCounters {
+public:
+    PerfCounters();
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    ~PerfCounters();
+
+    [[nodiscard]] bool IsAvailable() const;
+
+    // Why the counters are unavailable, empty otherwise
+    [[nodiscard]] const std::string& GetError() const;
+
+    // Resets the counters and starts counting
+    void Start();
+
+    // Stops counting and returns the values since Start. Values are scaled up if the kernel
+    // had to multiplex the counters with other events.
+    HardwareCounters Stop();
+
+private:
+    static constexpr size_t COUNTER_COUNT = 4;
+
+    // The first opened counter leads the group, the others are read together with it
+    std::array<int, COUNTER_COUNT> fds_;
+    // Kernel ids of the counters, group reads tag values with them
+    std::array<uint64_t, COUNTER_COUNT> ids_{};
+    std::string error_;
+};
+
+std::ostream& operator<<(std::ostream& output, const HardwareCounters& counters);
@@ -0,0 +1,143 @@
+#include "perfect_hash_set.h"
+
+#include <algorithm>
+#include <numeric>
+
+namespace {
+
+// Average number of words per bucket
+const size_t WORDS_PER_BUCKET = 2;
+
+uint64_t Mix(uint64_t value) {
+    value ^= value >> 30;
+    value *= 0xBF58476D1CE4E5B9ull;
+    value ^= value >> 27;
+    value *= 0x94D049BB133111EBull;
+    value ^= value >> 31;
+    return value;
+}
+
+uint64_t HashWord(std::string_view word, uint64_t salt) {
+    uint64_t hash = 0xCBF29CE484222325ull ^ salt;
+    for (const char c : word) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 0x100000001B3ull;
+    }
+    return Mix(hash);
+}
+
+size_t GetSlot(uint64_t hash, uint32_t seed, size_t slot_count) {
+    return Mix(hash ^ (seed * 0x9E3779B97F4A7C15ull)) % slot_count;
+}
+
+} // namespace
+
+PerfectHashSet::PerfectHashSet(std::pmr::memory_resource* resource)
+        : bucket_seeds_(resource)
+        , word_offsets_(1, 0, resource)
+        , characters_(resource) {
+}
+
+PerfectHashSet::PerfectHashSet(const std::vector<std::string_view>& words, std::pmr::memory_resource* resource)
+        : PerfectHashSet(resource) {
+    std::vector<std::string_view> unique_words = words;
+    std::sort(unique_words.begin(), unique_words.end());
+    unique_words.erase(std::unique(unique_words.begin(), unique_words.end()), unique_words.end());
+    if (unique_words.empty()) {
+        return;
+    }
+    while (!TryBuild(unique_words)) {
+        ++salt_;
+    }
+}
+
+bool PerfectHashSet::Contains(std::string_view word) const {
+    if (bucket_seeds_.empty()) {
+        return false;
+    }
+    const uint64_t hash = HashWord(word, salt_);
+    const uint32_t seed = bucket_seeds_[hash % bucket_seeds_.size()];
+    return GetWord(GetSlot(hash, seed, size())) == word;
+}
+
+size_t PerfectHashSet::size() const {
+    return word_offsets_.size() - 1;
+}
+
+bool PerfectHashSet::empty() const {
+    return size() == 0;
+}
+
+std::vector<std::string_view> PerfectHashSet::GetWords() const {
+    std::vector<std::string_view> words;
+    words.reserve(size());
+    for (size_t slot = 0; slot < size(); ++slot) {
+        words.push_back(GetWord(slot));
+    }
+    return words;
+}
+
+std::string_view PerfectHashSet::GetWord(size_t slot) const {
+    return {characters_.data() + word_offsets_[slot], word_offsets_[slot + 1] - word_offsets_[slot]};
+}
+
+bool PerfectHashSet::TryBuild(const std::vector<std::string_view>& words) {
+    const size_t slot_count = words.size();
+    const size_t bucket_count = slot_count / WORDS_PER_BUCKET + 1;
+    std::vector<uint64_t> hashes(words.size());
+    std::vector<std::vector<size_t>> buckets(bucket_count);
+    for (size_t i = 0; i < words.size(); ++i) {
+        hashes[i] = HashWord(words[i], salt_);
+        buckets[hashes[i] % bucket_count].push_back(i);
+    }
+    // The biggest buckets are placed first, while most slots are still free
+    std::vector<size_t> bucket_order(bucket_count);
+    std::iota(bucket_order.begin(), bucket_order.end(), 0);
+    std::stable_sort(bucket_order.begin(), bucket_order.end(), [&buckets](size_t lhs, size_t rhs) {
+        return buckets[lhs].size() > buckets[rhs].size();
+    });
+
+    // A bucket of one word needs about 'slot_count' tries for the last free slot
+    const uint64_t max_seed = 16 * static_cast<uint64_t>(slot_count) + 1024;
+    std::vector<size_t> slot_words(slot_count, words.size());
+    std::vector<uint32_t> seeds(bucket_count, 0);
+    std::vector<size_t> bucket_slots;
+    for (const size_t bucket : bucket_order) {
+        if (buckets[bucket].empty()) {
+            break;
+        }
+        bool is_placed = false;
+        for (uint64_t seed = 0; seed < max_seed && !is_placed; ++seed) {
+            bucket_slots.clear();
+            is_placed = true;
+            for (const size_t word : buckets[bucket]) {
+                const size_t slot = GetSlot(hashes[word], static_cast<uint32_t>(seed), slot_count);
+                if (slot_words[slot] != words.size()
+                    || std::find(bucket_slots.begin(), bucket_slots.end(), slot) != bucket_slots.end()) {
+                    is_placed = false;
+                    break;
+                }
+                bucket_slots.push_back(slot);
+            }
+            if (is_placed) {
+                seeds[bucket] = static_cast<uint32_t>(seed);
+                for (size_t i = 0; i < bucket_slots.size(); ++i) {
+                    slot_words[bucket_slots[i]] = buckets[bucket][i];
+                }
+            }
+        }
+        if (!is_placed) {
+            return false;
+        }
+    }
+
+    bucket_seeds_.assign(seeds.begin(), seeds.end());
+    word_offsets_.clear();
+    characters_.clear();
+    for (const size_t word : slot_words) {
+        word_offsets_.push_back(static_cast<uint32_t>(characters_.size()));
+        characters_.insert(characters_.end(), words[word].begin(), words[word].end());
+    }
+    word_offsets_.push_back(static_cast<uint32_t>(characters_.size()));
+    return true;
+}
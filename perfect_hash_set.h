@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <memory_resource>
+#include <string_view>
+#include <vector>
+
+// Immutable set of words behind a minimal perfect hash (hash and displace). One hash splits the words
+// into buckets of about two, and every bucket gets a seed that sends its words to free slots of a table
+// with exactly one slot per word. A lookup hashes the word once and compares it with a single slot.
+class PerfectHashSet {
+public:
+    explicit PerfectHashSet(std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+    // Repeated words are stored once
+    explicit PerfectHashSet(const std::vector<std::string_view>& words,
+                            std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+    [[nodiscard]] bool Contains(std::string_view word) const;
+
+    [[nodiscard]] size_t size() const;
+    [[nodiscard]] bool empty() const;
+
+    // Words in slot order, the views are valid while the set is alive and unchanged
+    [[nodiscard]] std::vector<std::string_view> GetWords() const;
+
+private:
+    // Changed if two words collide on the whole 64-bit hash, then no seed can separate them
+    uint64_t salt_ = 0;
+    std::pmr::vector<uint32_t> bucket_seeds_;
+    // Word in slot i is characters_[word_offsets_[i], word_offsets_[i + 1])
+    std::pmr::vector<uint32_t> word_offsets_;
+    std::pmr::vector<char> characters_;
+
+    [[nodiscard]] std::string_view GetWord(size_t slot) const;
+
+    // Fills the table for 'words' with the current salt, false if some bucket found no seed
+    bool TryBuild(const std::vector<std::string_view>& words);
+};
@@ -0,0 +1,58 @@
+#include "query_protocol.h"
+
+#include <algorithm>
+#include <charconv>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+namespace {
+
+const std::pair<std::string_view, DocumentStatus> STATUS_NAMES[] = {
+    { "ACTUAL", DocumentStatus::ACTUAL },
+    { "IRRELEVANT", DocumentStatus::IRRELEVANT },
+    { "BANNED", DocumentStatus::BANNED },
+    { "REMOVED", DocumentStatus::REMOVED },
+};
+
+} // namespace
+
+std::string_view TakeToken(std::string_view& text) {
+    const size_t start = text.find_first_not_of(' ');
+    if (start == std::string_view::npos) {
+        text = {};
+        return {};
+    }
+    text.remove_prefix(start);
+    const size_t end = std::min(text.find(' '), text.size());
+    const std::string_view token = text.substr(0, end);
+    text.remove_prefix(std::min(end + 1, text.size()));
+    return token;
+}
+
+int ParseInt(std::string_view token) {
+    int value = 0;
+    const auto [end, error] = std::from_chars(token.data(), token.data() + token.size(), value);
+    if (error != std::errc() || end != token.data() + token.size()) {
+        throw std::invalid_argument("Expected a number instead of '" + std::string(token) + "'");
+    }
+    return value;
+}
+
+DocumentStatus ParseStatus(std::string_view token) {
+    for (const auto& [name, status] : STATUS_NAMES) {
+        if (name == token) {
+            return status;
+        }
+    }
+    throw std::invalid_argument("Unknown document status '" + std::string(token) + "'");
+}
+
+std::string_view GetStatusName(DocumentStatus status) {
+    for (const auto& [name, named_status] : STATUS_NAMES) {
+        if (named_status == status) {
+            return name;
+        }
+    }
+    return "UNKNOWN";
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "document.h"
+
+#include <string_view>
+
+// Pieces of the QueryServer line protocol shared by the server and the clients replaying query logs
+
+// Splits off the first space separated token of 'text', empty if there is none
+std::string_view TakeToken(std::string_view& text);
+
+// Throws std::invalid_argument if 'token' isn't a whole int
+int ParseInt(std::string_view token);
+
+// Statuses are written as ACTUAL, IRRELEVANT, BANNED or REMOVED
+// Throws std::invalid_argument on any other name
+DocumentStatus ParseStatus(std::string_view token);
+
+std::string_view GetStatusName(DocumentStatus status);
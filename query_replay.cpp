@@ -0,0 +1,273 @@
+#include "query_replay.h"
+#include "query_protocol.h"
+#include "request_queue.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <exception>
+#include <stdexcept>
+#include <string_view>
+#include <system_error>
+#include <thread>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Client of a QueryServer sending one request at a time over its own connection
+class ServerConnection {
+public:
+    ServerConnection(const std::string& address, uint16_t port)
+            : fd_(socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0)) {
+        sockaddr_in server_address{};
+        server_address.sin_family = AF_INET;
+        server_address.sin_port = htons(port);
+        if (inet_pton(AF_INET, address.c_str(), &server_address.sin_addr) != 1) {
+            if (fd_ >= 0) {
+                close(fd_);
+            }
+            throw std::invalid_argument("Not an IPv4 address: " + address);
+        }
+        if (fd_ < 0 || connect(fd_, reinterpret_cast<const sockaddr*>(&server_address), sizeof(server_address)) != 0) {
+            const int error = errno;
+            if (fd_ >= 0) {
+                close(fd_);
+            }
+            throw std::system_error(error, std::generic_category(), "Can't connect to " + address + ":" + std::to_string(port));
+        }
+        const int no_delay = 1;
+        setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+    }
+
+    ServerConnection(const ServerConnection&) = delete;
+    ServerConnection& operator=(const ServerConnection&) = delete;
+
+    ~ServerConnection() {
+        close(fd_);
+    }
+
+    // Number of documents found, nullopt if the server answered with an error
+    std::optional<size_t> operator()(const ReplayQuery& query) {
+        request_.clear();
+        if (query.status) {
+            request_ += "FIND_STATUS ";
+            request_ += GetStatusName(*query.status);
+            request_ += ' ';
+        } else {
+            request_ += "FIND ";
+        }
+        request_ += query.query;
+        request_ += '\n';
+        Send();
+
+        const std::string_view reply = ReceiveLine();
+        std::string_view rest = reply;
+        if (TakeToken(rest) != "OK") {
+            return std::nullopt;
+        }
+        const std::string_view count = TakeToken(rest);
+        size_t document_count = 0;
+        const auto [end, error] = std::from_chars(count.data(), count.data() + count.size(), document_count);
+        if (error != std::errc()) {
+            return std::nullopt;
+        }
+        return document_count;
+    }
+
+private:
+    int fd_;
+    std::string request_;
+    std::string input_;
+    size_t line_begin_ = 0;
+
+    void Send() {
+        for (size_t written = 0; written < request_.size();) {
+            const ssize_t result = send(fd_, request_.data() + written, request_.size() - written, MSG_NOSIGNAL);
+            if (result < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::system_error(errno, std::generic_category(), "Can't send a request");
+            }
+            written += static_cast<size_t>(result);
+        }
+    }
+
+    // The returned line stays valid until the next call
+    std::string_view ReceiveLine() {
+        input_.erase(0, line_begin_);
+        line_begin_ = 0;
+        size_t line_end = input_.find('\n');
+        char buffer[4096];
+        while (line_end == std::string::npos) {
+            const ssize_t result = read(fd_, buffer, sizeof(buffer));
+            if (result < 0 && errno == EINTR) {
+                continue;
+            }
+            if (result < 0) {
+                throw std::system_error(errno, std::generic_category(), "Can't receive a reply");
+            }
+            if (result == 0) {
+                throw std::runtime_error("Query server closed the connection");
+            }
+            const size_t searched = input_.size();
+            input_.append(buffer, result);
+            line_end = input_.find('\n', searched);
+        }
+        line_begin_ = line_end + 1;
+        return std::string_view(input_).substr(0, line_end);
+    }
+};
+
+// Runs the clients made by 'make_client' until 'options.request_count' requests are answered.
+// A client is called with a query and returns the number of documents found, nullopt on an error.
+template <typename MakeClient>
+ReplayResult Replay(const std::vector<ReplayQuery>& queries, const ReplayOptions& options, MakeClient make_client) {
+    ReplayResult result;
+    if (queries.empty()) {
+        return result;
+    }
+    const bool is_open_loop = options.mode == ReplayMode::OPEN_LOOP;
+    if (is_open_loop && !(options.requests_per_second > 0)) {
+        throw std::invalid_argument("Open loop replay needs a positive request rate");
+    }
+    const size_t request_count = options.request_count > 0 ? options.request_count : queries.size();
+    const size_t client_count = std::max<size_t>(options.client_count, 1);
+
+    std::atomic<size_t> next_request{0};
+    std::vector<ReplayResult> client_results(client_count);
+    std::vector<std::exception_ptr> client_errors(client_count);
+    std::vector<std::thread> clients;
+    clients.reserve(client_count);
+    const Clock::time_point start = Clock::now();
+    for (size_t client_index = 0; client_index < client_count; ++client_index) {
+        clients.emplace_back([&, client_index] {
+            try {
+                auto client = make_client();
+                ReplayResult& client_result = client_results[client_index];
+                for (size_t i = next_request++; i < request_count; i = next_request++) {
+                    Clock::time_point sent = Clock::now();
+                    if (is_open_loop) {
+                        // A client that is late sends at once, the delay still counts
+                        sent = start + std::chrono::duration_cast<Clock::duration>(
+                                std::chrono::duration<double>(i / options.requests_per_second));
+                        std::this_thread::sleep_until(sent);
+                    }
+                    const std::optional<size_t> found = client(queries[i % queries.size()]);
+                    client_result.latencies.Record(Clock::now() - sent);
+                    ++client_result.requests;
+                    if (!found) {
+                        ++client_result.errors;
+                    } else if (*found == 0) {
+                        ++client_result.empty_results;
+                    }
+                }
+            } catch (...) {
+                client_errors[client_index] = std::current_exception();
+                // The other clients stop too
+                next_request = request_count;
+            }
+        });
+    }
+    for (std::thread& client : clients) {
+        client.join();
+    }
+    result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    for (const std::exception_ptr& error : client_errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    for (const ReplayResult& client_result : client_results) {
+        result.requests += client_result.requests;
+        result.errors += client_result.errors;
+        result.empty_results += client_result.empty_results;
+        result.latencies.Merge(client_result.latencies);
+    }
+    return result;
+}
+
+} // namespace
+
+double ReplayResult::GetThroughput() const {
+    return seconds > 0 ? requests / seconds : 0;
+}
+
+std::ostream& operator<<(std::ostream& output, const ReplayResult& result) {
+    output << "requests = " << result.requests << ", "
+        << "errors = " << result.errors << ", "
+        << "empty results = " << result.empty_results << ", "
+        << "seconds = " << result.seconds << ", "
+        << "requests per second = " << result.GetThroughput() << '\n';
+    result.latencies.Print(output);
+
+    return output;
+}
+
+std::vector<ReplayQuery> ReadQueryLog(std::istream& input) {
+    std::vector<ReplayQuery> queries;
+    std::string line;
+    while (std::getline(input, line)) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        std::string_view rest = line;
+        const std::string_view command = TakeToken(rest);
+        if (command.empty()) {
+            continue;
+        }
+        ReplayQuery query;
+        if (command == "FIND_STATUS") {
+            query.status = ParseStatus(TakeToken(rest));
+            query.query = rest;
+        } else if (command == "FIND") {
+            query.query = rest;
+        } else {
+            query.query = line;
+        }
+        queries.push_back(std::move(query));
+    }
+    return queries;
+}
+
+ReplayResult ReplayQueries(SearchServer& search_server, const std::vector<ReplayQuery>& queries,
+                           const ReplayOptions& options) {
+    // Timing lines would be written from every client thread and counted in the latencies
+    std::ostream* const duration_log = search_server.GetDurationLog();
+    search_server.SetDurationLog(nullptr);
+    ReplayResult result;
+    try {
+        result = Replay(queries, options, [&search_server] {
+            return [queue = RequestQueue(search_server)](const ReplayQuery& query) mutable -> std::optional<size_t> {
+                try {
+                    return query.status ? queue.AddFindRequest(query.query, *query.status).size()
+                                        : queue.AddFindRequest(query.query).size();
+                } catch (const std::exception&) {
+                    return std::nullopt;
+                }
+            };
+        });
+    } catch (...) {
+        search_server.SetDurationLog(duration_log);
+        throw;
+    }
+    search_server.SetDurationLog(duration_log);
+    return result;
+}
+
+ReplayResult ReplayQueries(const std::string& address, uint16_t port, const std::vector<ReplayQuery>& queries,
+                           const ReplayOptions& options) {
+    return Replay(queries, options, [&address, port] {
+        return ServerConnection(address, port);
+    });
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "latency_histogram.h"
+#include "search_server.h"
+
+#include <cstdint>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <vector>
+
+// One recorded request: a query, optionally restricted to documents of one status
+struct ReplayQuery {
+    std::string query;
+    std::optional<DocumentStatus> status;
+};
+
+enum class ReplayMode {
+    // Every client sends its next request as soon as the previous one is answered.
+    // Shows the throughput at a given concurrency, but latencies hide queueing: a slow
+    // request delays the requests behind it without them being measured (coordinated omission).
+    CLOSED_LOOP,
+    // Requests are due at a fixed rate whether or not earlier ones are answered, and latency
+    // is measured from the time a request was due. Once the clients fall behind, the wait
+    // shows up in the latencies, which is how the saturation point is found.
+    OPEN_LOOP,
+};
+
+struct ReplayOptions {
+    ReplayMode mode = ReplayMode::CLOSED_LOOP;
+    // Concurrent clients, each with its own RequestQueue or connection
+    size_t client_count = 4;
+    // Arrival rate of the open loop
+    double requests_per_second = 1000;
+    // The log is replayed in a cycle up to this many requests, 0 replays it once
+    size_t request_count = 0;
+};
+
+struct ReplayResult {
+    uint64_t requests = 0;
+    // Requests that failed, like queries the server rejects
+    uint64_t errors = 0;
+    uint64_t empty_results = 0;
+    double seconds = 0;
+    LatencyHistogram latencies;
+
+    [[nodiscard]] double GetThroughput() const;
+};
+
+std::ostream& operator<<(std::ostream& output, const ReplayResult& result);
+
+/// Reads a query log, one request per line in the QueryServer protocol: 'FIND <query>' or
+/// 'FIND_STATUS <status> <query>'. A line without a command is a query. Blank lines are skipped.
+/// Throws std::invalid_argument on an unknown status
+std::vector<ReplayQuery> ReadQueryLog(std::istream& input);
+
+/// Replays 'queries' against 'search_server' in this process. Each client sends its queries
+/// through its own RequestQueue, the way the application does. The duration log of 'search_server'
+/// is off during the replay, nothing else may use the server meanwhile.
+ReplayResult ReplayQueries(SearchServer& search_server, const std::vector<ReplayQuery>& queries,
+                           const ReplayOptions& options = {});
+
+/// Replays 'queries' against a QueryServer listening at 'address':'port', one connection per client.
+/// Throws std::system_error if a client can't connect
+ReplayResult ReplayQueries(const std::string& address, uint16_t port, const std::vector<ReplayQuery>& queries,
+                           const ReplayOptions& options = {});
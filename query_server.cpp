@@ -0,0 +1,511 @@
+#include "query_server.h"
+#include "query_protocol.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <stdexcept>
+#include <string_view>
+#include <system_error>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+// epoll_event ids of the two non-connection descriptors, connections are numbered after them
+const uint64_t LISTEN_ID = 0;
+const uint64_t WAKE_ID = 1;
+const uint64_t FIRST_CONNECTION_ID = 2;
+
+const int MAX_EVENTS = 256;
+const size_t READ_BUFFER_SIZE = 64 * 1024;
+
+[[noreturn]] void ThrowSystemError(const std::string& what) {
+    throw std::system_error(errno, std::generic_category(), what);
+}
+
+void AppendNumber(std::string& output, double value) {
+    char buffer[32];
+    const auto [end, error] = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    output.append(buffer, end);
+}
+
+std::string FormatDocuments(const std::vector<Document>& documents) {
+    std::string reply = "OK " + std::to_string(documents.size());
+    for (const Document& document : documents) {
+        reply += ' ';
+        reply += std::to_string(document.id);
+        reply += ' ';
+        AppendNumber(reply, document.relevance);
+        reply += ' ';
+        reply += std::to_string(document.rating);
+    }
+    return reply;
+}
+
+std::string FormatStats(const QueryServerStats& stats) {
+    std::string reply = "OK connections=" + std::to_string(stats.connections)
+                        + " requests=" + std::to_string(stats.requests)
+                        + " batches=" + std::to_string(stats.batches) + " throughput=";
+    AppendNumber(reply, stats.GetThroughput());
+    for (const auto& [name, percentile] : { std::pair{ "p50", 50.0 }, std::pair{ "p99", 99.0 }, std::pair{ "max", 100.0 } }) {
+        reply += ' ';
+        reply += name;
+        reply += "_us=";
+        AppendNumber(reply, std::chrono::duration<double, std::micro>(stats.latencies.GetPercentile(percentile)).count());
+    }
+    return reply;
+}
+
+std::string FormatError(const std::string& message) {
+    std::string reply = "ERROR " + message;
+    // Replies are single lines
+    std::replace(reply.begin(), reply.end(), '\n', ' ');
+    return reply;
+}
+
+bool IsChange(std::string_view line) {
+    return TakeToken(line) == "ADD";
+}
+
+} // namespace
+
+double QueryServerStats::GetThroughput() const {
+    return seconds > 0 ? requests / seconds : 0;
+}
+
+double QueryServerStats::GetAverageBatchSize() const {
+    return batches > 0 ? static_cast<double>(requests) / batches : 0;
+}
+
+std::ostream& operator<<(std::ostream& output, const QueryServerStats& stats) {
+    output << "connections = " << stats.connections << ", "
+        << "requests = " << stats.requests << ", "
+        << "batches = " << stats.batches << ", "
+        << "requests per second = " << stats.GetThroughput() << ", "
+        << "requests per batch = " << stats.GetAverageBatchSize() << '\n';
+    stats.latencies.Print(output);
+
+    return output;
+}
+
+QueryServer::QueryServer(SearchServer& search_server, const QueryServerOptions& options)
+        : search_server_(search_server)
+        , duration_log_(search_server.GetDurationLog())
+        , options_(options)
+        , start_(Clock::now())
+        , next_connection_id_(FIRST_CONNECTION_ID) {
+    options_.max_batch_size = std::max<size_t>(options_.max_batch_size, 1);
+    try {
+        listen_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (listen_fd_ < 0) {
+            ThrowSystemError("Can't create a socket");
+        }
+        const int reuse_address = 1;
+        setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &reuse_address, sizeof(reuse_address));
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(options_.port);
+        if (inet_pton(AF_INET, options_.address.c_str(), &address.sin_addr) != 1) {
+            throw std::invalid_argument("Not an IPv4 address: " + options_.address);
+        }
+        if (bind(listen_fd_, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0
+            || listen(listen_fd_, SOMAXCONN) != 0) {
+            ThrowSystemError("Can't listen on " + options_.address + ":" + std::to_string(options_.port));
+        }
+        socklen_t address_size = sizeof(address);
+        if (getsockname(listen_fd_, reinterpret_cast<sockaddr*>(&address), &address_size) != 0) {
+            ThrowSystemError("Can't get the listening port");
+        }
+        port_ = ntohs(address.sin_port);
+
+        epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+        wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (epoll_fd_ < 0 || wake_fd_ < 0) {
+            ThrowSystemError("Can't create the event loop");
+        }
+        for (const auto& [fd, id] : { std::pair{ listen_fd_, LISTEN_ID }, std::pair{ wake_fd_, WAKE_ID } }) {
+            epoll_event event{};
+            event.events = EPOLLIN;
+            event.data.u64 = id;
+            if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) != 0) {
+                ThrowSystemError("Can't watch the listening socket");
+            }
+        }
+    } catch (...) {
+        for (const int fd : { listen_fd_, epoll_fd_, wake_fd_ }) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+        throw;
+    }
+    // Every FIND and MATCH would print a timing line from a pool thread
+    search_server_.SetDurationLog(nullptr);
+    event_loop_ = std::thread([this] {
+        RunEventLoop();
+    });
+    executor_ = std::thread([this] {
+        RunExecutor();
+    });
+}
+
+QueryServer::~QueryServer() {
+    Stop();
+}
+
+uint16_t QueryServer::GetPort() const {
+    return port_;
+}
+
+QueryServerStats QueryServer::GetStats() const {
+    std::lock_guard lock(stats_mutex_);
+    QueryServerStats stats = stats_;
+    stats.seconds = std::chrono::duration<double>(Clock::now() - start_).count();
+    return stats;
+}
+
+void QueryServer::Stop() {
+    if (stop_.exchange(true)) {
+        return;
+    }
+    {
+        // The executor checks the flag under this mutex, so it either sees it or gets the notification
+        std::lock_guard lock(requests_mutex_);
+    }
+    requests_ready_.notify_all();
+    const uint64_t wake = 1;
+    [[maybe_unused]] const ssize_t written = write(wake_fd_, &wake, sizeof(wake));
+    event_loop_.join();
+    executor_.join();
+    for (const auto& [id, connection] : connections_) {
+        close(connection.fd);
+    }
+    connections_.clear();
+    close(listen_fd_);
+    close(epoll_fd_);
+    close(wake_fd_);
+    search_server_.SetDurationLog(duration_log_);
+}
+
+void QueryServer::RunEventLoop() {
+    std::vector<epoll_event> events(MAX_EVENTS);
+    while (!stop_) {
+        const int count = epoll_wait(epoll_fd_, events.data(), MAX_EVENTS, -1);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        for (int i = 0; i < count; ++i) {
+            const uint64_t id = events[i].data.u64;
+            if (id == LISTEN_ID) {
+                AcceptConnections();
+            } else if (id == WAKE_ID) {
+                uint64_t wake_count = 0;
+                [[maybe_unused]] const ssize_t result = read(wake_fd_, &wake_count, sizeof(wake_count));
+                DeliverReplies();
+            } else if (connections_.count(id)) {
+                if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                    CloseConnection(id);
+                    continue;
+                }
+                if (events[i].events & (EPOLLIN | EPOLLRDHUP)) {
+                    ReadConnection(id);
+                }
+                if ((events[i].events & EPOLLOUT) && connections_.count(id)) {
+                    WriteConnection(id);
+                }
+            }
+        }
+    }
+}
+
+void QueryServer::AcceptConnections() {
+    while (true) {
+        const int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        // Replies are small and must not wait for more data
+        const int no_delay = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+        const uint64_t id = next_connection_id_++;
+        connections_[id].fd = fd;
+        epoll_event event{};
+        event.events = EPOLLIN | EPOLLRDHUP;
+        event.data.u64 = id;
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) != 0) {
+            close(fd);
+            connections_.erase(id);
+            continue;
+        }
+        std::lock_guard lock(stats_mutex_);
+        ++stats_.connections;
+    }
+}
+
+void QueryServer::ReadConnection(uint64_t connection_id) {
+    Connection& connection = connections_.at(connection_id);
+    const Clock::time_point now = Clock::now();
+    std::vector<Request> requests;
+    char buffer[READ_BUFFER_SIZE];
+    while (true) {
+        const ssize_t result = read(connection.fd, buffer, sizeof(buffer));
+        if (result > 0) {
+            connection.input.append(buffer, result);
+            TakeRequests(connection_id, connection, static_cast<size_t>(result), now, requests);
+            // Checked on every read, a client sending without line breaks can't grow the input past the limit
+            if (connection.input.size() > options_.max_line_length) {
+                CloseConnection(connection_id);
+                return;
+            }
+            continue;
+        }
+        if (result == 0) {
+            connection.is_input_closed = true;
+            break;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            break;
+        }
+        CloseConnection(connection_id);
+        return;
+    }
+
+    if (!requests.empty()) {
+        connection.pending_replies += requests.size();
+        {
+            std::lock_guard lock(requests_mutex_);
+            std::move(requests.begin(), requests.end(), std::back_inserter(requests_));
+        }
+        requests_ready_.notify_one();
+    }
+    if (connection.is_input_closed) {
+        if (connection.pending_replies == 0 && connection.output.empty()) {
+            CloseConnection(connection_id);
+            return;
+        }
+        // A closed input stays readable, it is no longer watched
+        UpdateEvents(connection_id, connection);
+    }
+}
+
+void QueryServer::TakeRequests(uint64_t connection_id, Connection& connection, size_t appended, Clock::time_point arrival,
+                               std::vector<Request>& requests) {
+    // The input held no line break before the appended bytes
+    size_t line_begin = 0;
+    for (size_t line_end = connection.input.find('\n', connection.input.size() - appended); line_end != std::string::npos;
+         line_begin = line_end + 1, line_end = connection.input.find('\n', line_begin)) {
+        std::string line = connection.input.substr(line_begin, line_end - line_begin);
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (!line.empty()) {
+            requests.push_back({connection_id, std::move(line), arrival});
+        }
+    }
+    connection.input.erase(0, line_begin);
+}
+
+void QueryServer::WriteConnection(uint64_t connection_id) {
+    Connection& connection = connections_.at(connection_id);
+    size_t written = 0;
+    while (written < connection.output.size()) {
+        const ssize_t result = send(connection.fd, connection.output.data() + written, connection.output.size() - written, MSG_NOSIGNAL);
+        if (result >= 0) {
+            written += result;
+            continue;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            break;
+        }
+        CloseConnection(connection_id);
+        return;
+    }
+    connection.output.erase(0, written);
+    if (connection.is_input_closed && connection.pending_replies == 0 && connection.output.empty()) {
+        CloseConnection(connection_id);
+        return;
+    }
+    const bool is_writing = !connection.output.empty();
+    if (is_writing != connection.is_writing) {
+        connection.is_writing = is_writing;
+        UpdateEvents(connection_id, connection);
+    }
+}
+
+void QueryServer::DeliverReplies() {
+    std::vector<Reply> replies;
+    {
+        std::lock_guard lock(replies_mutex_);
+        replies.swap(replies_);
+    }
+    const Clock::time_point now = Clock::now();
+    {
+        std::lock_guard lock(stats_mutex_);
+        stats_.requests += replies.size();
+        for (const Reply& reply : replies) {
+            stats_.latencies.Record(now - reply.arrival);
+        }
+    }
+    std::vector<uint64_t> touched_connections;
+    for (Reply& reply : replies) {
+        const auto it = connections_.find(reply.connection_id);
+        if (it == connections_.end()) {
+            continue;
+        }
+        it->second.output += reply.text;
+        it->second.output += '\n';
+        --it->second.pending_replies;
+        if (touched_connections.empty() || touched_connections.back() != reply.connection_id) {
+            touched_connections.push_back(reply.connection_id);
+        }
+    }
+    for (const uint64_t connection_id : touched_connections) {
+        if (connections_.count(connection_id)) {
+            WriteConnection(connection_id);
+        }
+    }
+}
+
+void QueryServer::UpdateEvents(uint64_t connection_id, const Connection& connection) {
+    epoll_event event{};
+    event.events = (connection.is_input_closed ? 0u : EPOLLIN | EPOLLRDHUP) | (connection.is_writing ? EPOLLOUT : 0u);
+    event.data.u64 = connection_id;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, connection.fd, &event) != 0) {
+        CloseConnection(connection_id);
+    }
+}
+
+void QueryServer::CloseConnection(uint64_t connection_id) {
+    const auto it = connections_.find(connection_id);
+    // Closing the descriptor also removes it from epoll
+    close(it->second.fd);
+    connections_.erase(it);
+}
+
+void QueryServer::RunExecutor() {
+    while (true) {
+        std::vector<Request> batch;
+        {
+            std::unique_lock lock(requests_mutex_);
+            requests_ready_.wait(lock, [this] {
+                return stop_ || !requests_.empty();
+            });
+            if (stop_) {
+                return;
+            }
+            // A change runs alone, queries are taken up to the next change
+            if (IsChange(requests_.front().line)) {
+                batch.push_back(std::move(requests_.front()));
+                requests_.pop_front();
+            } else {
+                while (!requests_.empty() && batch.size() < options_.max_batch_size && !IsChange(requests_.front().line)) {
+                    batch.push_back(std::move(requests_.front()));
+                    requests_.pop_front();
+                }
+            }
+        }
+
+        std::vector<Reply> replies(batch.size());
+        if (IsChange(batch.front().line)) {
+            replies.front().text = ExecuteAdd(batch.front().line);
+        } else {
+            ThreadPool::GetShared().ParallelFor(batch.size(), [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; ++i) {
+                    replies[i].text = Execute(batch[i].line);
+                }
+            });
+        }
+        for (size_t i = 0; i < batch.size(); ++i) {
+            replies[i].connection_id = batch[i].connection_id;
+            replies[i].arrival = batch[i].arrival;
+        }
+        {
+            std::lock_guard lock(stats_mutex_);
+            ++stats_.batches;
+        }
+        PostReplies(std::move(replies));
+    }
+}
+
+void QueryServer::PostReplies(std::vector<Reply> replies) {
+    {
+        std::lock_guard lock(replies_mutex_);
+        std::move(replies.begin(), replies.end(), std::back_inserter(replies_));
+    }
+    const uint64_t wake = 1;
+    [[maybe_unused]] const ssize_t written = write(wake_fd_, &wake, sizeof(wake));
+}
+
+std::string QueryServer::Execute(const std::string& line) const {
+    try {
+        std::string_view arguments = line;
+        const std::string_view command = TakeToken(arguments);
+        if (command == "FIND") {
+            return FormatDocuments(search_server_.FindTopDocuments(std::string(arguments)));
+        }
+        if (command == "FIND_STATUS") {
+            const DocumentStatus status = ParseStatus(TakeToken(arguments));
+            return FormatDocuments(search_server_.FindTopDocuments(std::string(arguments), status));
+        }
+        if (command == "MATCH") {
+            const int document_id = ParseInt(TakeToken(arguments));
+            const auto [words, status] = search_server_.MatchDocument(std::string(arguments), document_id);
+            std::string reply = "OK " + std::string(GetStatusName(status)) + " " + std::to_string(words.size());
+            for (const std::string& word : words) {
+                reply += ' ';
+                reply += word;
+            }
+            return reply;
+        }
+        if (command == "STATS") {
+            return FormatStats(GetStats());
+        }
+        return FormatError("Unknown command '" + std::string(command) + "'");
+    } catch (const std::out_of_range&) {
+        return FormatError("No such document");
+    } catch (const std::exception& e) {
+        return FormatError(e.what());
+    }
+}
+
+std::string QueryServer::ExecuteAdd(const std::string& line) {
+    try {
+        std::string_view arguments = line;
+        TakeToken(arguments);
+        const int document_id = ParseInt(TakeToken(arguments));
+        const DocumentStatus status = ParseStatus(TakeToken(arguments));
+        // The count comes from the client, so nothing is allocated for it up front. Every rating
+        // has to be in the line, a missing one fails to parse.
+        const int rating_count = ParseInt(TakeToken(arguments));
+        if (rating_count < 0) {
+            throw std::invalid_argument("Negative ratings count");
+        }
+        std::vector<int> ratings;
+        for (int i = 0; i < rating_count; ++i) {
+            ratings.push_back(ParseInt(TakeToken(arguments)));
+        }
+        search_server_.AddDocument(document_id, arguments, status, ratings);
+        return "OK";
+    } catch (const std::exception& e) {
+        return FormatError(e.what());
+    }
+}
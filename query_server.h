@@ -0,0 +1,141 @@
+#pragma once
+
+#include "latency_histogram.h"
+#include "search_server.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+struct QueryServerOptions {
+    std::string address = "127.0.0.1";
+    // 0 picks a free port, see GetPort
+    uint16_t port = 0;
+    // Queries waiting together are executed as one parallel batch of at most this many
+    size_t max_batch_size = 256;
+    // A connection sending a longer line without a line break is closed
+    size_t max_line_length = 1 << 20;
+};
+
+struct QueryServerStats {
+    uint64_t connections = 0;
+    uint64_t requests = 0;
+    uint64_t batches = 0;
+    double seconds = 0;
+    // From the arrival of a request line to its reply being queued for sending
+    LatencyHistogram latencies;
+
+    [[nodiscard]] double GetThroughput() const;
+    [[nodiscard]] double GetAverageBatchSize() const;
+};
+
+std::ostream& operator<<(std::ostream& output, const QueryServerStats& stats);
+
+// TCP front end of a SearchServer: one thread runs an epoll loop over non-blocking sockets and another
+// executes the requests. Requests are lines of text and every request gets a single line reply, in order
+// per connection; clients may send several requests without waiting (pipelining).
+//
+//     FIND <query>                                  OK <count> (<id> <relevance> <rating>)*
+//     FIND_STATUS <status> <query>                  OK <count> (<id> <relevance> <rating>)*
+//     MATCH <document id> <query>                   OK <status> <count> <word>*
+//     ADD <document id> <status> <ratings count> <rating>* <text>    OK
+//     STATS                                         OK <counters of QueryServerStats>
+//
+// Statuses are written as ACTUAL, IRRELEVANT, BANNED or REMOVED. A failed request is answered with
+// 'ERROR <message>'. Queries that arrive while a batch is running are coalesced into the next batch,
+// which runs on the shared thread pool. ADD runs on its own, between batches, since searches must not
+// overlap with changes of the SearchServer. The duration log of the SearchServer is off while it is served.
+class QueryServer {
+public:
+    // Starts serving at once. 'search_server' must outlive the server and must not be changed by others while it runs.
+    // Throws std::system_error if the address can't be bound.
+    explicit QueryServer(SearchServer& search_server, const QueryServerOptions& options = {});
+
+    QueryServer(const QueryServer&) = delete;
+    QueryServer& operator=(const QueryServer&) = delete;
+
+    ~QueryServer();
+
+    [[nodiscard]] uint16_t GetPort() const;
+
+    [[nodiscard]] QueryServerStats GetStats() const;
+
+    // Closes all connections, replies still pending are dropped
+    void Stop();
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Request {
+        uint64_t connection_id;
+        std::string line;
+        Clock::time_point arrival;
+    };
+
+    struct Reply {
+        uint64_t connection_id;
+        std::string text;
+        Clock::time_point arrival;
+    };
+
+    struct Connection {
+        int fd = -1;
+        std::string input;
+        std::string output;
+        size_t pending_replies = 0;
+        bool is_input_closed = false;
+        bool is_writing = false;
+    };
+
+    SearchServer& search_server_;
+    // Restored on Stop
+    std::ostream* duration_log_;
+    QueryServerOptions options_;
+    int listen_fd_ = -1;
+    int epoll_fd_ = -1;
+    // Wakes the event loop up for replies and for stopping
+    int wake_fd_ = -1;
+    uint16_t port_ = 0;
+    Clock::time_point start_;
+
+    // Owned by the event loop thread
+    std::unordered_map<uint64_t, Connection> connections_;
+    uint64_t next_connection_id_;
+
+    std::mutex requests_mutex_;
+    std::condition_variable requests_ready_;
+    std::deque<Request> requests_;
+
+    std::mutex replies_mutex_;
+    std::vector<Reply> replies_;
+
+    mutable std::mutex stats_mutex_;
+    QueryServerStats stats_;
+
+    std::atomic<bool> stop_{false};
+    std::thread event_loop_;
+    std::thread executor_;
+
+    void RunEventLoop();
+    void AcceptConnections();
+    void ReadConnection(uint64_t connection_id);
+    // Moves the complete lines of the input into 'requests', the last 'appended' bytes of it are new
+    void TakeRequests(uint64_t connection_id, Connection& connection, size_t appended, Clock::time_point arrival,
+                      std::vector<Request>& requests);
+    void WriteConnection(uint64_t connection_id);
+    void DeliverReplies();
+    void UpdateEvents(uint64_t connection_id, const Connection& connection);
+    void CloseConnection(uint64_t connection_id);
+
+    void RunExecutor();
+    void PostReplies(std::vector<Reply> replies);
+    [[nodiscard]] std::string Execute(const std::string& line) const;
+    [[nodiscard]] std::string ExecuteAdd(const std::string& line);
+};
@@ -1,4 +1,5 @@
 #pragma once
 #include "search_server.h"
 
-void RemoveDuplicates(SearchServer& search_server);
\ No newline at end of file
+// 'report' receives a line per removed document, nullptr reports nothing
+void RemoveDuplicates(SearchServer& search_server, std::ostream* report = &std::cout);
\ No newline at end of file
@@ -3,7 +3,9 @@
 
 #include <algorithm>
 #include <cmath>
+#include <cstdint>
 #include <iostream>
+#include <limits>
 #include <map>
 #include <set>
 #include <string>
@@ -11,64 +13,222 @@
 #include <vector>
 #include <sstream>
 #include <cerrno>
+#include <queue>
 
 #include "log_duration.h"
 
-SearchServer::SearchServer(const std::string& stop_words_text)
-        : SearchServer(SplitIntoWords(stop_words_text))  // Invoke delegating constructor from std::string container
+namespace {
+
+// The sorted dictionary is rebuilt once the recently added terms outgrow this share of it
+const size_t MIN_RECENT_TERMS_TO_REBUILD = 256;
+const size_t RECENT_TERMS_REBUILD_DIVISOR = 8;
+
+const char SNAPSHOT_MAGIC[8] = {'S', 'S', 'N', 'A', 'P', 'v', '1', '\n'};
+
+template <typename T>
+void WriteValue(std::ostream& output, const T& value) {
+    output.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void WriteString(std::ostream& output, std::string_view text) {
+    WriteValue(output, static_cast<uint32_t>(text.size()));
+    output.write(text.data(), static_cast<std::streamsize>(text.size()));
+}
+
+template <typename T>
+T ReadValue(std::istream& input) {
+    T value{};
+    if (!input.read(reinterpret_cast<char*>(&value), sizeof(value))) {
+        throw std::invalid_argument("Snapshot is truncated");
+    }
+    return value;
+}
+
+std::string ReadString(std::istream& input) {
+    std::string text(ReadValue<uint32_t>(input), '\0');
+    if (!input.read(text.data(), static_cast<std::streamsize>(text.size()))) {
+        throw std::invalid_argument("Snapshot is truncated");
+    }
+    return text;
+}
+
+} // namespace
+
+SearchServer::DocumentStore::DocumentStore(std::pmr::memory_resource* upstream)
+        : term_counts_memory(upstream)
+        , forward_index_memory(upstream)
+        , documents_memory(upstream)
+        , document_ids_memory(upstream)
+        , attributes_memory(upstream) {
+}
+
+void SearchServer::DocumentStoreDeleter::operator()(DocumentStore* store) const {
+    if (!is_in_arena) {
+        delete store;
+    }
+}
+
+SearchServer::SearchServer(const IndexOptions& options)
+        : memory_(std::make_shared<MemoryResources>())
+        , index_(std::make_unique<SegmentedIndex>(options, &memory_->inverted_index))
+        , arena_(options.arena_allocation ? std::make_unique<ArenaResource>() : nullptr)
+{
+}
+
+SearchServer::SearchServer(const std::string& stop_words_text, const IndexOptions& options)
+        : SearchServer(SplitIntoWords(stop_words_text), options)  // Invoke delegating constructor from std::string container
 {
 }
 
-void SearchServer::AddDocument(int document_id, const std::string& document, DocumentStatus status,
+SearchServer::SearchServer(SharedVocabulary vocabulary, const IndexOptions& options)
+        : memory_(std::make_shared<MemoryResources>())
+        , stop_words_(std::move(vocabulary.stop_words))
+        , term_dictionary_(std::move(vocabulary.terms))
+        , index_(std::make_unique<SegmentedIndex>(options, &memory_->inverted_index))
+        , arena_(options.arena_allocation ? std::make_unique<ArenaResource>() : nullptr) {
+    if (!stop_words_ || !term_dictionary_) {
+        throw std::invalid_argument("Vocabulary must have both stop words and a term dictionary");
+    }
+}
+
+void SearchServer::AddDocument(int document_id, std::string_view document, DocumentStatus status,
                                const std::vector<int>& ratings)
 {
-    const std::vector<std::string> words = SplitIntoWordsNoStop(document);
+    AddTokenizedDocument(document_id, ComputeWordFrequencies(document), status, ratings);
+}
 
-    //Check response for correctness
-    for(const std::string& word : words){
-        if(!IsValidWord(word)){
-            throw std::invalid_argument("Words in the 'document' must not contain invalid characters with codes from 0 to 31");
-        }
-        else if(document_id < 0){
-            throw std::invalid_argument("'document_id' must be a positive number");
-        }
-        else if(documents_.count(document_id)){
-            throw std::invalid_argument("The document with the given 'document_id' already exists");
+TokenizedDocument SearchServer::ComputeWordFrequencies(std::string_view document) const {
+    std::vector<std::string_view> words = SplitIntoWordsNoStop(document);
+    const double inv_word_count = 1.0 / words.size();
+    // Equal words end up next to each other, every run becomes one entry
+    std::sort(words.begin(), words.end());
+    TokenizedDocument word_freqs;
+    for (const std::string_view word : words) {
+        if (word_freqs.empty() || word_freqs.back().first != word) {
+            word_freqs.emplace_back(word, 0.0);
         }
+        word_freqs.back().second += inv_word_count;
     }
+    return word_freqs;
+}
 
-    const double inv_word_count = 1.0 / words.size();
-    for (const std::string& word : words) {
-        word_to_id_freqs_[word][document_id] += inv_word_count;
-        id_to_word_freqs_[document_id][word] += inv_word_count;
+void SearchServer::AddTokenizedDocument(int document_id, const TokenizedDocument& word_freqs, DocumentStatus status,
+                                        const std::vector<int>& ratings)
+{
+    //Check response for correctness
+    if(document_id < 0){
+        throw std::invalid_argument("'document_id' must be a positive number");
+    }
+    else if(store_->documents.count(document_id)){
+        throw std::invalid_argument("The document with the given 'document_id' already exists");
+    }
+
+    std::vector<std::pair<TermId, double>> term_freqs;
+    term_freqs.reserve(word_freqs.size());
+    for (const auto& [word, freq] : word_freqs) {
+        term_freqs.emplace_back(term_dictionary_->Insert(word), freq);
+    }
+    for (const auto& [term, _] : term_freqs) {
+        if (store_->term_document_counts[term]++ == 0) {
+            recent_terms_.insert(term_dictionary_->GetWord(term));
+        }
+    }
+    const int rating = ComputeAverageRating(ratings);
+    index_->AddDocument(document_id, term_freqs, rating);
+    if (recent_terms_.size() > std::max(MIN_RECENT_TERMS_TO_REBUILD, sorted_terms_.size() / RECENT_TERMS_REBUILD_DIVISOR)) {
+        RebuildSortedTerms();
     }
 
-    documents_.emplace(document_id,DocumentData{ComputeAverageRating(ratings),status});
-    ids_.push_back(document_id);
+    std::sort(term_freqs.begin(), term_freqs.end());
+    store_->forward_index.AddDocument(document_id, term_freqs);
+    store_->documents.emplace(document_id,DocumentData{rating,status});
+    store_->attribute_index.AddDocument(document_id, status, rating);
+    store_->ids.push_back(document_id);
 }
 
 void SearchServer::RemoveDocument(int document_id){
-    if (id_to_word_freqs_.count(document_id)) {
-        for (const auto& [word, freq] : id_to_word_freqs_.at(document_id)) {
-            word_to_id_freqs_.at(word).erase(document_id);
+    if (store_->forward_index.ContainsDocument(document_id)) {
+        // Document counts drop right away so IDF stays exact, the postings only get a tombstone
+        const auto [begin, end] = store_->forward_index.GetTermFrequencies(document_id);
+        for (const TermFrequency* entry = begin; entry != end; ++entry) {
+            const auto count = store_->term_document_counts.find(entry->term);
+            if (--count->second == 0) {
+                store_->term_document_counts.erase(count);
+            }
         }
-        id_to_word_freqs_.erase(document_id);
+        index_->RemoveDocument(document_id);
+        store_->forward_index.RemoveDocument(document_id);
         
-        documents_.erase(document_id);
+        const auto [rating, status] = store_->documents.at(document_id);
+        store_->attribute_index.RemoveDocument(document_id, status, rating);
+        store_->documents.erase(document_id);
         
-        ids_.erase(std::find(ids_.begin(), ids_.end(), document_id));
+        store_->ids.erase(std::find(store_->ids.begin(), store_->ids.end(), document_id));
     }
 }
 
+void SearchServer::Clear() {
+    // Segments are a few large blocks each, the index is simply rebuilt
+    index_ = std::make_unique<SegmentedIndex>(index_->GetOptions(), &memory_->inverted_index);
+    store_.reset();
+    if (arena_) {
+        arena_->Release();
+    }
+    store_ = MakeDocumentStore();
+    sorted_terms_ = FrontCodedDictionary(&memory_->term_dictionary);
+    recent_terms_.clear();
+}
+
 
 void SearchServer::SetStopWords(const std::string& text) {
-    for (const std::string& word : SplitIntoWords(text)) {
-        stop_words_.insert(word);
+    const std::vector<std::string> words = SplitIntoWords(text);
+    AddStopWords(std::vector<std::string_view>(words.begin(), words.end()));
+}
+
+SharedVocabulary SearchServer::GetVocabulary() const {
+    return {stop_words_, term_dictionary_};
+}
+
+void SearchServer::SetDurationLog(std::ostream* output) {
+    duration_log_ = output;
+}
+
+std::ostream* SearchServer::GetDurationLog() const {
+    return duration_log_;
+}
+
+SharedVocabulary SearchServer::CreateVocabulary(const std::string& stop_words_text, std::pmr::memory_resource* resource) {
+    const std::vector<std::string> words = SplitIntoWords(stop_words_text);
+    const std::set<std::string, std::less<>> unique_words = MakeUniqueNonEmptyStrings(words);
+    if (IsWordsHaveSpecialSymbols(unique_words)) {
+        throw std::invalid_argument("Stop words contain invalid characters with codes from 0 to 31");
     }
+    return {std::make_shared<const PerfectHashSet>(std::vector<std::string_view>(unique_words.begin(), unique_words.end()), resource),
+            std::make_shared<TermDictionary>(resource)};
+}
+
+std::vector<Document> SearchServer::FindTopDocuments(const std::string& raw_query, const DocumentFilter& filter) const {
+    LOG_DURATION_STREAM("", duration_log_);
+    const Query query = ParseQuery(raw_query);
+    size_t posting_count = 0;
+    for (const ExpandedTerm& term : CollectPlusTermsByIdf(query)) {
+        posting_count += store_->term_document_counts.at(term.term);
+    }
+    // The filter selects at most its smaller side. Every candidate costs at most a galloping step per posting list,
+    // so with as many candidates as postings the postings are better scanned.
+    std::vector<Document> matched_documents;
+    if (std::min(store_->attribute_index.CountByStatus(filter), store_->attribute_index.CountByRating(filter)) < posting_count) {
+        matched_documents = FindFilteredDocuments(query, store_->attribute_index.Select(filter));
+    } else {
+        matched_documents = IsImpactOrderedQuery(query) ? FindImpactOrderedDocuments(query, filter, CancellationToken{})
+                                                        : FindAllDocuments(query, filter, CancellationToken{});
+    }
+    SelectTopDocuments(matched_documents);
+    return matched_documents;
 }
 
 std::vector<Document> SearchServer::FindTopDocuments(const std::string& raw_query, DocumentStatus status) const {
-    return FindTopDocuments(raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
+    return FindTopDocuments(raw_query, [status](int, DocumentStatus document_status, int) {
         return document_status == status;
     });
 }
@@ -77,81 +237,193 @@ std::vector<Document> SearchServer::FindTopDocuments(const std::string& raw_quer
     return FindTopDocuments(raw_query, DocumentStatus::ACTUAL);
 }
 
+SearchResult SearchServer::FindTopDocuments(const std::string& raw_query, DocumentStatus status, const SearchBudget& budget) const {
+    return FindTopDocuments(raw_query, [status](int, DocumentStatus document_status, int) {
+        return document_status == status;
+    }, budget);
+}
+
+SearchResult SearchServer::FindTopDocuments(const std::string& raw_query, const SearchBudget& budget) const {
+    return FindTopDocuments(raw_query, DocumentStatus::ACTUAL, budget);
+}
+
+std::future<std::vector<Document>> SearchServer::FindTopDocumentsAsync(std::string raw_query, DocumentStatus status,
+                                                                      CancellationToken token) const {
+    return FindTopDocumentsAsync(std::move(raw_query), [status](int, DocumentStatus document_status, int) {
+        return document_status == status;
+    }, std::move(token));
+}
+
+std::future<std::vector<Document>> SearchServer::FindTopDocumentsAsync(std::string raw_query) const {
+    return FindTopDocumentsAsync(std::move(raw_query), DocumentStatus::ACTUAL);
+}
+
 unsigned int SearchServer::GetDocumentCount() const {
-    return documents_.size();
+    return store_->documents.size();
 }
 
 std::tuple<std::vector<std::string>, DocumentStatus> SearchServer::MatchDocument(const std::string& raw_query, int document_id) const {
-    LOG_DURATION_STREAM("", std::cout);
-    
-    if(!IsQueryCorrect(raw_query)){
-        throw std::invalid_argument("'raw_query' has one of the following errors:"
-                               "1.Search words contain invalid characters with codes from 0 to 31"
-                               "2.More than one minus sign in front of words"
-                               "3.No text after the 'minus' character");
+    LOG_DURATION_STREAM("", duration_log_);
+
+    const auto [words, status] = MatchTermsInDocument(ResolveMatchTerms(ParseQuery(raw_query)), document_id);
+    return {std::vector<std::string>(words.begin(), words.end()), status};
+}
+
+std::vector<MatchedDocument> SearchServer::MatchDocuments(const std::string& raw_query, const std::vector<int>& document_ids) const {
+    return MatchDocuments(std::execution::seq, raw_query, document_ids);
+}
+
+std::vector<MatchedDocument> SearchServer::MatchDocuments(const std::execution::sequenced_policy&, const std::string& raw_query,
+                                                          const std::vector<int>& document_ids) const {
+    const MatchTerms terms = ResolveMatchTerms(ParseQuery(raw_query));
+    std::vector<MatchedDocument> result;
+    result.reserve(document_ids.size());
+    for (const int document_id : document_ids) {
+        result.push_back(MatchTermsInDocument(terms, document_id));
     }
+    return result;
+}
 
-    const Query query = ParseQuery(raw_query);
-    std::vector<std::string> matched_words;
-    for (const std::string& word : query.plus_words) {
-        if (word_to_id_freqs_.count(word) == 0) {
-            continue;
-        }
-        if (word_to_id_freqs_.at(word).count(document_id)) {
-            matched_words.push_back(word);
+std::vector<MatchedDocument> SearchServer::MatchDocuments(const std::execution::parallel_policy&, const std::string& raw_query,
+                                                          const std::vector<int>& document_ids) const {
+    const MatchTerms terms = ResolveMatchTerms(ParseQuery(raw_query));
+    std::vector<MatchedDocument> result(document_ids.size());
+    ThreadPool::GetShared().ParallelFor(document_ids.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            result[i] = MatchTermsInDocument(terms, document_ids[i]);
         }
+    });
+    return result;
+}
+
+/// Finding frequences for word with document_id in store_->forward_index
+/// @param <document_id> ID of the document for which you want to find frequencies
+/// @return view of (word, frequency) pairs if success, empty view otherwise
+WordFrequencies SearchServer::GetWordFrequencies(int document_id) const {
+    return WordFrequencies(store_->forward_index.GetTermFrequencies(document_id), term_dictionary_.get());
+}
+
+void SearchServer::SaveSnapshot(std::ostream& output) const {
+    output.write(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    WriteValue(output, static_cast<uint32_t>(stop_words_->size()));
+    for (const std::string_view word : stop_words_->GetWords()) {
+        WriteString(output, word);
     }
-    for (const std::string& word : query.minus_words) {
-        if (word_to_id_freqs_.count(word) == 0) {
-            continue;
-        }
-        if (word_to_id_freqs_.at(word).count(document_id)) {
-            matched_words.clear();
-            break;
+    // Documents go in insertion order, so begin()/end() iterate the same way after loading
+    WriteValue(output, static_cast<uint32_t>(store_->ids.size()));
+    for (const int document_id : store_->ids) {
+        const DocumentData& data = store_->documents.at(document_id);
+        WriteValue(output, static_cast<int32_t>(document_id));
+        WriteValue(output, static_cast<int32_t>(data.status));
+        WriteValue(output, static_cast<int32_t>(data.rating));
+        const WordFrequencies word_freqs = GetWordFrequencies(document_id);
+        WriteValue(output, static_cast<uint32_t>(word_freqs.size()));
+        for (const auto& [word, freq] : word_freqs) {
+            WriteString(output, word);
+            WriteValue(output, freq);
         }
     }
-
-    std::tuple<std::vector<std::string>, DocumentStatus> result = {matched_words, documents_.at(document_id).status};
-    return result;
+    if (!output) {
+        throw std::runtime_error("Failed to write snapshot");
+    }
 }
 
-/// Finding frequences for word with document_id in id_to_document_freqs_
-/// @param <document_id> ID of the document for which you want to find frequencies
-/// @return map<word, frequences> if success, empty map (get_word_frequencies_null) otherwise
-static std::map<std::string, double> get_word_frequencies_null;
-const std::map<std::string, double>& SearchServer::GetWordFrequencies(int document_id) const{
-    
-    if (id_to_word_freqs_.count(document_id)) {
-        return id_to_word_freqs_.at(document_id);
+void SearchServer::LoadSnapshot(std::istream& input) {
+    if (!store_->documents.empty()) {
+        throw std::invalid_argument("Snapshot can only be loaded into an empty server");
+    }
+    char magic[sizeof(SNAPSHOT_MAGIC)];
+    if (!input.read(magic, sizeof(magic)) || !std::equal(magic, magic + sizeof(magic), SNAPSHOT_MAGIC)) {
+        throw std::invalid_argument("Not a search server snapshot");
+    }
+    std::vector<std::string> stop_words(ReadValue<uint32_t>(input));
+    for (std::string& word : stop_words) {
+        word = ReadString(input);
     }
-    else {
-        return get_word_frequencies_null;
+    AddStopWords(std::vector<std::string_view>(stop_words.begin(), stop_words.end()));
+    for (uint32_t count = ReadValue<uint32_t>(input); count > 0; --count) {
+        const int document_id = ReadValue<int32_t>(input);
+        const auto status = static_cast<DocumentStatus>(ReadValue<int32_t>(input));
+        const int rating = ReadValue<int32_t>(input);
+        std::vector<std::string> words(ReadValue<uint32_t>(input));
+        TokenizedDocument word_freqs;
+        word_freqs.reserve(words.size());
+        for (std::string& word : words) {
+            word = ReadString(input);
+            word_freqs.emplace_back(word, ReadValue<double>(input));
+        }
+        // The average of a single rating is the rating itself
+        AddTokenizedDocument(document_id, word_freqs, status, {rating});
     }
 }
 
-std::vector<int>::const_iterator SearchServer::begin() const{
-    return ids_.begin();
+MemoryStats SearchServer::GetMemoryStats() const {
+    const auto get_structure_stats = [](const TrackingMemoryResource& resource) {
+        return StructureMemoryStats{resource.GetBytes(), resource.GetAllocationCount()};
+    };
+    MemoryStats stats;
+    stats.stop_words = get_structure_stats(memory_->stop_words);
+    stats.term_dictionary = get_structure_stats(memory_->term_dictionary);
+    stats.term_dictionary.bytes += store_->term_counts_memory.GetBytes();
+    stats.term_dictionary.allocations += store_->term_counts_memory.GetAllocationCount();
+    stats.inverted_index = get_structure_stats(memory_->inverted_index);
+    stats.forward_index = get_structure_stats(store_->forward_index_memory);
+    stats.documents = get_structure_stats(store_->documents_memory);
+    stats.document_ids = get_structure_stats(store_->document_ids_memory);
+    stats.attributes = get_structure_stats(store_->attributes_memory);
+    stats.arena_blocks = arena_ ? arena_->GetUpstreamBlockCount() : 0;
+    stats.distinct_terms = store_->term_document_counts.size();
+    stats.total_postings = index_->GetPostingCount();
+    return stats;
 }
 
-std::vector<int>::const_iterator SearchServer::end() const{
-    return ids_.end();
+size_t SearchServer::GetSegmentCount() const {
+    return index_->GetSegmentCount();
 }
 
-bool SearchServer::IsStopWord(const std::string& word) const {
-    return stop_words_.count(word) > 0;
+void SearchServer::WaitForMerges() {
+    index_->WaitForMerges();
 }
 
-std::vector<std::string> SearchServer::SplitIntoWordsNoStop(const std::string& text) const {
-    std::vector<std::string> words;
-    for (const std::string& word : SplitIntoWords(text)) {
-        if (!IsStopWord(word)) {
-            words.push_back(word);
-        }
+std::pmr::vector<int>::const_iterator SearchServer::begin() const{
+    return store_->ids.begin();
+}
+
+std::pmr::vector<int>::const_iterator SearchServer::end() const{
+    return store_->ids.end();
+}
+
+std::unique_ptr<SearchServer::DocumentStore, SearchServer::DocumentStoreDeleter> SearchServer::MakeDocumentStore() const {
+    if (!arena_) {
+        return {new DocumentStore(std::pmr::new_delete_resource()), DocumentStoreDeleter{false}};
     }
+    void* const memory = arena_->allocate(sizeof(DocumentStore), alignof(DocumentStore));
+    return {new (memory) DocumentStore(arena_.get()), DocumentStoreDeleter{true}};
+}
+
+bool SearchServer::IsStopWord(std::string_view word) const {
+    return stop_words_->Contains(word);
+}
+
+void SearchServer::AddStopWords(const std::vector<std::string_view>& words) {
+    std::vector<std::string_view> all_words = stop_words_->GetWords();
+    all_words.insert(all_words.end(), words.begin(), words.end());
+    // A new set rather than a changed one, other servers may share the current set
+    stop_words_ = MakeOwned<const PerfectHashSet>(all_words, &memory_->stop_words);
+}
+
+std::vector<std::string_view> SearchServer::SplitIntoWordsNoStop(std::string_view text) const {
+    std::vector<std::string_view> words;
+    if(!SplitIntoWordsChecked(text, words)){
+        throw std::invalid_argument("Words in the 'document' must not contain invalid characters with codes from 0 to 31");
+    }
+    words.erase(std::remove_if(words.begin(), words.end(), [this](std::string_view word) {
+        return IsStopWord(word);
+    }), words.end());
     return words;
 }
 
-bool SearchServer::IsWordsHaveSpecialSymbols(const std::set<std::string>& words){
+bool SearchServer::IsWordsHaveSpecialSymbols(const std::set<std::string, std::less<>>& words){
     for(const std::string& word : words){
         if(!IsValidWord(word)){
             return true;
@@ -161,33 +433,30 @@ bool SearchServer::IsWordsHaveSpecialSymbols(const std::set<std::string>& words)
     return false;
 }
 
-bool SearchServer::IsQueryCorrect(const std::string& query_words){
-    for(const std::string& word : SplitIntoWords(query_words)){
-        if(!IsQueryWordCorrect(word)){
-            return false;
-        }
+bool SearchServer::IsQueryWordCorrect(std::string_view word){
+    if (word[0] == '+') {
+        // Only a plain word can be required
+        return word.size() > 1 && word[1] != '+' && word[1] != '-' && word.back() != '*';
     }
-    return true;
-}
-
-bool SearchServer::IsQueryWordCorrect(const std::string& word){
-    if((word.size() == 1 && word[0] == '-')
-       || (word[0] == '-' && word[1] == '-')
-       || !IsValidWord(word)){
+    if((word.size() == 1 && (word[0] == '-' || word[0] == '*'))
+       || (word[0] == '-' && (word[1] == '-' || word[1] == '+' || word == "-*"))){
         return false;
     }
 
     return true;
 }
 
-bool SearchServer::IsValidWord(const std::string& word) {
+bool SearchServer::IsValidWord(std::string_view word) {
     // A valid word must not contain special characters
-    return none_of(word.begin(), word.end(), [](char c) {
+    return std::none_of(word.begin(), word.end(), [](char c) {
         return c >= '\0' && c < ' ';
     });
 }
 
 int SearchServer::ComputeAverageRating(const std::vector<int>& ratings) {
+    if (ratings.empty()) {
+        return 0;
+    }
     int rating_sum = 0;
     for (const int rating : ratings) {
         rating_sum += rating;
@@ -195,36 +464,495 @@ int SearchServer::ComputeAverageRating(const std::vector<int>& ratings) {
     return rating_sum / static_cast<int>(ratings.size());
 }
 
-SearchServer::QueryWord SearchServer::ParseQueryWord(std::string text) const {
+bool SearchServer::IsBetterResult(const Document& lhs, const Document& rhs) {
+    if (std::abs(lhs.relevance - rhs.relevance) >= RELEVANCE_EPSILON) {
+        return lhs.relevance > rhs.relevance;
+    }
+    if (lhs.rating != rhs.rating) {
+        return lhs.rating > rhs.rating;
+    }
+    return lhs.id < rhs.id;
+}
+
+void SearchServer::SelectTopDocuments(std::vector<Document>& documents) {
+    sort(documents.begin(), documents.end(), IsBetterResult);
+    if (documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
+        documents.resize(MAX_RESULT_DOCUMENT_COUNT);
+    }
+}
+
+SearchServer::QueryWord SearchServer::ParseQueryWord(std::string_view text) const {
     bool is_minus = false;
+    bool is_required = false;
+    bool is_prefix = false;
     // Word shouldn't be empty
     if (text[0] == '-') {
         is_minus = true;
-        text = text.substr(1);
+        text.remove_prefix(1);
+    } else if (text[0] == '+') {
+        is_required = true;
+        text.remove_prefix(1);
+    }
+    if (text.back() == '*') {
+        is_prefix = true;
+        text.remove_suffix(1);
     }
     return {
             text,
             is_minus,
-            IsStopWord(text)
+            is_required,
+            !is_prefix && IsStopWord(text),
+            is_prefix
     };
 }
 
-SearchServer::Query SearchServer::ParseQuery(const std::string& text) const {
+SearchServer::Query SearchServer::ParseQuery(std::string_view text) const {
+    std::vector<std::string_view> words;
+    bool is_correct = SplitIntoWordsChecked(text, words);
+    for (size_t i = 0; is_correct && i < words.size(); ++i) {
+        is_correct = IsQueryWordCorrect(words[i]);
+    }
+    if(!is_correct){
+        throw std::invalid_argument("'raw_query' has one of the following errors:"
+                               "1.Search words contain invalid characters with codes from 0 to 31"
+                               "2.More than one minus sign in front of words"
+                               "3.No text after the 'minus' character"
+                               "4.No text before the wildcard '*' character"
+                               "5.No plain word after the 'plus' character");
+    }
+
     Query query;
-    for (const std::string& word : SplitIntoWords(text)) {
+    for (const std::string_view word : words) {
         const QueryWord query_word = ParseQueryWord(word);
-        if (!query_word.is_stop) {
+        if (query_word.is_prefix) {
+            if (query_word.is_minus) {
+                query.minus_prefixes.insert(query_word.data);
+            } else {
+                query.plus_prefixes.insert(query_word.data);
+            }
+        } else if (!query_word.is_stop) {
             if (query_word.is_minus) {
                 query.minus_words.insert(query_word.data);
             } else {
                 query.plus_words.insert(query_word.data);
+                if (query_word.is_required) {
+                    query.required_words.insert(query_word.data);
+                }
             }
         }
     }
     return query;
 }
 
+std::optional<TermId> SearchServer::FindLiveTerm(std::string_view word) const {
+    const std::optional<TermId> term = term_dictionary_->Find(word);
+    if (!term || !store_->term_document_counts.count(*term)) {
+        return std::nullopt;
+    }
+    return term;
+}
+
 // Existence required
-double SearchServer::ComputeWordInverseDocumentFreq(const std::string& word) const {
-    return log(GetDocumentCount() * 1.0 / word_to_id_freqs_.at(word).size());
-}
\ No newline at end of file
+double SearchServer::ComputeWordInverseDocumentFreq(TermId term) const {
+    return log(GetDocumentCount() * 1.0 / store_->term_document_counts.at(term));
+}
+
+void SearchServer::RebuildSortedTerms() {
+    std::vector<std::string_view> terms;
+    terms.reserve(store_->term_document_counts.size());
+    for (const auto& [term, _] : store_->term_document_counts) {
+        terms.push_back(term_dictionary_->GetWord(term));
+    }
+    std::sort(terms.begin(), terms.end());
+    sorted_terms_ = FrontCodedDictionary(terms, &memory_->term_dictionary);
+    recent_terms_.clear();
+}
+
+std::vector<SearchServer::ExpandedTerm> SearchServer::ExpandPrefix(std::string_view prefix, size_t max_count) const {
+    // Terms may have lost all their documents since the dictionary was built, those are skipped
+    const auto find_live_term = [this](std::string_view word) -> std::optional<ExpandedTerm> {
+        const std::optional<TermId> term = FindLiveTerm(word);
+        if (!term) {
+            return std::nullopt;
+        }
+        return ExpandedTerm{term_dictionary_->GetWord(*term), *term};
+    };
+
+    std::vector<ExpandedTerm> sealed_terms;
+    sorted_terms_.ForEachWithPrefix(prefix, [&](std::string_view word) {
+        if (const auto term = find_live_term(word)) {
+            sealed_terms.push_back(*term);
+        }
+        return sealed_terms.size() < max_count;
+    });
+
+    std::vector<ExpandedTerm> recent_terms;
+    for (auto it = recent_terms_.lower_bound(prefix);
+         it != recent_terms_.end() && it->substr(0, prefix.size()) == prefix
+         && recent_terms.size() < max_count; ++it) {
+        if (const auto term = find_live_term(*it)) {
+            recent_terms.push_back(*term);
+        }
+    }
+
+    std::vector<ExpandedTerm> terms;
+    const auto by_word = [](const ExpandedTerm& lhs, const ExpandedTerm& rhs) {
+        return lhs.word < rhs.word;
+    };
+    std::set_union(sealed_terms.begin(), sealed_terms.end(), recent_terms.begin(), recent_terms.end(),
+                   std::back_inserter(terms), by_word);
+    if (terms.size() > max_count) {
+        terms.resize(max_count);
+    }
+    return terms;
+}
+
+std::vector<SearchServer::ExpandedTerm> SearchServer::ExpandPlusPrefixes(const Query& query) const {
+    std::vector<ExpandedTerm> terms;
+    for (const std::string_view prefix : query.plus_prefixes) {
+        for (const ExpandedTerm& term : ExpandPrefix(prefix, MAX_PREFIX_EXPANSION_COUNT)) {
+            if (!query.plus_words.count(term.word)) {
+                terms.push_back(term);
+            }
+        }
+    }
+    // Prefixes like 'pe*' and 'pet*' overlap, every term counts once
+    std::sort(terms.begin(), terms.end(), [](const ExpandedTerm& lhs, const ExpandedTerm& rhs) {
+        return lhs.word < rhs.word;
+    });
+    terms.erase(std::unique(terms.begin(), terms.end(), [](const ExpandedTerm& lhs, const ExpandedTerm& rhs) {
+        return lhs.term == rhs.term;
+    }), terms.end());
+    return terms;
+}
+
+SearchServer::MatchTerms SearchServer::ResolveMatchTerms(const Query& query) const {
+    MatchTerms terms;
+    for (const std::string_view word : query.plus_words) {
+        if (const std::optional<TermId> term = FindLiveTerm(word)) {
+            terms.plus_terms.push_back({term_dictionary_->GetWord(*term), *term});
+        }
+    }
+    const std::vector<ExpandedTerm> prefix_terms = ExpandPlusPrefixes(query);
+    terms.plus_terms.insert(terms.plus_terms.end(), prefix_terms.begin(), prefix_terms.end());
+    for (const std::string_view word : query.required_words) {
+        if (const std::optional<TermId> term = FindLiveTerm(word)) {
+            terms.required_terms.push_back(*term);
+        } else {
+            terms.is_unsatisfiable = true;
+        }
+    }
+    for (const ExpandedTerm& term : CollectMinusTerms(query)) {
+        terms.minus_terms.push_back(term.term);
+    }
+    return terms;
+}
+
+std::vector<Document> SearchServer::FindFilteredDocuments(const Query& query, const DocumentBitmap& candidates) const {
+    const MatchTerms terms = ResolveMatchTerms(query);
+    if (terms.is_unsatisfiable || candidates.empty()) {
+        return {};
+    }
+    std::vector<std::pair<TermId, double>> term_idfs;
+    for (const ExpandedTerm& term : terms.plus_terms) {
+        term_idfs.emplace_back(term.term, ComputeWordInverseDocumentFreq(term.term));
+    }
+    if (candidates.size() <= MAX_FORWARD_SCORED_CANDIDATES) {
+        return ScoreFromForwardIndex(terms, term_idfs, candidates);
+    }
+
+    // The candidates as one more posting list, sorted by document id like the others
+    std::vector<Posting> candidate_postings;
+    candidate_postings.reserve(candidates.size());
+    candidates.ForEach([&candidate_postings](int document_id) {
+        candidate_postings.push_back({document_id, 0});
+    });
+    const SegmentedIndex::Reader reader = index_->Read();
+    // Calls 'func(candidate_index, posting)' for the live postings of 'term' belonging to candidates. The shorter
+    // of a posting list and the candidates drives the intersection, the other one is galloped through.
+    const auto for_each_candidate_posting = [&reader, &candidate_postings](TermId term, auto func) {
+        const PostingRange candidate_range(candidate_postings.data(), candidate_postings.data() + candidate_postings.size());
+        reader.ForEachPostingList(term, [&](PostingRange postings, const DeletedDocuments& deleted) {
+            IntersectPostings({candidate_range, postings}, [&](const std::vector<const Posting*>& matched) {
+                if (deleted.empty() || !deleted.count(matched[1]->document_id)) {
+                    func(static_cast<size_t>(matched[0] - candidate_postings.data()), *matched[1]);
+                }
+            });
+        });
+    };
+
+    for (const TermId term : terms.required_terms) {
+        std::vector<Posting> narrowed;
+        for_each_candidate_posting(term, [&](size_t candidate_index, const Posting&) {
+            narrowed.push_back(candidate_postings[candidate_index]);
+        });
+        // Each segment yields its matches in order, the segments don't follow each other by document id
+        std::sort(narrowed.begin(), narrowed.end(), [](const Posting& lhs, const Posting& rhs) {
+            return lhs.document_id < rhs.document_id;
+        });
+        candidate_postings.swap(narrowed);
+    }
+
+    std::vector<double> relevances(candidate_postings.size());
+    std::vector<bool> is_matched(candidate_postings.size());
+    for (const auto& [term, inverse_document_freq] : term_idfs) {
+        for_each_candidate_posting(term, [&, inverse_document_freq = inverse_document_freq](size_t candidate_index, const Posting& posting) {
+            relevances[candidate_index] += posting.term_freq * inverse_document_freq;
+            is_matched[candidate_index] = true;
+        });
+    }
+    for (const TermId term : terms.minus_terms) {
+        for_each_candidate_posting(term, [&is_matched](size_t candidate_index, const Posting&) {
+            is_matched[candidate_index] = false;
+        });
+    }
+
+    std::vector<Document> matched_documents;
+    for (size_t i = 0; i < candidate_postings.size(); ++i) {
+        if (is_matched[i]) {
+            const int document_id = candidate_postings[i].document_id;
+            matched_documents.push_back({document_id, relevances[i], store_->documents.at(document_id).rating});
+        }
+    }
+    return matched_documents;
+}
+
+std::vector<Document> SearchServer::ScoreFromForwardIndex(const MatchTerms& terms, const std::vector<std::pair<TermId, double>>& term_idfs,
+                                                          const DocumentBitmap& candidates) const {
+    std::vector<Document> matched_documents;
+    candidates.ForEach([&](int document_id) {
+        const auto [begin, end] = store_->forward_index.GetTermFrequencies(document_id);
+        const auto find_term = [begin = begin, end = end](TermId term) -> const TermFrequency* {
+            const TermFrequency* entry = std::lower_bound(begin, end, term, [](const TermFrequency& entry, TermId term) {
+                return entry.term < term;
+            });
+            return entry != end && entry->term == term ? entry : nullptr;
+        };
+        if (!std::all_of(terms.required_terms.begin(), terms.required_terms.end(), find_term)
+            || std::any_of(terms.minus_terms.begin(), terms.minus_terms.end(), find_term)) {
+            return;
+        }
+        double relevance = 0;
+        bool has_plus_term = false;
+        for (const auto& [term, inverse_document_freq] : term_idfs) {
+            if (const TermFrequency* entry = find_term(term)) {
+                relevance += entry->term_freq * inverse_document_freq;
+                has_plus_term = true;
+            }
+        }
+        if (has_plus_term) {
+            matched_documents.push_back({document_id, relevance, store_->documents.at(document_id).rating});
+        }
+    });
+    return matched_documents;
+}
+
+bool SearchServer::IsImpactOrderedQuery(const Query& query) const {
+    return index_->GetOptions().impact_ordered_postings && query.required_words.empty() && query.plus_prefixes.empty()
+           && !query.plus_words.empty() && query.plus_words.size() <= MAX_IMPACT_ORDERED_WORDS;
+}
+
+double SearchServer::ComputeRelevance(const std::vector<std::pair<TermId, double>>& term_idfs, int document_id) const {
+    double relevance = 0;
+    for (const auto& [term, inverse_document_freq] : term_idfs) {
+        if (const std::optional<double> term_freq = store_->forward_index.FindTermFrequency(document_id, term)) {
+            relevance += *term_freq * inverse_document_freq;
+        }
+    }
+    return relevance;
+}
+
+MatchedDocument SearchServer::MatchTermsInDocument(const MatchTerms& terms, int document_id) const {
+    const DocumentStatus status = store_->documents.at(document_id).status;
+    const auto contains = [this, document_id](TermId term) {
+        return store_->forward_index.HasTerm(document_id, term);
+    };
+    if (terms.is_unsatisfiable || !std::all_of(terms.required_terms.begin(), terms.required_terms.end(), contains)
+        || std::any_of(terms.minus_terms.begin(), terms.minus_terms.end(), contains)) {
+        return {std::vector<std::string_view>{}, status};
+    }
+    std::vector<std::string_view> matched_words;
+    for (const ExpandedTerm& term : terms.plus_terms) {
+        if (contains(term.term)) {
+            matched_words.push_back(term.word);
+        }
+    }
+    return {std::move(matched_words), status};
+}
+
+std::vector<std::pair<int, double>> SearchServer::FindRequiredRelevance(const SegmentedIndex::Reader& reader, const Query& query,
+                                                                        BudgetTracker& budget) const {
+    // Plus-words with live terms in query order, the required ones first
+    std::vector<TermId> terms;
+    std::vector<size_t> plus_word_terms;
+    for (const std::string_view word : query.required_words) {
+        const std::optional<TermId> term = FindLiveTerm(word);
+        if (!term) {
+            return {};
+        }
+        terms.push_back(*term);
+    }
+    const size_t required_count = terms.size();
+    for (const std::string_view word : query.plus_words) {
+        const std::optional<TermId> term = FindLiveTerm(word);
+        if (!term) {
+            continue;
+        }
+        if (query.required_words.count(word)) {
+            plus_word_terms.push_back(std::distance(query.required_words.begin(), query.required_words.find(word)));
+        } else {
+            plus_word_terms.push_back(terms.size());
+            terms.push_back(*term);
+        }
+    }
+    std::vector<double> inverse_document_freqs(terms.size());
+    for (size_t i = 0; i < terms.size(); ++i) {
+        inverse_document_freqs[i] = ComputeWordInverseDocumentFreq(terms[i]);
+    }
+    const std::vector<ExpandedTerm> minus_terms = CollectMinusTerms(query);
+
+    std::vector<std::pair<int, double>> document_relevance;
+    std::vector<const Posting*> optional_postings(terms.size() - required_count);
+    reader.ForEachSegmentPostings(terms, [&](const std::vector<PostingRange>& postings, const DeletedDocuments& deleted) {
+        if (budget.IsExhausted()) {
+            return;
+        }
+        const std::vector<PostingRange> required_postings(postings.begin(), postings.begin() + required_count);
+        for (size_t i = 0; i < optional_postings.size(); ++i) {
+            optional_postings[i] = postings[required_count + i].begin();
+        }
+        IntersectPostings(required_postings, [&](const std::vector<const Posting*>& matched) {
+            const int document_id = matched[0]->document_id;
+            if (deleted.count(document_id) || !budget.Spend(optional_postings.size())) {
+                return;
+            }
+            // Summed in the same order as FindAllDocuments does for the union, so relevance is identical
+            double relevance = 0;
+            for (const size_t term_index : plus_word_terms) {
+                if (term_index < required_count) {
+                    relevance += matched[term_index]->term_freq * inverse_document_freqs[term_index];
+                    continue;
+                }
+                const Posting*& posting = optional_postings[term_index - required_count];
+                posting = GallopTo(posting, postings[term_index].end(), document_id);
+                if (posting != postings[term_index].end() && posting->document_id == document_id) {
+                    relevance += posting->term_freq * inverse_document_freqs[term_index];
+                }
+            }
+            document_relevance.emplace_back(document_id, relevance);
+        }, [&budget, required_count] {
+            return budget.Spend(required_count);
+        });
+    });
+    std::sort(document_relevance.begin(), document_relevance.end());
+
+    if (!query.plus_prefixes.empty() && budget.HasTimeLeft()) {
+        const std::vector<std::pair<int, double>> prefix_relevance = FindPrefixRelevance(reader, ExpandPlusPrefixes(query), budget);
+        for (auto& [document_id, relevance] : document_relevance) {
+            const auto it = std::lower_bound(prefix_relevance.begin(), prefix_relevance.end(), document_id,
+                                             [](const std::pair<int, double>& lhs, int rhs) {
+                return lhs.first < rhs;
+            });
+            if (it != prefix_relevance.end() && it->first == document_id) {
+                relevance += it->second;
+            }
+        }
+    }
+
+    document_relevance.erase(std::remove_if(document_relevance.begin(), document_relevance.end(), [&](const std::pair<int, double>& document) {
+        return std::any_of(minus_terms.begin(), minus_terms.end(), [&reader, &document](const ExpandedTerm& term) {
+            return reader.HasPosting(term.term, document.first);
+        });
+    }), document_relevance.end());
+    return document_relevance;
+}
+
+std::vector<std::pair<int, double>> SearchServer::FindPrefixRelevance(const SegmentedIndex::Reader& reader,
+                                                                      const std::vector<ExpandedTerm>& terms,
+                                                                      BudgetTracker& budget) const {
+    struct Cursor {
+        const Posting* current;
+        const Posting* end;
+        const DeletedDocuments* deleted;
+        double inverse_document_freq;
+
+        bool SkipDeleted() {
+            while (current != end && deleted->count(current->document_id)) {
+                ++current;
+            }
+            return current != end;
+        }
+    };
+    // One cursor per term and segment, postings are sorted by document_id within a segment
+    std::vector<Cursor> cursors;
+    for (const ExpandedTerm& term : terms) {
+        const double inverse_document_freq = ComputeWordInverseDocumentFreq(term.term);
+        reader.ForEachPostingList(term.term, [&](PostingRange postings, const DeletedDocuments& deleted) {
+            cursors.push_back({postings.begin(), postings.end(), &deleted, inverse_document_freq});
+        });
+    }
+
+    // k-way merge of the posting lists by document_id
+    const auto greater_document_id = [&cursors](size_t lhs, size_t rhs) {
+        return cursors[lhs].current->document_id > cursors[rhs].current->document_id;
+    };
+    std::priority_queue<size_t, std::vector<size_t>, decltype(greater_document_id)> heap(greater_document_id);
+    for (size_t i = 0; i < cursors.size(); ++i) {
+        if (cursors[i].SkipDeleted()) {
+            heap.push(i);
+        }
+    }
+
+    std::vector<std::pair<int, double>> document_relevance;
+    while (!heap.empty() && budget.Spend(1)) {
+        const size_t top = heap.top();
+        heap.pop();
+        Cursor& cursor = cursors[top];
+        const auto [document_id, term_freq] = *cursor.current;
+        if (document_relevance.empty() || document_relevance.back().first != document_id) {
+            document_relevance.emplace_back(document_id, 0.0);
+        }
+        document_relevance.back().second += term_freq * cursor.inverse_document_freq;
+        ++cursor.current;
+        if (cursor.SkipDeleted()) {
+            heap.push(top);
+        }
+    }
+    return document_relevance;
+}
+
+std::vector<SearchServer::ExpandedTerm> SearchServer::CollectPlusTermsByIdf(const Query& query) const {
+    std::vector<ExpandedTerm> terms;
+    for (const std::string_view word : query.plus_words) {
+        if (const std::optional<TermId> term = FindLiveTerm(word)) {
+            terms.push_back({term_dictionary_->GetWord(*term), *term});
+        }
+    }
+    const std::vector<ExpandedTerm> prefix_terms = ExpandPlusPrefixes(query);
+    terms.insert(terms.end(), prefix_terms.begin(), prefix_terms.end());
+    // IDF decreases with the number of documents containing the word
+    std::stable_sort(terms.begin(), terms.end(), [this](const ExpandedTerm& lhs, const ExpandedTerm& rhs) {
+        return store_->term_document_counts.at(lhs.term) < store_->term_document_counts.at(rhs.term);
+    });
+    return terms;
+}
+
+std::vector<SearchServer::ExpandedTerm> SearchServer::CollectMinusTerms(const Query& query) const {
+    std::vector<ExpandedTerm> terms;
+    for (const std::string_view word : query.minus_words) {
+        if (const std::optional<TermId> term = FindLiveTerm(word)) {
+            terms.push_back({term_dictionary_->GetWord(*term), *term});
+        }
+    }
+    for (const std::string_view prefix : query.minus_prefixes) {
+        const std::vector<ExpandedTerm> expanded = ExpandPrefix(prefix, std::numeric_limits<size_t>::max());
+        terms.insert(terms.end(), expanded.begin(), expanded.end());
+    }
+    std::sort(terms.begin(), terms.end(), [](const ExpandedTerm& lhs, const ExpandedTerm& rhs) {
+        return lhs.term < rhs.term;
+    });
+    terms.erase(std::unique(terms.begin(), terms.end(), [](const ExpandedTerm& lhs, const ExpandedTerm& rhs) {
+        return lhs.term == rhs.term;
+    }), terms.end());
+    return terms;
+}
@@ -2,78 +2,230 @@
 
 #include "document.h"
 #include "string_processing.h"
+#include "term_dictionary.h"
+#include "cancellation_token.h"
+#include "thread_pool.h"
+#include "segmented_index.h"
 #include "log_duration.h"
+#include "arena_resource.h"
+#include "memory_stats.h"
+#include "forward_index.h"
+#include "perfect_hash_set.h"
+#include "attribute_index.h"
 
 #include <algorithm>
+#include <chrono>
 #include <cmath>
+#include <execution>
+#include <future>
 #include <iostream>
+#include <limits>
 #include <map>
+#include <memory>
+#include <memory_resource>
+#include <unordered_map>
+#include <unordered_set>
+#include <optional>
+#include <queue>
 #include <set>
 #include <string>
+#include <string_view>
 #include <utility>
 #include <vector>
 #include <sstream>
 #include <cerrno>
 
 const int MAX_RESULT_DOCUMENT_COUNT = 5;
-
+// Relevances closer than this are equal and the rating decides
+const double RELEVANCE_EPSILON = 1e-6;
+// With IndexOptions::impact_ordered_postings, queries of at most this many plain plus-words are answered
+// from impact ordered postings
+const size_t MAX_IMPACT_ORDERED_WORDS = 2;
+
+// Words of the query found in a document and the document's status
+using MatchedDocument = std::tuple<std::vector<std::string_view>, DocumentStatus>;
+// Distinct words of a document with their term frequencies, the words point into the document text
+using TokenizedDocument = std::vector<std::pair<std::string_view, double>>;
+// How many dictionary terms a single 'prefix*' query word may expand to
+const size_t MAX_PREFIX_EXPANSION_COUNT = 64;
+// Filtered queries with at most this many candidate documents score them from the forward index
+// instead of galloping through the posting lists
+const size_t MAX_FORWARD_SCORED_CANDIDATES = 64;
+
+// Limits for a single query, whichever runs out first stops scoring
+struct SearchBudget {
+    std::chrono::steady_clock::duration time = std::chrono::steady_clock::duration::max();
+    size_t max_postings = std::numeric_limits<size_t>::max();
+};
+
+struct SearchResult {
+    std::vector<Document> documents;
+    // True if the budget ran out before all postings were scored
+    bool is_approximate = false;
+};
+
+// Stop words and term dictionary that any number of servers may share, see SearchServer::CreateVocabulary
+struct SharedVocabulary {
+    std::shared_ptr<const PerfectHashSet> stop_words;
+    std::shared_ptr<TermDictionary> terms;
+};
 
 class SearchServer {
 public:
-    explicit SearchServer() = default;
+    explicit SearchServer(const IndexOptions& options = {});
+
+    // Server using 'vocabulary' instead of a stop word set and dictionary of its own: the words of all servers
+    // sharing it are stored once and map to the same term ids, and creating such a server copies no words.
+    // Stop words added to one server later are copied into a set of its own and don't affect the others.
+    // Throws std::invalid_argument if a part of 'vocabulary' is missing
+    explicit SearchServer(SharedVocabulary vocabulary, const IndexOptions& options = {});
 
     template <typename StringContainer>
-    explicit SearchServer(const StringContainer& stop_words)
-            : stop_words_(MakeUniqueNonEmptyStrings(stop_words)) {
-        if(IsWordsHaveSpecialSymbols(stop_words_)){
+    explicit SearchServer(const StringContainer& stop_words, const IndexOptions& options = {})
+            : memory_(std::make_shared<MemoryResources>())
+            , index_(std::make_unique<SegmentedIndex>(options, &memory_->inverted_index))
+            , arena_(options.arena_allocation ? std::make_unique<ArenaResource>() : nullptr) {
+        const std::set<std::string, std::less<>> unique_stop_words = MakeUniqueNonEmptyStrings(stop_words);
+        if(IsWordsHaveSpecialSymbols(unique_stop_words)){
             throw std::invalid_argument("Stop words contain invalid characters with codes from 0 to 31");
         }
+        AddStopWords(std::vector<std::string_view>(unique_stop_words.begin(), unique_stop_words.end()));
     }
 
-    explicit SearchServer(const std::string& stop_words_text);
+    explicit SearchServer(const std::string& stop_words_text, const IndexOptions& options = {});
+
+    // Containers allocate from memory resources owned by the server: it can be moved into a new object,
+    // but not assigned over an existing one
+    SearchServer(SearchServer&&) = default;
+    SearchServer& operator=(SearchServer&&) = delete;
+
+    void AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+
+    // AddDocument split in two: the tokenizing half doesn't touch the index,
+    // so several documents can be tokenized in parallel and then added in order.
+    // The words point into 'document', which has to outlive AddTokenizedDocument.
+    [[nodiscard]] TokenizedDocument ComputeWordFrequencies(std::string_view document) const;
+    // 'word_freqs' holds distinct words in any order
+    void AddTokenizedDocument(int document_id, const TokenizedDocument& word_freqs, DocumentStatus status,
+                              const std::vector<int>& ratings);
 
-    void AddDocument(int document_id, const std::string& document, DocumentStatus status, const std::vector<int>& ratings);
     void RemoveDocument(int document_id);
+
+    // Removes all documents, the stop words, dictionary and options stay. With IndexOptions::arena_allocation
+    // the per-document structures go with the arena, at one free per chunk instead of one per node.
+    // Must not be called while searches run.
+    void Clear();
+
     void SetStopWords(const std::string& text);
+
+    // Stop words and dictionary of this server, for creating more servers that share them
+    [[nodiscard]] SharedVocabulary GetVocabulary() const;
+
+    // FindTopDocuments and MatchDocument log their duration to std::cout, 'output' replaces it and nullptr
+    // turns the log off. Must not be called while searches run.
+    void SetDurationLog(std::ostream* output);
+    [[nodiscard]] std::ostream* GetDurationLog() const;
+
+    // Vocabulary with the given stop words and no terms yet, allocated from 'resource'
+    // Throws std::invalid_argument if a stop word contains a character with code from 0 to 31
+    static SharedVocabulary CreateVocabulary(const std::string& stop_words_text,
+                                             std::pmr::memory_resource* resource = std::pmr::get_default_resource());
     template <typename DocumentPredicate>
     [[nodiscard]] std::vector<Document> FindTopDocuments(const std::string& raw_query, DocumentPredicate document_predicate) const {
-        LOG_DURATION_STREAM("", std::cout);
-        if(!IsQueryCorrect(raw_query)){
-            throw std::invalid_argument("'raw_query' has one of the following errors:"
-                                   "1.Search words contain invalid characters with codes from 0 to 31"
-                                   "2.More than one minus sign in front of words"
-                                   "3.No text after the 'minus' character");
-        }
+        return FindTopDocuments(raw_query, document_predicate, CancellationToken{});
+    }
 
+    // Throws OperationCancelled if 'token' is cancelled before scoring is finished
+    template <typename DocumentPredicate>
+    [[nodiscard]] std::vector<Document> FindTopDocuments(const std::string& raw_query, DocumentPredicate document_predicate,
+                                                         const CancellationToken& token) const {
+        LOG_DURATION_STREAM("", duration_log_);
         const Query query = ParseQuery(raw_query);
-        auto matched_documents = FindAllDocuments(query, document_predicate);
-
-        sort(matched_documents.begin(), matched_documents.end(), [](const Document& lhs, const Document& rhs) {
-            if (std::abs(lhs.relevance - rhs.relevance) < 1e-6) {
-                return lhs.rating > rhs.rating;
-            } else {
-                return lhs.relevance > rhs.relevance;
-            }
-        });
-        if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-            matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
-        }
-
+        auto matched_documents = IsImpactOrderedQuery(query)
+                ? FindImpactOrderedDocuments(query, document_predicate, token)
+                : FindAllDocuments(query, document_predicate, token);
+        SelectTopDocuments(matched_documents);
         return matched_documents;
     }
 
+    // Scores plus-words from the rarest (highest IDF) to the most frequent and stops when 'budget' runs out.
+    // Minus-words are always applied to the documents found.
+    template <typename DocumentPredicate>
+    [[nodiscard]] SearchResult FindTopDocuments(const std::string& raw_query, DocumentPredicate document_predicate,
+                                                const SearchBudget& budget) const {
+        LOG_DURATION_STREAM("", duration_log_);
+        const Query query = ParseQuery(raw_query);
+        SearchResult result;
+        result.documents = FindAllDocuments(query, document_predicate, budget, result.is_approximate);
+        SelectTopDocuments(result.documents);
+        return result;
+    }
+
+    [[nodiscard]] SearchResult FindTopDocuments(const std::string& raw_query, DocumentStatus status, const SearchBudget& budget) const;
+
+    [[nodiscard]] SearchResult FindTopDocuments(const std::string& raw_query, const SearchBudget& budget) const;
+
+    // A filter selecting fewer documents than the query words have postings is turned into a list of candidates,
+    // and the posting lists are galloped through from candidate to candidate. Otherwise it is checked against
+    // every posting like a predicate.
+    [[nodiscard]] std::vector<Document> FindTopDocuments(const std::string& raw_query, const DocumentFilter& filter) const;
+
     [[nodiscard]] std::vector<Document> FindTopDocuments(const std::string& raw_query, DocumentStatus status) const;
 
     [[nodiscard]] std::vector<Document> FindTopDocuments(const std::string& raw_query) const;
 
+    // Runs FindTopDocuments on the shared thread pool. The server must outlive the future
+    // and must not be modified until it is ready.
+    template <typename DocumentPredicate>
+    [[nodiscard]] std::future<std::vector<Document>> FindTopDocumentsAsync(std::string raw_query, DocumentPredicate document_predicate,
+                                                                           CancellationToken token = {}) const {
+        return ThreadPool::GetShared().Submit([this, raw_query = std::move(raw_query), document_predicate, token] {
+            token.ThrowIfCancelled();
+            return FindTopDocuments(raw_query, document_predicate, token);
+        });
+    }
+
+    [[nodiscard]] std::future<std::vector<Document>> FindTopDocumentsAsync(std::string raw_query, DocumentStatus status,
+                                                                           CancellationToken token = {}) const;
+
+    [[nodiscard]] std::future<std::vector<Document>> FindTopDocumentsAsync(std::string raw_query) const;
+
     [[nodiscard]] unsigned int GetDocumentCount() const;
 
     [[nodiscard]] std::tuple<std::vector<std::string>, DocumentStatus> MatchDocument(const std::string& raw_query, int document_id) const;
 
-    const std::map<std::string, double>& GetWordFrequencies(int document_id) const;
+    // MatchDocument for every id in 'document_ids', with the query parsed once. The words point into
+    // the server's dictionary and stay valid while the server lives. Throws std::out_of_range for unknown ids.
+    [[nodiscard]] std::vector<MatchedDocument> MatchDocuments(const std::string& raw_query, const std::vector<int>& document_ids) const;
+
+    [[nodiscard]] std::vector<MatchedDocument> MatchDocuments(const std::execution::sequenced_policy&, const std::string& raw_query,
+                                                              const std::vector<int>& document_ids) const;
+
+    // Splits the ids between the shared thread pool and the calling thread
+    [[nodiscard]] std::vector<MatchedDocument> MatchDocuments(const std::execution::parallel_policy&, const std::string& raw_query,
+                                                              const std::vector<int>& document_ids) const;
+
+    // Words of the document with their term frequencies, empty for an unknown id.
+    // The view is valid until the server is modified.
+    [[nodiscard]] WordFrequencies GetWordFrequencies(int document_id) const;
 
-    [[nodiscard]] std::vector<int>::const_iterator begin() const;
-    [[nodiscard]] std::vector<int>::const_iterator end() const;
+    // Memory currently allocated by each structure of the server, counted by its allocator
+    [[nodiscard]] MemoryStats GetMemoryStats() const;
+
+    // Binary dump of stop words and documents. Term frequencies are stored as is,
+    // so a loaded server ranks exactly like the saved one.
+    void SaveSnapshot(std::ostream& output) const;
+    // Throws std::invalid_argument if the server isn't empty or the snapshot is malformed
+    void LoadSnapshot(std::istream& input);
+
+    // Number of sealed index segments
+    [[nodiscard]] size_t GetSegmentCount() const;
+
+    // Blocks until the index has no pending segment merges
+    void WaitForMerges();
+
+    [[nodiscard]] std::pmr::vector<int>::const_iterator begin() const;
+    [[nodiscard]] std::pmr::vector<int>::const_iterator end() const;
 
 private:
     struct DocumentData {
@@ -81,73 +233,432 @@ private:
         DocumentStatus status;
     };
 
+    // Counts the postings a query visits against its SearchBudget and reads the clock once per
+    // POSTINGS_PER_CLOCK_CHECK of them. Once the budget has run out it stays out.
+    class BudgetTracker {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        explicit BudgetTracker(const SearchBudget& budget)
+                : max_postings_(budget.max_postings)
+                , deadline_(budget.time >= Clock::time_point::max() - Clock::now()
+                        ? Clock::time_point::max()
+                        : Clock::now() + budget.time) {
+        }
+
+        // Accounts for visiting 'postings' more postings, false if they don't fit into the budget
+        bool Spend(size_t postings) {
+            if (is_exhausted_ || max_postings_ - postings_ < postings
+                || (postings_ >= next_clock_check_ && IsPastDeadline())) {
+                is_exhausted_ = true;
+                return false;
+            }
+            if (postings_ >= next_clock_check_) {
+                next_clock_check_ = postings_ + POSTINGS_PER_CLOCK_CHECK;
+            }
+            postings_ += postings;
+            return true;
+        }
+
+        // Reads the clock right away, for the steps between posting lists
+        bool HasTimeLeft() {
+            if (!is_exhausted_ && IsPastDeadline()) {
+                is_exhausted_ = true;
+            }
+            return !is_exhausted_;
+        }
+
+        [[nodiscard]] bool IsExhausted() const {
+            return is_exhausted_;
+        }
+
+    private:
+        static const size_t POSTINGS_PER_CLOCK_CHECK = 256;
+
+        size_t max_postings_;
+        Clock::time_point deadline_;
+        size_t postings_ = 0;
+        size_t next_clock_check_ = 0;
+        bool is_exhausted_ = false;
+
+        [[nodiscard]] bool IsPastDeadline() const {
+            return deadline_ != Clock::time_point::max() && Clock::now() >= deadline_;
+        }
+    };
+
     struct QueryWord {
-        std::string data;
+        std::string_view data;
         bool is_minus;
+        bool is_required;
         bool is_stop;
+        bool is_prefix;
     };
 
+    // Words point into the raw query text, prefixes are stored without the trailing '*'
     struct Query {
-        std::set<std::string> plus_words;
-        std::set<std::string> minus_words;
+        std::set<std::string_view> plus_words;
+        // Plus-words written as '+word', a document has to contain all of them
+        std::set<std::string_view> required_words;
+        std::set<std::string_view> minus_words;
+        std::set<std::string_view> plus_prefixes;
+        std::set<std::string_view> minus_prefixes;
+    };
+
+    struct ExpandedTerm {
+        std::string_view word;
+        TermId term;
+    };
+
+    // Query resolved to term ids for matching against the forward index
+    struct MatchTerms {
+        // Words pointing into the dictionary, in the order MatchDocument reports them
+        std::vector<ExpandedTerm> plus_terms;
+        std::vector<TermId> required_terms;
+        // A required word that no document contains, nothing can match
+        bool is_unsatisfiable = false;
+        std::vector<TermId> minus_terms;
+    };
+
+    // One resource per structure, so GetMemoryStats can tell them apart
+    struct MemoryResources {
+        TrackingMemoryResource stop_words;
+        TrackingMemoryResource term_dictionary;
+        TrackingMemoryResource inverted_index;
+    };
+
+    // Everything kept per document, rebuilt from scratch by Clear
+    struct DocumentStore {
+        explicit DocumentStore(std::pmr::memory_resource* upstream);
+
+        TrackingMemoryResource term_counts_memory;
+        TrackingMemoryResource forward_index_memory;
+        TrackingMemoryResource documents_memory;
+        TrackingMemoryResource document_ids_memory;
+        TrackingMemoryResource attributes_memory;
+        // Number of live documents containing the term. Keyed by term id rather than indexed by it,
+        // as a shared dictionary holds the terms of other servers too.
+        std::pmr::unordered_map<TermId, size_t> term_document_counts{&term_counts_memory};
+        // Term ids and frequencies of every document, sorted by term id
+        ForwardIndex forward_index{&forward_index_memory};
+        std::pmr::map<int, DocumentData> documents{&documents_memory};
+        std::pmr::vector<int> ids{&document_ids_memory};
+        // Statuses and ratings as bitmaps for DocumentFilter
+        AttributeIndex attribute_index{&attributes_memory};
+    };
+
+    // Deletes a store on the heap. A store in the arena is abandoned without running its destructors,
+    // its memory is all in the arena and is freed by ArenaResource::Release.
+    struct DocumentStoreDeleter {
+        bool is_in_arena = false;
+
+        void operator()(DocumentStore* store) const;
     };
 
-    std::set<std::string> stop_words_;
-    std::map<std::string, std::map<int, double>> word_to_id_freqs_;
-    std::map<int, std::map<std::string, double>> id_to_word_freqs_;
-    std::map<int, DocumentData> documents_;
-    std::vector<int> ids_;
+    // Declared first: the containers below allocate from it. Shared, since a vocabulary handed out
+    // by GetVocabulary may outlive the server.
+    std::shared_ptr<MemoryResources> memory_;
+    // Replaced whenever stop words are added
+    std::shared_ptr<const PerfectHashSet> stop_words_ = MakeOwned<const PerfectHashSet>(&memory_->stop_words);
+    std::shared_ptr<TermDictionary> term_dictionary_ = MakeOwned<TermDictionary>(&memory_->term_dictionary);
+    // Sorted dictionary for prefix lookups plus the terms that appeared after it was built
+    FrontCodedDictionary sorted_terms_{&memory_->term_dictionary};
+    std::pmr::set<std::string_view> recent_terms_{&memory_->term_dictionary};
+    std::unique_ptr<SegmentedIndex> index_;
+    // Null unless IndexOptions::arena_allocation is set. Declared before the store, so the store is
+    // abandoned before the arena releases its memory.
+    std::unique_ptr<ArenaResource> arena_;
+    std::unique_ptr<DocumentStore, DocumentStoreDeleter> store_ = MakeDocumentStore();
+    std::ostream* duration_log_ = &std::cout;
+
+    // Object allocating from 'memory_' that keeps the resources alive while it is referenced
+    template <typename T, typename... Args>
+    std::shared_ptr<T> MakeOwned(Args&&... args) const {
+        return std::shared_ptr<T>(new T(std::forward<Args>(args)...), [memory = memory_](T* object) {
+            delete object;
+        });
+    }
 
-    [[nodiscard]] bool IsStopWord(const std::string& word) const;
+    // Empty store, in the arena if there is one
+    [[nodiscard]] std::unique_ptr<DocumentStore, DocumentStoreDeleter> MakeDocumentStore() const;
 
-    [[nodiscard]] std::vector<std::string> SplitIntoWordsNoStop(const std::string& text) const;
+    [[nodiscard]] bool IsStopWord(std::string_view word) const;
 
-    static bool IsWordsHaveSpecialSymbols(const std::set<std::string>& words);
+    // Rebuilds the stop word hash with 'words' added
+    void AddStopWords(const std::vector<std::string_view>& words);
 
-    static bool IsQueryCorrect(const std::string& query_words);
+    [[nodiscard]] std::vector<std::string_view> SplitIntoWordsNoStop(std::string_view text) const;
 
-    static bool IsQueryWordCorrect(const std::string& word);
+    static bool IsWordsHaveSpecialSymbols(const std::set<std::string, std::less<>>& words);
 
-    static bool IsValidWord(const std::string& word);
+    static bool IsQueryWordCorrect(std::string_view word);
+
+    static bool IsValidWord(std::string_view word);
 
     static int ComputeAverageRating(const std::vector<int>& ratings);
 
+    // Result order: by relevance, then by rating, then by document id
+    static bool IsBetterResult(const Document& lhs, const Document& rhs);
+
+    // Sorts in result order and keeps the first MAX_RESULT_DOCUMENT_COUNT
+    static void SelectTopDocuments(std::vector<Document>& documents);
+
 
-    QueryWord ParseQueryWord(std::string text) const;
+    QueryWord ParseQueryWord(std::string_view text) const;
 
-    Query ParseQuery(const std::string& text) const;
+    // Validates and parses the query in a single pass, throws std::invalid_argument on errors
+    Query ParseQuery(std::string_view text) const;
+
+    // Id of a word contained in at least one document
+    std::optional<TermId> FindLiveTerm(std::string_view word) const;
 
     // Existence required
-    double ComputeWordInverseDocumentFreq(const std::string& word) const;
+    double ComputeWordInverseDocumentFreq(TermId term) const;
+
+    void RebuildSortedTerms();
+
+    // Terms with live postings that start with 'prefix', in sorted order, at most 'max_count' of them.
+    // Minus-prefixes are expanded in full, otherwise documents containing only the terms past the cap
+    // would slip through.
+    std::vector<ExpandedTerm> ExpandPrefix(std::string_view prefix, size_t max_count) const;
+
+    // Expansions of the plus-prefixes that aren't plus-words, each prefix capped at MAX_PREFIX_EXPANSION_COUNT.
+    // A term matched by several prefixes is listed once.
+    std::vector<ExpandedTerm> ExpandPlusPrefixes(const Query& query) const;
+
+    // Plus-words and the expansions of plus-prefixes, the rarest first
+    std::vector<ExpandedTerm> CollectPlusTermsByIdf(const Query& query) const;
+
+    // Minus-words and the full expansions of minus-prefixes, each term once. Exclusion isn't capped,
+    // otherwise documents containing only the terms past the cap would slip through.
+    std::vector<ExpandedTerm> CollectMinusTerms(const Query& query) const;
+
+    MatchTerms ResolveMatchTerms(const Query& query) const;
+
+    MatchedDocument MatchTermsInDocument(const MatchTerms& terms, int document_id) const;
+
+    // Union of the postings of 'terms' as (document_id, relevance) pairs sorted by document_id.
+    // Every merged posting is charged to 'budget', the merge stops when it runs out.
+    std::vector<std::pair<int, double>> FindPrefixRelevance(const SegmentedIndex::Reader& reader,
+                                                           const std::vector<ExpandedTerm>& terms, BudgetTracker& budget) const;
+
+    // Documents containing all required words, with minus-words applied, as (document_id, relevance) pairs
+    // sorted by document_id. The required posting lists are intersected from the shortest one and only
+    // the documents left are scored, so the work follows the rarest required word. Every candidate of the
+    // shortest list is charged one posting per required word and every match one per other plus-word;
+    // once 'budget' runs out the documents found so far are returned.
+    std::vector<std::pair<int, double>> FindRequiredRelevance(const SegmentedIndex::Reader& reader, const Query& query,
+                                                             BudgetTracker& budget) const;
+
+    // Documents among 'candidates' matching the query. Required words narrow the candidates down first, then every
+    // posting list of the plus- and minus-words is intersected with them, so only the postings of candidates are read.
+    std::vector<Document> FindFilteredDocuments(const Query& query, const DocumentBitmap& candidates) const;
+
+    // FindFilteredDocuments for a few candidates, the query terms are looked up in their forward index entries
+    std::vector<Document> ScoreFromForwardIndex(const MatchTerms& terms, const std::vector<std::pair<TermId, double>>& term_idfs,
+                                                const DocumentBitmap& candidates) const;
+
+    // Query of a few plain plus-words, the impact ordered postings give its top documents exactly
+    bool IsImpactOrderedQuery(const Query& query) const;
+
+    // Sum of term_freq * IDF over the plus-words in the document, added up in query order like FindAllDocuments does
+    double ComputeRelevance(const std::vector<std::pair<TermId, double>>& term_idfs, int document_id) const;
+
+    // Candidates holding the top documents of an impact ordered query (threshold algorithm). The postings of the
+    // words are read in turn in impact order and every new document is scored in full from the forward index.
+    // Unread documents score at most the sum of the current term frequencies times IDF, reading stops once that
+    // is below the relevance of the MAX_RESULT_DOCUMENT_COUNT-th candidate by more than RELEVANCE_EPSILON.
+    template <typename Func>
+    std::vector<Document> FindImpactOrderedDocuments(const Query& query, Func func, const CancellationToken& token) const {
+        // The token is checked once per this many postings
+        const size_t postings_per_cancel_check = 256;
+        token.ThrowIfCancelled();
+        const SegmentedIndex::Reader reader = index_->Read();
+        std::vector<std::pair<TermId, double>> term_idfs;
+        std::vector<MergedImpactCursor> cursors;
+        for (const std::string_view word : query.plus_words) {
+            if (const std::optional<TermId> term = FindLiveTerm(word)) {
+                term_idfs.emplace_back(*term, ComputeWordInverseDocumentFreq(*term));
+                cursors.push_back(reader.GetImpactCursor(*term));
+            }
+        }
+        const std::vector<ExpandedTerm> minus_terms = CollectMinusTerms(query);
+
+        std::vector<Document> candidates;
+        std::unordered_set<int> seen_documents;
+        // Relevances of the best candidates, the lowest on top
+        std::priority_queue<double, std::vector<double>, std::greater<>> top_relevances;
+        size_t postings_read = 0;
+        for (size_t next = 0; !cursors.empty(); next = (next + 1) % cursors.size()) {
+            double bound = 0;
+            bool is_exhausted = true;
+            for (size_t i = 0; i < cursors.size(); ++i) {
+                if (!cursors[i].IsDone()) {
+                    bound += cursors[i].GetPosting().term_freq * term_idfs[i].second;
+                    is_exhausted = false;
+                }
+            }
+            // Twice the tolerance leaves room for the rounding of the bound
+            if (is_exhausted || (top_relevances.size() == MAX_RESULT_DOCUMENT_COUNT
+                                 && bound < top_relevances.top() - 2 * RELEVANCE_EPSILON)) {
+                break;
+            }
+            MergedImpactCursor& cursor = cursors[next];
+            if (cursor.IsDone()) {
+                continue;
+            }
+            if (++postings_read % postings_per_cancel_check == 0) {
+                token.ThrowIfCancelled();
+            }
+            const ImpactPosting posting = cursor.GetPosting();
+            // With a single word the rest of a term frequency has the same relevance and a lower rating,
+            // once enough candidates beat this posting none of them can make the top
+            if (cursors.size() == 1 && top_relevances.size() == MAX_RESULT_DOCUMENT_COUNT) {
+                const Document current{posting.document_id, posting.term_freq * term_idfs[0].second, posting.rating};
+                const auto better_count = std::count_if(candidates.begin(), candidates.end(), [&current](const Document& candidate) {
+                    return IsBetterResult(candidate, current);
+                });
+                if (better_count >= MAX_RESULT_DOCUMENT_COUNT) {
+                    cursor.SkipTermFrequency();
+                    continue;
+                }
+            }
+            cursor.Next();
+            if (!seen_documents.insert(posting.document_id).second) {
+                continue;
+            }
+            const auto [rating, status] = store_->documents.at(posting.document_id);
+            const bool has_minus_word = std::any_of(minus_terms.begin(), minus_terms.end(), [this, &posting](const ExpandedTerm& term) {
+                return store_->forward_index.HasTerm(posting.document_id, term.term);
+            });
+            if (has_minus_word || !func(posting.document_id, status, rating)) {
+                continue;
+            }
+            const double relevance = ComputeRelevance(term_idfs, posting.document_id);
+            candidates.push_back({posting.document_id, relevance, rating});
+            top_relevances.push(relevance);
+            if (top_relevances.size() > MAX_RESULT_DOCUMENT_COUNT) {
+                top_relevances.pop();
+            }
+        }
+        return candidates;
+    }
 
     template <typename Func>
-    std::vector<Document> FindAllDocuments(const Query& query, Func func) const {
+    std::vector<Document> FindAllRequiredDocuments(const SegmentedIndex::Reader& reader, const Query& query, Func func,
+                                                   BudgetTracker& budget) const {
+        std::vector<Document> matched_documents;
+        for (const auto& [document_id, relevance] : FindRequiredRelevance(reader, query, budget)) {
+            const auto [rating, status] = store_->documents.at(document_id);
+            if (func(document_id,status, rating)) {
+                matched_documents.push_back({document_id,relevance,rating});
+            }
+        }
+        return matched_documents;
+    }
+
+    // 'token' is checked before every posting list
+    template <typename Func>
+    std::vector<Document> FindAllDocuments(const Query& query, Func func, const CancellationToken& token) const {
+        const SegmentedIndex::Reader reader = index_->Read();
+        BudgetTracker unlimited_budget(SearchBudget{});
+        if (!query.required_words.empty()) {
+            token.ThrowIfCancelled();
+            return FindAllRequiredDocuments(reader, query, func, unlimited_budget);
+        }
         std::map<int, double> document_to_relevance;
-        for (const std::string& word : query.plus_words) {
-            if (word_to_id_freqs_.count(word) == 0) {
+        for (const std::string_view word : query.plus_words) {
+            token.ThrowIfCancelled();
+            const std::optional<TermId> term = FindLiveTerm(word);
+            if (!term) {
                 continue;
             }
-            const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-            for (const auto [document_id, term_freq] : word_to_id_freqs_.at(word)) {
-                const auto [rating, status] = documents_.at(document_id);
+            const double inverse_document_freq = ComputeWordInverseDocumentFreq(*term);
+            reader.ForEachPosting(*term, [&](int document_id, double term_freq) {
+                const auto [rating, status] = store_->documents.at(document_id);
                 if (func(document_id,status, rating)) {
                     document_to_relevance[document_id] += term_freq * inverse_document_freq;
                 }
+            });
+        }
+
+        if (!query.plus_prefixes.empty()) {
+            token.ThrowIfCancelled();
+            for (const auto& [document_id, relevance] : FindPrefixRelevance(reader, ExpandPlusPrefixes(query), unlimited_budget)) {
+                const auto [rating, status] = store_->documents.at(document_id);
+                if (func(document_id,status, rating)) {
+                    document_to_relevance[document_id] += relevance;
+                }
             }
         }
 
-        for (const std::string& word : query.minus_words) {
-            if (word_to_id_freqs_.count(word) == 0) {
-                continue;
+        const auto erase_document = [&document_to_relevance](int document_id, double) {
+            document_to_relevance.erase(document_id);
+        };
+        for (const std::string_view word : query.minus_words) {
+            token.ThrowIfCancelled();
+            if (const std::optional<TermId> term = FindLiveTerm(word)) {
+                reader.ForEachPosting(*term, erase_document);
             }
-            for (const auto [document_id, _] : word_to_id_freqs_.at(word)) {
-                document_to_relevance.erase(document_id);
+        }
+
+        for (const std::string_view prefix : query.minus_prefixes) {
+            token.ThrowIfCancelled();
+            for (const ExpandedTerm& term : ExpandPrefix(prefix, std::numeric_limits<size_t>::max())) {
+                reader.ForEachPosting(term.term, erase_document);
+            }
+        }
+
+        std::vector<Document> matched_documents;
+        for (const auto [document_id, relevance] : document_to_relevance) {
+            matched_documents.push_back({document_id,relevance,store_->documents.at(document_id).rating});
+        }
+        return matched_documents;
+    }
+
+    template <typename Func>
+    std::vector<Document> FindAllDocuments(const Query& query, Func func, const SearchBudget& search_budget, bool& is_approximate) const {
+        BudgetTracker budget(search_budget);
+        const SegmentedIndex::Reader reader = index_->Read();
+        if (!query.required_words.empty()) {
+            std::vector<Document> matched_documents = FindAllRequiredDocuments(reader, query, func, budget);
+            is_approximate = budget.IsExhausted();
+            return matched_documents;
+        }
+        std::map<int, double> document_to_relevance;
+        for (const ExpandedTerm& term : CollectPlusTermsByIdf(query)) {
+            if (!budget.HasTimeLeft()) {
+                break;
+            }
+            const double inverse_document_freq = ComputeWordInverseDocumentFreq(term.term);
+            reader.ForEachPostingList(term.term, [&](PostingRange postings, const DeletedDocuments& deleted) {
+                for (const auto [document_id, term_freq] : postings) {
+                    if (!budget.Spend(1)) {
+                        return;
+                    }
+                    if (deleted.count(document_id)) {
+                        continue;
+                    }
+                    const auto [rating, status] = store_->documents.at(document_id);
+                    if (func(document_id,status, rating)) {
+                        document_to_relevance[document_id] += term_freq * inverse_document_freq;
+                    }
+                }
+            });
+            if (budget.IsExhausted()) {
+                break;
             }
         }
+        is_approximate = budget.IsExhausted();
 
+        const std::vector<ExpandedTerm> minus_terms = CollectMinusTerms(query);
         std::vector<Document> matched_documents;
         for (const auto [document_id, relevance] : document_to_relevance) {
-            matched_documents.push_back({document_id,relevance,documents_.at(document_id).rating});
+            const bool has_minus_word = std::any_of(minus_terms.begin(), minus_terms.end(), [&reader, document_id = document_id](const ExpandedTerm& term) {
+                return reader.HasPosting(term.term, document_id);
+            });
+            if (!has_minus_word) {
+                matched_documents.push_back({document_id,relevance,store_->documents.at(document_id).rating});
+            }
         }
         return matched_documents;
     }
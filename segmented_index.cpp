@@ -0,0 +1,271 @@
+#include "segmented_index.h"
+
+#include <algorithm>
+#include <map>
+
+SegmentedIndex::SegmentedIndex(const IndexOptions& options, std::pmr::memory_resource* resource)
+        : options_(options)
+        , resource_(resource)
+        , write_segment_(resource)
+        , sealed_segments_(resource) {
+    options_.segment_max_documents = std::max<size_t>(options_.segment_max_documents, 1);
+    options_.merge_factor = std::max<size_t>(options_.merge_factor, 2);
+    options_.vacuum_threshold = std::clamp(options_.vacuum_threshold, 0.0, 1.0);
+    if (options_.background_merge) {
+        merger_ = std::thread([this] {
+            MergerLoop();
+        });
+    }
+}
+
+SegmentedIndex::~SegmentedIndex() {
+    if (merger_.joinable()) {
+        {
+            std::lock_guard lock(mutex_);
+            stop_ = true;
+        }
+        merge_requested_.notify_all();
+        merger_.join();
+    }
+}
+
+void SegmentedIndex::AddDocument(int document_id, const std::vector<std::pair<TermId, double>>& term_freqs, int rating) {
+    std::unique_lock lock(mutex_);
+    write_segment_.AddDocument(document_id, term_freqs, rating);
+    if (write_segment_.GetDocumentCount() < options_.segment_max_documents) {
+        return;
+    }
+    SealWriteSegment();
+    if (options_.background_merge) {
+        lock.unlock();
+        merge_requested_.notify_one();
+    } else {
+        while (MergeOnce(lock)) {
+        }
+    }
+}
+
+void SegmentedIndex::RemoveDocument(int document_id) {
+    std::unique_lock lock(mutex_);
+    if (write_segment_.RemoveDocument(document_id)) {
+        if (write_segment_.GetDeletedDocuments().size() > options_.vacuum_threshold * write_segment_.GetDocumentCount()) {
+            write_segment_.Vacuum();
+        }
+        return;
+    }
+    for (SealedEntry& entry : sealed_segments_) {
+        if (entry.segment->ContainsDocument(document_id) && !entry.deleted.count(document_id)) {
+            entry.deleted.insert(document_id);
+            if (!entry.NeedsVacuum(options_.vacuum_threshold)) {
+                return;
+            }
+            // One segment is rewritten per crossing of the threshold, so the work is spread over the deletions
+            if (options_.background_merge) {
+                lock.unlock();
+                merge_requested_.notify_one();
+            } else {
+                MergeOnce(lock);
+            }
+            return;
+        }
+    }
+}
+
+void SegmentedIndex::WaitForMerges() {
+    std::unique_lock lock(mutex_);
+    if (!options_.background_merge) {
+        while (MergeOnce(lock)) {
+        }
+        return;
+    }
+    merge_finished_.wait(lock, [this] {
+        return !is_merging_ && SelectMerge().empty();
+    });
+}
+
+const IndexOptions& SegmentedIndex::GetOptions() const {
+    return options_;
+}
+
+size_t SegmentedIndex::GetSegmentCount() const {
+    std::shared_lock lock(mutex_);
+    return sealed_segments_.size();
+}
+
+size_t SegmentedIndex::GetPostingCount() const {
+    std::shared_lock lock(mutex_);
+    size_t posting_count = write_segment_.GetPostingCount();
+    for (const SealedEntry& entry : sealed_segments_) {
+        posting_count += entry.segment->GetPostingCount();
+    }
+    return posting_count;
+}
+
+size_t SegmentedIndex::GetDeletedDocumentCount() const {
+    std::shared_lock lock(mutex_);
+    size_t deleted_count = write_segment_.GetDeletedDocuments().size();
+    for (const SealedEntry& entry : sealed_segments_) {
+        deleted_count += entry.deleted.size();
+    }
+    return deleted_count;
+}
+
+SegmentedIndex::Reader::Reader(const SegmentedIndex& index)
+        : index_(index), lock_(index.mutex_) {
+}
+
+bool SegmentedIndex::Reader::HasPosting(TermId term, int document_id) const {
+    if (index_.write_segment_.FindPostings(term).Contains(document_id)
+        && !index_.write_segment_.GetDeletedDocuments().count(document_id)) {
+        return true;
+    }
+    for (const SealedEntry& entry : index_.sealed_segments_) {
+        if (entry.segment->FindPostings(term).Contains(document_id) && !entry.deleted.count(document_id)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+MergedImpactCursor SegmentedIndex::Reader::GetImpactCursor(TermId term) const {
+    std::vector<ImpactCursor> cursors;
+    for (const SealedEntry& entry : index_.sealed_segments_) {
+        cursors.push_back(entry.segment->GetImpactCursor(term, entry.deleted));
+    }
+    cursors.push_back(index_.write_segment_.GetImpactCursor(term));
+    return MergedImpactCursor(std::move(cursors));
+}
+
+SegmentedIndex::Reader SegmentedIndex::Read() const {
+    return Reader(*this);
+}
+
+size_t SegmentedIndex::SealedEntry::GetLiveDocumentCount() const {
+    return segment->GetDocumentCount() - deleted.size();
+}
+
+bool SegmentedIndex::SealedEntry::NeedsVacuum(double threshold) const {
+    return !deleted.empty() && deleted.size() > threshold * segment->GetDocumentCount();
+}
+
+void SegmentedIndex::SealWriteSegment() {
+    sealed_segments_.push_back({write_segment_.Seal(options_.impact_ordered_postings), DeletedDocuments(resource_)});
+}
+
+std::vector<size_t> SegmentedIndex::SelectMerge() const {
+    std::vector<size_t> selection = SelectPolicyMerge();
+    if (!selection.empty()) {
+        return selection;
+    }
+    // The segment with the largest share of deleted documents among those over the threshold
+    double max_deleted_share = 0;
+    for (size_t i = 0; i < sealed_segments_.size(); ++i) {
+        const SealedEntry& entry = sealed_segments_[i];
+        if (!entry.NeedsVacuum(options_.vacuum_threshold)) {
+            continue;
+        }
+        const double deleted_share = static_cast<double>(entry.deleted.size()) / entry.segment->GetDocumentCount();
+        if (deleted_share > max_deleted_share) {
+            max_deleted_share = deleted_share;
+            selection = {i};
+        }
+    }
+    return selection;
+}
+
+std::vector<size_t> SegmentedIndex::SelectPolicyMerge() const {
+    const size_t segment_count = sealed_segments_.size();
+    if (segment_count < 2) {
+        return {};
+    }
+
+    if (options_.merge_policy == MergePolicy::LOG_STRUCTURED) {
+        const size_t newest = sealed_segments_[segment_count - 1].GetLiveDocumentCount();
+        const size_t previous = sealed_segments_[segment_count - 2].GetLiveDocumentCount();
+        if (previous < options_.merge_factor * std::max<size_t>(newest, 1)) {
+            return {segment_count - 2, segment_count - 1};
+        }
+        return {};
+    }
+
+    // Tier of a segment: how many times 'merge_factor' it is bigger than a freshly sealed one
+    std::map<size_t, std::vector<size_t>> tiers;
+    for (size_t i = 0; i < segment_count; ++i) {
+        size_t tier = 0;
+        for (size_t tier_limit = options_.segment_max_documents;
+             sealed_segments_[i].GetLiveDocumentCount() > tier_limit; tier_limit *= options_.merge_factor) {
+            ++tier;
+        }
+        tiers[tier].push_back(i);
+    }
+    for (auto& [tier, segments] : tiers) {
+        if (segments.size() >= options_.merge_factor) {
+            segments.resize(options_.merge_factor);
+            return segments;
+        }
+    }
+    return {};
+}
+
+bool SegmentedIndex::MergeOnce(std::unique_lock<std::shared_mutex>& lock) {
+    const std::vector<size_t> selection = SelectMerge();
+    if (selection.empty()) {
+        return false;
+    }
+
+    // The inputs are immutable, only their deletion marks may change while the lock is released
+    std::vector<std::shared_ptr<const SealedSegment>> inputs;
+    std::vector<DeletedDocuments> deleted_snapshots;
+    for (const size_t index : selection) {
+        inputs.push_back(sealed_segments_[index].segment);
+        deleted_snapshots.push_back(sealed_segments_[index].deleted);
+    }
+    is_merging_ = true;
+    lock.unlock();
+
+    std::vector<SealedSegment::Source> sources;
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        sources.push_back({inputs[i].get(), &deleted_snapshots[i]});
+    }
+    std::shared_ptr<const SealedSegment> merged = SealedSegment::Merge(sources, resource_, options_.impact_ordered_postings);
+
+    lock.lock();
+    SealedEntry merged_entry{std::move(merged), DeletedDocuments(resource_)};
+    size_t insert_position = sealed_segments_.size();
+    for (size_t i = sealed_segments_.size(); i-- > 0;) {
+        const auto input_it = std::find(inputs.begin(), inputs.end(), sealed_segments_[i].segment);
+        if (input_it == inputs.end()) {
+            continue;
+        }
+        // Documents deleted during the merge are still in the merged segment
+        const DeletedDocuments& snapshot = deleted_snapshots[input_it - inputs.begin()];
+        for (const int document_id : sealed_segments_[i].deleted) {
+            if (!snapshot.count(document_id)) {
+                merged_entry.deleted.insert(document_id);
+            }
+        }
+        sealed_segments_.erase(sealed_segments_.begin() + i);
+        insert_position = i;
+    }
+    // Vacuuming a segment with no live documents leaves nothing to keep
+    if (merged_entry.segment->GetDocumentCount() > 0) {
+        sealed_segments_.insert(sealed_segments_.begin() + insert_position, std::move(merged_entry));
+    }
+    is_merging_ = false;
+    return true;
+}
+
+void SegmentedIndex::MergerLoop() {
+    std::unique_lock lock(mutex_);
+    while (true) {
+        merge_requested_.wait(lock, [this] {
+            return stop_ || !SelectMerge().empty();
+        });
+        if (stop_) {
+            return;
+        }
+        while (!stop_ && MergeOnce(lock)) {
+        }
+        merge_finished_.notify_all();
+    }
+}
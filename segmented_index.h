@@ -0,0 +1,167 @@
+#pragma once
+
+#include "index_segment.h"
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <vector>
+
+enum class MergePolicy {
+    // Segments of similar size form a tier, 'merge_factor' segments of one tier are merged together
+    TIERED,
+    // The newest segment is merged into the previous one while that one is less than 'merge_factor' times bigger
+    LOG_STRUCTURED,
+};
+
+struct IndexOptions {
+    // The write segment is sealed when it holds this many documents
+    size_t segment_max_documents = 4096;
+    MergePolicy merge_policy = MergePolicy::TIERED;
+    size_t merge_factor = 4;
+    // Merge on a background thread instead of inside AddDocument
+    bool background_merge = false;
+    // A segment is rewritten without its deleted documents once they make up more than this share of it,
+    // 1 turns vacuuming off (merges still drop deleted documents)
+    double vacuum_threshold = 0.25;
+    // Sealed segments also store every posting list in impact order (4 bytes per posting), and queries of a
+    // few plain words are answered from it with early termination instead of traversing all their postings
+    bool impact_ordered_postings = false;
+    // The server's per-document structures (forward index, document data, attributes, term counts) come from
+    // an arena it owns instead of the heap: nodes built together sit together, and destroying the server or
+    // SearchServer::Clear drops them all with one free per arena chunk instead of one per node.
+    // Off by default, RunAllocationBenchmark compares the two.
+    bool arena_allocation = false;
+};
+
+// Log-structured inverted index: new documents go into a small write segment, which is sealed into
+// an immutable segment when full. Sealed segments are merged according to the merge policy.
+// Deleted documents are only marked in their segment (a tombstone) and are dropped by merges,
+// sealing, or a vacuum of the segment once its share of deleted documents crosses the threshold.
+// Readers may run concurrently with each other and with a background merge, not with writers.
+class SegmentedIndex {
+public:
+    // Segments and postings are allocated from 'resource', which has to be thread-safe with background merges
+    explicit SegmentedIndex(const IndexOptions& options, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+    SegmentedIndex(const SegmentedIndex&) = delete;
+    SegmentedIndex& operator=(const SegmentedIndex&) = delete;
+
+    ~SegmentedIndex();
+
+    // 'term_freqs' must not repeat terms. 'rating' breaks ties of term frequency in impact order.
+    void AddDocument(int document_id, const std::vector<std::pair<TermId, double>>& term_freqs, int rating = 0);
+
+    void RemoveDocument(int document_id);
+
+    // Blocks until the merge policy has nothing left to merge
+    void WaitForMerges();
+
+    [[nodiscard]] const IndexOptions& GetOptions() const;
+
+    // Number of sealed segments, the write segment is not counted
+    [[nodiscard]] size_t GetSegmentCount() const;
+
+    // Postings in all segments, including those of deleted documents not yet vacuumed
+    [[nodiscard]] size_t GetPostingCount() const;
+
+    // Deleted documents whose postings are still stored
+    [[nodiscard]] size_t GetDeletedDocumentCount() const;
+
+    // Consistent view of all segments, holds off background merges from swapping segments while alive
+    class Reader {
+    public:
+        explicit Reader(const SegmentedIndex& index);
+
+        // Calls 'callback(PostingRange postings, const DeletedDocuments& deleted)' for every segment holding 'term'
+        template <typename Callback>
+        void ForEachPostingList(TermId term, Callback callback) const {
+            for (const SealedEntry& entry : index_.sealed_segments_) {
+                const PostingRange postings = entry.segment->FindPostings(term);
+                if (!postings.empty()) {
+                    callback(postings, entry.deleted);
+                }
+            }
+            const PostingRange postings = index_.write_segment_.FindPostings(term);
+            if (!postings.empty()) {
+                callback(postings, index_.write_segment_.GetDeletedDocuments());
+            }
+        }
+
+        // Calls 'callback(int document_id, double term_freq)' for every live posting of 'term'
+        template <typename Callback>
+        void ForEachPosting(TermId term, Callback callback) const {
+            ForEachPostingList(term, [&callback](PostingRange postings, const DeletedDocuments& deleted) {
+                for (const Posting& posting : postings) {
+                    if (deleted.empty() || !deleted.count(posting.document_id)) {
+                        callback(posting.document_id, posting.term_freq);
+                    }
+                }
+            });
+        }
+
+        // Calls 'callback(const std::vector<PostingRange>& postings, const DeletedDocuments& deleted)' for every segment,
+        // postings[i] are the postings of terms[i] there and may be empty. All postings of a document are in one segment.
+        template <typename Callback>
+        void ForEachSegmentPostings(const std::vector<TermId>& terms, Callback callback) const {
+            std::vector<PostingRange> postings(terms.size());
+            for (const SealedEntry& entry : index_.sealed_segments_) {
+                for (size_t i = 0; i < terms.size(); ++i) {
+                    postings[i] = entry.segment->FindPostings(terms[i]);
+                }
+                callback(postings, entry.deleted);
+            }
+            for (size_t i = 0; i < terms.size(); ++i) {
+                postings[i] = index_.write_segment_.FindPostings(terms[i]);
+            }
+            callback(postings, index_.write_segment_.GetDeletedDocuments());
+        }
+
+        [[nodiscard]] bool HasPosting(TermId term, int document_id) const;
+
+        // Live postings of 'term' from all segments in impact order
+        [[nodiscard]] MergedImpactCursor GetImpactCursor(TermId term) const;
+
+    private:
+        const SegmentedIndex& index_;
+        std::shared_lock<std::shared_mutex> lock_;
+    };
+
+    [[nodiscard]] Reader Read() const;
+
+private:
+    struct SealedEntry {
+        std::shared_ptr<const SealedSegment> segment;
+        DeletedDocuments deleted;
+
+        [[nodiscard]] size_t GetLiveDocumentCount() const;
+        [[nodiscard]] bool NeedsVacuum(double threshold) const;
+    };
+
+    IndexOptions options_;
+    std::pmr::memory_resource* resource_;
+    mutable std::shared_mutex mutex_;
+    WriteSegment write_segment_;
+    // Oldest first
+    std::pmr::vector<SealedEntry> sealed_segments_;
+
+    std::thread merger_;
+    std::condition_variable_any merge_requested_;
+    std::condition_variable_any merge_finished_;
+    bool is_merging_ = false;
+    bool stop_ = false;
+
+    void SealWriteSegment();
+
+    // Indexes into sealed_segments_ to merge next, empty if the policy is satisfied.
+    // A single index means a vacuum of that segment.
+    [[nodiscard]] std::vector<size_t> SelectMerge() const;
+    [[nodiscard]] std::vector<size_t> SelectPolicyMerge() const;
+
+    // Merges one selection, 'lock' is released while the new segment is built
+    bool MergeOnce(std::unique_lock<std::shared_mutex>& lock);
+
+    void MergerLoop();
+};
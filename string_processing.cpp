@@ -1,16 +1,184 @@
 #include "string_processing.h"
+#include <cstdint>
+#include <cstring>
 #include <string>
-#include <sstream>
 #include <vector>
 
-std::vector<std::string> SplitIntoWords(const std::string& text) {
-    std::vector<std::string> output;
-    std::istringstream iss(text);
-    std::string word;
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define SEARCH_SERVER_X86_SIMD 1
+#endif
+
+namespace {
+
+// Bit i of each mask describes byte i of the block
+struct BlockMasks {
+    uint32_t space;
+    uint32_t control;
+};
+
+// Same set of separators as operator>> for std::string in the "C" locale
+inline bool IsSpaceChar(unsigned char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+inline bool IsControlChar(unsigned char c) {
+    return c < ' ' && !IsSpaceChar(c);
+}
+
+inline int CountTrailingZeros(uint32_t value) {
+#if defined(__GNUC__)
+    return __builtin_ctz(value);
+#else
+    int count = 0;
+    while ((value & 1u) == 0) {
+        value >>= 1;
+        ++count;
+    }
+    return count;
+#endif
+}
+
+template <size_t BlockSize>
+BlockMasks ClassifyScalar(const char* block) {
+    BlockMasks masks{0, 0};
+    for (size_t i = 0; i < BlockSize; ++i) {
+        const auto c = static_cast<unsigned char>(block[i]);
+        masks.space |= static_cast<uint32_t>(IsSpaceChar(c)) << i;
+        masks.control |= static_cast<uint32_t>(IsControlChar(c)) << i;
+    }
+    return masks;
+}
+
+#ifdef SEARCH_SERVER_X86_SIMD
+BlockMasks ClassifySse2(const char* block) {
+    const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block));
+    const __m128i is_blank = _mm_cmpeq_epi8(bytes, _mm_set1_epi8(' '));
+    const __m128i is_tab_to_cr = _mm_and_si128(_mm_cmpgt_epi8(bytes, _mm_set1_epi8('\t' - 1)),
+                                               _mm_cmpgt_epi8(_mm_set1_epi8('\r' + 1), bytes));
+    const __m128i is_space = _mm_or_si128(is_blank, is_tab_to_cr);
+    // Bytes above 127 are negative here and are not control characters
+    const __m128i is_below_blank = _mm_and_si128(_mm_cmpgt_epi8(bytes, _mm_set1_epi8(-1)),
+                                                 _mm_cmpgt_epi8(_mm_set1_epi8(' '), bytes));
+    const __m128i is_control = _mm_andnot_si128(is_space, is_below_blank);
+    return {static_cast<uint32_t>(_mm_movemask_epi8(is_space)),
+            static_cast<uint32_t>(_mm_movemask_epi8(is_control))};
+}
+
+__attribute__((target("avx2")))
+BlockMasks ClassifyAvx2(const char* block) {
+    const __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block));
+    const __m256i is_blank = _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(' '));
+    const __m256i is_tab_to_cr = _mm256_and_si256(_mm256_cmpgt_epi8(bytes, _mm256_set1_epi8('\t' - 1)),
+                                                  _mm256_cmpgt_epi8(_mm256_set1_epi8('\r' + 1), bytes));
+    const __m256i is_space = _mm256_or_si256(is_blank, is_tab_to_cr);
+    const __m256i is_below_blank = _mm256_and_si256(_mm256_cmpgt_epi8(bytes, _mm256_set1_epi8(-1)),
+                                                    _mm256_cmpgt_epi8(_mm256_set1_epi8(' '), bytes));
+    const __m256i is_control = _mm256_andnot_si256(is_space, is_below_blank);
+    return {static_cast<uint32_t>(_mm256_movemask_epi8(is_space)),
+            static_cast<uint32_t>(_mm256_movemask_epi8(is_control))};
+}
+#endif
+
+// Finds word boundaries block by block: a word starts at a non-space byte preceded by a space
+// and ends at a space preceded by a non-space byte. The text is treated as if surrounded by spaces.
+// Without 'validate' control characters are treated as ordinary word characters.
+template <size_t BlockSize, typename Classify>
+bool SplitBlocks(std::string_view text, std::vector<std::string_view>& words, bool validate, Classify classify) {
+    static_assert(BlockSize <= 32);
+    constexpr uint32_t full_block = BlockSize == 32 ? ~0u : (1u << BlockSize) - 1;
+
+    const char* data = text.data();
+    const size_t size = text.size();
+    uint32_t prev_space = 1;
+    size_t word_start = 0;
+
+    for (size_t offset = 0; offset < size; offset += BlockSize) {
+        BlockMasks masks;
+        if (offset + BlockSize <= size) {
+            masks = classify(data + offset);
+        } else {
+            char tail[BlockSize];
+            std::memset(tail, ' ', BlockSize);
+            std::memcpy(tail, data + offset, size - offset);
+            masks = classify(tail);
+        }
+        if (validate && masks.control != 0) {
+            return false;
+        }
 
-    while(iss >> word){
-        output.push_back(word);
+        const uint32_t space = masks.space & full_block;
+        const uint32_t word = ~space & full_block;
+        const uint32_t starts = word & ((space << 1) | prev_space);
+        const uint32_t ends = space & ((word << 1) | (prev_space ^ 1u));
+        prev_space = (space >> (BlockSize - 1)) & 1u;
+
+        for (uint32_t bounds = starts | ends; bounds != 0; bounds &= bounds - 1) {
+            const int bit = CountTrailingZeros(bounds);
+            const size_t pos = offset + bit;
+            if ((starts >> bit) & 1u) {
+                word_start = pos;
+            } else {
+                words.emplace_back(data + word_start, pos - word_start);
+            }
+        }
+    }
+    if (prev_space == 0) {
+        words.emplace_back(data + word_start, size - word_start);
+    }
+    return true;
+}
+
+using SplitFunction = bool (*)(std::string_view, std::vector<std::string_view>&, bool);
+
+[[maybe_unused]] bool SplitScalar(std::string_view text, std::vector<std::string_view>& words, bool validate) {
+    return SplitBlocks<32>(text, words, validate, ClassifyScalar<32>);
+}
+
+#ifdef SEARCH_SERVER_X86_SIMD
+bool SplitSse2(std::string_view text, std::vector<std::string_view>& words, bool validate) {
+    return SplitBlocks<16>(text, words, validate, ClassifySse2);
+}
+
+bool SplitAvx2(std::string_view text, std::vector<std::string_view>& words, bool validate) {
+    return SplitBlocks<32>(text, words, validate, ClassifyAvx2);
+}
+#endif
+
+SplitFunction ChooseSplitFunction() {
+#ifdef SEARCH_SERVER_X86_SIMD
+    if (__builtin_cpu_supports("avx2")) {
+        return SplitAvx2;
     }
+    return SplitSse2;
+#else
+    return SplitScalar;
+#endif
+}
 
+// Chosen once on first use, so the tokenizer is usable during static initialization
+SplitFunction GetSplitFunction() {
+    static const SplitFunction split_function = ChooseSplitFunction();
+    return split_function;
+}
+
+} // namespace
+
+bool SplitIntoWordsChecked(std::string_view text, std::vector<std::string_view>& words) {
+    return GetSplitFunction()(text, words, true);
+}
+
+std::vector<std::string_view> SplitIntoWordsView(std::string_view text) {
+    // Invalid characters are kept inside words, callers that care use SplitIntoWordsChecked
+    std::vector<std::string_view> words;
+    GetSplitFunction()(text, words, false);
+    return words;
+}
+
+std::vector<std::string> SplitIntoWords(const std::string& text) {
+    std::vector<std::string> output;
+    for (const std::string_view word : SplitIntoWordsView(text)) {
+        output.emplace_back(word);
+    }
     return output;
-}
\ No newline at end of file
+}
@@ -2,17 +2,26 @@
 
 #include <vector>
 #include <string>
+#include <string_view>
 #include <set>
 
 std::vector<std::string> SplitIntoWords(const std::string& text);
 
+std::vector<std::string_view> SplitIntoWordsView(std::string_view text);
+
+/// Splits 'text' into words and validates it in the same pass
+/// @param <text> Text to split, the resulting views point into it
+/// @param <words> Words are appended here
+/// @return false if 'text' contains characters with codes from 0 to 31 (other than whitespace), true otherwise
+bool SplitIntoWordsChecked(std::string_view text, std::vector<std::string_view>& words);
+
 template <typename StringContainer>
-std::set<std::string> MakeUniqueNonEmptyStrings(const StringContainer& strings) {
-    std::set<std::string> non_empty_strings;
+std::set<std::string, std::less<>> MakeUniqueNonEmptyStrings(const StringContainer& strings) {
+    std::set<std::string, std::less<>> non_empty_strings;
     try{
-        for (const std::string& str : strings) {
+        for (const auto& str : strings) {
             if (!str.empty()) {
-                non_empty_strings.insert(str);
+                non_empty_strings.emplace(str);
             }
         }
     }
@@ -0,0 +1,213 @@
+#include "term_dictionary.h"
+
+#include <algorithm>
+#include <functional>
+
+namespace {
+
+const size_t MIN_SLOT_COUNT = 16;
+// Words are copied into chunks of this many characters, longer words get a chunk of their own
+const size_t WORD_CHUNK_SIZE = 64 * 1024;
+
+uint32_t GetHashTag(size_t hash) {
+    return static_cast<uint32_t>(static_cast<uint64_t>(hash) >> 32);
+}
+
+void WriteVarint(std::pmr::string& out, size_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+const char* ReadVarint(const char* pos, size_t& value) {
+    value = 0;
+    for (int shift = 0;; shift += 7) {
+        const auto byte = static_cast<unsigned char>(*pos++);
+        value |= static_cast<size_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            return pos;
+        }
+    }
+}
+
+size_t CommonPrefixLength(std::string_view lhs, std::string_view rhs) {
+    const size_t max_length = std::min(lhs.size(), rhs.size());
+    size_t length = 0;
+    while (length < max_length && lhs[length] == rhs[length]) {
+        ++length;
+    }
+    return length;
+}
+
+} // namespace
+
+FrontCodedDictionary::FrontCodedDictionary(std::pmr::memory_resource* resource)
+        : data_(resource)
+        , block_offsets_(resource) {
+}
+
+FrontCodedDictionary::FrontCodedDictionary(const std::vector<std::string_view>& sorted_terms, std::pmr::memory_resource* resource)
+        : data_(resource)
+        , block_offsets_(resource)
+        , term_count_(sorted_terms.size()) {
+    std::string_view prev_term;
+    for (size_t i = 0; i < sorted_terms.size(); ++i) {
+        const std::string_view term = sorted_terms[i];
+        if (i % BLOCK_SIZE == 0) {
+            block_offsets_.push_back(static_cast<uint32_t>(data_.size()));
+            WriteVarint(data_, term.size());
+            data_.append(term);
+        } else {
+            const size_t shared = CommonPrefixLength(prev_term, term);
+            WriteVarint(data_, shared);
+            WriteVarint(data_, term.size() - shared);
+            data_.append(term.substr(shared));
+        }
+        prev_term = term;
+    }
+    data_.shrink_to_fit();
+    block_offsets_.shrink_to_fit();
+}
+
+size_t FrontCodedDictionary::size() const {
+    return term_count_;
+}
+
+bool FrontCodedDictionary::empty() const {
+    return term_count_ == 0;
+}
+
+size_t FrontCodedDictionary::GetByteSize() const {
+    return data_.capacity() + block_offsets_.capacity() * sizeof(uint32_t);
+}
+
+size_t FrontCodedDictionary::FindFirstBlock(std::string_view prefix) const {
+    size_t left = 0;
+    size_t right = block_offsets_.size();
+    while (left < right) {
+        const size_t middle = left + (right - left) / 2;
+        if (GetBlockHead(middle) < prefix) {
+            left = middle + 1;
+        } else {
+            right = middle;
+        }
+    }
+    return left == 0 ? 0 : left - 1;
+}
+
+std::string_view FrontCodedDictionary::GetBlockHead(size_t block) const {
+    size_t length;
+    const char* pos = ReadVarint(data_.data() + block_offsets_[block], length);
+    return {pos, length};
+}
+
+const char* FrontCodedDictionary::DecodeNext(const char* pos, bool is_block_head, std::string& term) {
+    size_t shared = 0;
+    if (!is_block_head) {
+        pos = ReadVarint(pos, shared);
+    }
+    size_t suffix_length;
+    pos = ReadVarint(pos, suffix_length);
+    term.resize(shared);
+    term.append(pos, suffix_length);
+    return pos + suffix_length;
+}
+
+TermDictionary::TermDictionary(std::pmr::memory_resource* resource)
+        : slots_(resource)
+        , chunks_(resource)
+        , word_blocks_(resource)
+        , directories_(resource) {
+}
+
+std::optional<TermId> TermDictionary::Find(std::string_view word) const {
+    std::shared_lock lock(mutex_);
+    if (slots_.empty()) {
+        return std::nullopt;
+    }
+    const Slot& slot = slots_[FindSlot(word, std::hash<std::string_view>{}(word))];
+    if (slot.term == EMPTY_SLOT) {
+        return std::nullopt;
+    }
+    return slot.term;
+}
+
+TermId TermDictionary::Insert(std::string_view word) {
+    // Most words of a document are already known, those don't need the exclusive lock
+    if (const std::optional<TermId> term = Find(word)) {
+        return *term;
+    }
+    std::lock_guard lock(mutex_);
+    const size_t size = size_.load(std::memory_order_relaxed);
+    if (2 * (size + 1) > slots_.size()) {
+        Grow();
+    }
+    const size_t hash = std::hash<std::string_view>{}(word);
+    Slot& slot = slots_[FindSlot(word, hash)];
+    if (slot.term == EMPTY_SLOT) {
+        slot = {GetHashTag(hash), static_cast<TermId>(size)};
+        AppendWord(StoreWord(word));
+    }
+    return slot.term;
+}
+
+size_t TermDictionary::size() const {
+    return size_.load(std::memory_order_acquire);
+}
+
+size_t TermDictionary::FindSlot(std::string_view word, size_t hash) const {
+    const size_t mask = slots_.size() - 1;
+    const uint32_t hash_tag = GetHashTag(hash);
+    for (size_t index = hash & mask;; index = (index + 1) & mask) {
+        const Slot& slot = slots_[index];
+        if (slot.term == EMPTY_SLOT || (slot.hash_tag == hash_tag && GetWord(slot.term) == word)) {
+            return index;
+        }
+    }
+}
+
+std::string_view TermDictionary::StoreWord(std::string_view word) {
+    if (chunks_.empty() || chunks_.back().capacity() - chunks_.back().size() < word.size()) {
+        chunks_.emplace_back();
+        chunks_.back().reserve(std::max(WORD_CHUNK_SIZE, word.size()));
+    }
+    // The chunk never grows past its capacity, so earlier views into it stay valid
+    std::pmr::string& chunk = chunks_.back();
+    const size_t offset = chunk.size();
+    chunk.append(word);
+    return {chunk.data() + offset, word.size()};
+}
+
+void TermDictionary::AppendWord(std::string_view word) {
+    const size_t size = size_.load(std::memory_order_relaxed);
+    if (size % WORD_BLOCK_SIZE == 0) {
+        const size_t block_count = word_blocks_.size();
+        word_blocks_.emplace_back().reserve(WORD_BLOCK_SIZE);
+        if (directories_.empty() || directories_.back().size() == directories_.back().capacity()) {
+            std::pmr::vector<const std::string_view*>& directory = directories_.emplace_back();
+            directory.reserve(std::max<size_t>(16, 2 * block_count));
+            if (block_count > 0) {
+                const std::pmr::vector<const std::string_view*>& previous = directories_[directories_.size() - 2];
+                directory.assign(previous.begin(), previous.end());
+            }
+        }
+        // Within its capacity the directory doesn't move, readers of the terms added so far aren't affected
+        directories_.back().push_back(word_blocks_.back().data());
+        directory_.store(directories_.back().data(), std::memory_order_release);
+    }
+    // A block never grows past its capacity either
+    word_blocks_.back().push_back(word);
+    size_.store(size + 1, std::memory_order_release);
+}
+
+void TermDictionary::Grow() {
+    std::pmr::vector<Slot> slots(std::max(MIN_SLOT_COUNT, 2 * slots_.size()), Slot{0, EMPTY_SLOT}, slots_.get_allocator());
+    slots_.swap(slots);
+    for (TermId term = 0; term < size_.load(std::memory_order_relaxed); ++term) {
+        const std::string_view word = GetWord(term);
+        const size_t hash = std::hash<std::string_view>{}(word);
+        slots_[FindSlot(word, hash)] = {GetHashTag(hash), term};
+    }
+}
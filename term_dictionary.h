@@ -0,0 +1,118 @@
+#pragma once
+
+#include "index_segment.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory_resource>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Words with dense term ids in order of insertion, ids are never reused. Lookups go through an
+// open addressing hash table with linear probing, kept at most half full, whose slots hold
+// the term id and the upper half of the word hash: a lookup usually compares a single word.
+// Words are copied into append-only chunks, so their views stay valid while the dictionary is alive.
+// Thread-safe, so that several servers can share one: lookups take a shared lock, adding a word an exclusive one,
+// and GetWord takes none.
+class TermDictionary {
+public:
+    explicit TermDictionary(std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+    TermDictionary(const TermDictionary&) = delete;
+    TermDictionary& operator=(const TermDictionary&) = delete;
+
+    [[nodiscard]] std::optional<TermId> Find(std::string_view word) const;
+
+    // Id of 'word', the next free one if it is new
+    TermId Insert(std::string_view word);
+
+    // Requires a term id returned by Find or Insert
+    [[nodiscard]] std::string_view GetWord(TermId term) const {
+        return directory_.load(std::memory_order_acquire)[term / WORD_BLOCK_SIZE][term % WORD_BLOCK_SIZE];
+    }
+
+    [[nodiscard]] size_t size() const;
+
+private:
+    struct Slot {
+        uint32_t hash_tag;
+        TermId term;
+    };
+
+    static constexpr TermId EMPTY_SLOT = UINT32_MAX;
+    static constexpr size_t WORD_BLOCK_SIZE = 4096;
+
+    mutable std::shared_mutex mutex_;
+    std::pmr::vector<Slot> slots_;
+    std::pmr::deque<std::pmr::string> chunks_;
+    // Word views in blocks that never move. GetWord reads them through the latest directory without a lock;
+    // a full directory is replaced by a bigger copy and kept, since a reader may still be using it.
+    std::pmr::deque<std::pmr::vector<std::string_view>> word_blocks_;
+    std::pmr::deque<std::pmr::vector<const std::string_view*>> directories_;
+    std::atomic<const std::string_view* const*> directory_{nullptr};
+    std::atomic<size_t> size_{0};
+
+    // Slot holding 'word' or the empty slot where it belongs
+    [[nodiscard]] size_t FindSlot(std::string_view word, size_t hash) const;
+
+    std::string_view StoreWord(std::string_view word);
+
+    void AppendWord(std::string_view word);
+
+    void Grow();
+};
+
+// Immutable sorted set of terms stored with front coding: terms are grouped into blocks,
+// the first term of a block is stored as is, the rest as (shared prefix length, suffix).
+// Lookups binary search the block heads and decode at most one block per step.
+class FrontCodedDictionary {
+public:
+    explicit FrontCodedDictionary(std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+    // 'sorted_terms' must be sorted and free of duplicates
+    explicit FrontCodedDictionary(const std::vector<std::string_view>& sorted_terms,
+                                  std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+    [[nodiscard]] size_t size() const;
+    [[nodiscard]] bool empty() const;
+    [[nodiscard]] size_t GetByteSize() const;
+
+    // Calls 'callback(std::string_view term)' for the terms starting with 'prefix' in sorted order
+    // until 'callback' returns false. The view is valid only during the call.
+    template <typename Callback>
+    void ForEachWithPrefix(std::string_view prefix, Callback callback) const {
+        std::string term;
+        for (size_t block = FindFirstBlock(prefix); block < block_offsets_.size(); ++block) {
+            const char* pos = data_.data() + block_offsets_[block];
+            const size_t block_size = std::min(BLOCK_SIZE, term_count_ - block * BLOCK_SIZE);
+            for (size_t i = 0; i < block_size; ++i) {
+                pos = DecodeNext(pos, i == 0, term);
+                if (term.compare(0, prefix.size(), prefix) < 0) {
+                    continue;
+                }
+                if (term.compare(0, prefix.size(), prefix) > 0 || !callback(std::string_view(term))) {
+                    return;
+                }
+            }
+        }
+    }
+
+private:
+    static constexpr size_t BLOCK_SIZE = 16;
+
+    std::pmr::string data_;
+    std::pmr::vector<uint32_t> block_offsets_;
+    size_t term_count_ = 0;
+
+    // Index of the last block whose head is less than 'prefix' (or 0)
+    [[nodiscard]] size_t FindFirstBlock(std::string_view prefix) const;
+
+    [[nodiscard]] std::string_view GetBlockHead(size_t block) const;
+
+    static const char* DecodeNext(const char* pos, bool is_block_head, std::string& term);
+};
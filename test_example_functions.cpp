@@ -1,6 +1,18 @@
 #include "test_example_functions.h"
 #include "search_server.h"
 #include "remove_duplicates.h"
+#include "string_processing.h"
+#include "corpus_loader.h"
+#include "thread_pool.h"
+#include "durable_search_server.h"
+#include "benchmark.h"
+#include "perf_counters.h"
+#include "perfect_hash_set.h"
+#include "term_dictionary.h"
+#include "query_server.h"
+#include "latency_histogram.h"
+#include "query_replay.h"
+#include "attribute_index.h"
 
 #include <algorithm>
 #include <cmath>
@@ -11,6 +23,20 @@
 #include <utility>
 #include <vector>
 #include <sstream>
+#include <fstream>
+#include <cstdio>
+#include <execution>
+#include <filesystem>
+#include <functional>
+#include <thread>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 void AssertImpl(bool value, const std::string& expr_str, const std::string& file, const std::string& func, unsigned line,
     const std::string& hint) {
@@ -239,6 +265,1501 @@ void TestRemoveDuplicates() {
     }
 }
 
+// The single-pass tokenizer must split exactly like operator>> and reject control characters
+void TestSplitIntoWords() {
+    const std::vector<std::string> texts = {
+        "",
+        "   ",
+        "cat",
+        " cat  in\tthe\ncity ",
+        "a\vb\fc\rd",
+        "exactly sixteen!",
+        "word-spanning-the-32-byte-block-boundary and a few more words after it",
+        std::string(100, 'x') + " " + std::string(33, 'y'),
+        "\xd0\xba\xd0\xbe\xd1\x82 \xd0\xb8 \xd0\xbf\xd1\x91\xd1\x81",
+    };
+    for (const std::string& text : texts) {
+        std::vector<std::string_view> words;
+        ASSERT_HINT(SplitIntoWordsChecked(text, words), text);
+        ASSERT(std::vector<std::string>(words.begin(), words.end()) == SplitToWords(text));
+        ASSERT(SplitIntoWords(text) == SplitToWords(text));
+    }
+
+    std::vector<std::string_view> words;
+    ASSERT(!SplitIntoWordsChecked(std::string(40, 'a') + "\x01", words));
+    ASSERT(!SplitIntoWordsChecked(std::string("cat\x1f"), words));
+
+    SearchServer server;
+    ASSERT(server.FindTopDocuments("cat\tcity").empty());
+    try {
+        server.AddDocument(1, "cat in the cit\x12y", DocumentStatus::ACTUAL, { 1 });
+        ASSERT_HINT(false, "control characters in a document must be rejected");
+    }
+    catch (const std::invalid_argument&) {
+    }
+    try {
+        ASSERT(server.FindTopDocuments("cat --city").empty());
+        ASSERT_HINT(false, "double minus in a query must be rejected");
+    }
+    catch (const std::invalid_argument&) {
+    }
+}
+
+// Words ending with '*' match every indexed word with that prefix, both before and after the dictionary rebuild
+void TestPrefixQuery() {
+    SearchServer server(std::string("and"));
+    server.AddDocument(1, "pet and petunia", DocumentStatus::ACTUAL, { 5 });
+    server.AddDocument(2, "petrol car", DocumentStatus::ACTUAL, { 4 });
+    server.AddDocument(3, "curly cat", DocumentStatus::ACTUAL, { 3 });
+    server.AddDocument(4, "pest control", DocumentStatus::BANNED, { 2 });
+
+    std::vector<Document> found = server.FindTopDocuments("pet*");
+    ASSERT_EQUAL(found.size(), 2);
+    ASSERT(found[0].id == 1 || found[1].id == 1);
+    ASSERT(found[0].id == 2 || found[1].id == 2);
+    ASSERT(server.FindTopDocuments("pet* -petr*").size() == 1);
+    ASSERT(server.FindTopDocuments("pe* -car", DocumentStatus::BANNED).size() == 1);
+    ASSERT(server.FindTopDocuments("dog*").empty());
+
+    const auto [matched, status] = server.MatchDocument("pet* cat", 1);
+    ASSERT(IsVectorsAreSimilar(matched, std::vector<std::string>{ "pet", "petunia" }));
+    ASSERT(std::get<0>(server.MatchDocument("pet* -cu*", 3)).empty());
+
+    // Enough new words to rebuild the sorted dictionary, then make one of the old words disappear
+    for (int id = 10; id < 410; ++id) {
+        server.AddDocument(id, "word" + std::to_string(id), DocumentStatus::ACTUAL, { 1 });
+    }
+    server.RemoveDocument(2);
+    found = server.FindTopDocuments("pet*");
+    ASSERT_EQUAL(found.size(), 1);
+    ASSERT_EQUAL(found[0].id, 1);
+    server.AddDocument(2, "petrol car", DocumentStatus::ACTUAL, { 4 });
+    ASSERT_EQUAL(server.FindTopDocuments("petr*").size(), 1);
+    ASSERT_EQUAL(server.FindTopDocuments("word3*").size(), MAX_RESULT_DOCUMENT_COUNT);
+    ASSERT_EQUAL(std::get<0>(server.MatchDocument("word*", 399)).size(), 0);
+    ASSERT_EQUAL(std::get<0>(server.MatchDocument("word*", 10)).size(), 1);
+
+    // Overlapping prefixes count a word once, minus-prefixes exclude past the expansion cap
+    ASSERT(std::abs(server.FindTopDocuments("pe* pet*").at(0).relevance - server.FindTopDocuments("pe*").at(0).relevance) < 1e-6);
+    ASSERT_EQUAL(std::get<0>(server.MatchDocument("pe* pet*", 1)).size(), 2);
+    server.AddDocument(500, "pet word409", DocumentStatus::ACTUAL, { 1 });
+    ASSERT_EQUAL(server.FindTopDocuments("pet").size(), 2);
+    ASSERT_EQUAL(server.FindTopDocuments("pet -word*").size(), 1);
+    ASSERT_EQUAL(server.FindTopDocuments("+pet -word*").size(), 1);
+    ASSERT(std::get<0>(server.MatchDocument("pet -word*", 500)).empty());
+
+    try {
+        ASSERT(server.FindTopDocuments("pet -*").empty());
+        ASSERT_HINT(false, "a bare wildcard must be rejected");
+    }
+    catch (const std::invalid_argument&) {
+    }
+}
+
+// Both corpus formats must load the same documents as AddDocument would
+void TestLoadCorpus() {
+    const std::string tsv_path = "search_server_test_corpus.tsv";
+    const std::string jsonl_path = "search_server_test_corpus.jsonl";
+    {
+        std::ofstream tsv(tsv_path, std::ios::binary);
+        tsv << "1\tACTUAL\t7 2 7\tfunny pet and nasty rat\n"
+            << "2\tBANNED\t1,2\tfunny pet with curly hair\r\n"
+            << "\n"
+            << "3\t0\t\tcurly dog";
+        std::ofstream jsonl(jsonl_path, std::ios::binary);
+        jsonl << R"({"id": 1, "status": "ACTUAL", "ratings": [7, 2, 7], "text": "funny pet and nasty rat"})" << '\n'
+              << R"({"text": "funny \"pet\" with\tcurly hair", "id": 2, "status": 2, "ratings": [1, 2]})" << '\n'
+              << R"({"id": 3, "text": "curly dog"})" << '\n';
+    }
+
+    for (const auto& [path, format] : { std::pair{ tsv_path, CorpusFormat::TSV }, std::pair{ jsonl_path, CorpusFormat::JSONL } }) {
+        SearchServer server(std::string("and with"));
+        size_t progress_calls = 0;
+        const CorpusLoadStats stats = LoadCorpus(server, path, format, [&progress_calls](const CorpusLoadProgress& progress) {
+            ASSERT(progress.bytes_done <= progress.bytes_total);
+            ++progress_calls;
+        }, 2);
+        ASSERT_EQUAL(stats.documents, 3);
+        ASSERT_EQUAL(progress_calls, 2);
+        ASSERT_EQUAL(server.GetDocumentCount(), 3u);
+
+        const std::vector<Document> found = server.FindTopDocuments("curly");
+        ASSERT_EQUAL(found.size(), 1);
+        ASSERT_EQUAL(found[0].id, 3);
+        ASSERT_EQUAL(server.FindTopDocuments("pet").at(0).rating, 5);
+        ASSERT_EQUAL(server.FindTopDocuments("hair", DocumentStatus::BANNED).size(), 1);
+        std::remove(path.c_str());
+    }
+
+    // Escaped keys and statuses after the text must not overwrite it, a surrogate pair is one code point
+    std::ofstream(jsonl_path) << R"({"text": "caf\u00e9 dog smile\ud83d\ude00", "st\u0061tus": "B\u0041NNED", "id": 4})";
+    {
+        SearchServer server;
+        LoadCorpus(server, jsonl_path, CorpusFormat::JSONL);
+        ASSERT_EQUAL(server.FindTopDocuments("dog", DocumentStatus::BANNED).size(), 1);
+        const auto [matched, status] = server.MatchDocument("caf\xC3\xA9 smile\xF0\x9F\x98\x80", 4);
+        ASSERT_EQUAL(matched.size(), 2);
+        ASSERT(status == DocumentStatus::BANNED);
+    }
+    std::remove(jsonl_path.c_str());
+
+    std::ofstream(tsv_path) << "1\tACTUAL\tseven\tfunny pet\n";
+    try {
+        SearchServer server;
+        LoadCorpus(server, tsv_path, CorpusFormat::TSV);
+        ASSERT_HINT(false, "malformed ratings must be rejected");
+    }
+    catch (const std::invalid_argument&) {
+    }
+
+    // Batches are tokenized in parallel, but a failing record still stops the load right before it
+    for (const std::string& bad_line : { std::string("4\tACTUAL\tseven\tfunny pet"), std::string("4\tACTUAL\t1\tfunny \x01pet") }) {
+        std::ofstream(tsv_path) << "1\tACTUAL\t1\tcat\n2\tACTUAL\t1\tdog\n3\tACTUAL\t1\tparrot\n" << bad_line << "\n5\tACTUAL\t1\trat\n";
+        SearchServer server;
+        try {
+            LoadCorpus(server, tsv_path, CorpusFormat::TSV, {}, 2);
+            ASSERT_HINT(false, "a failing record must stop the load");
+        }
+        catch (const std::invalid_argument&) {
+        }
+        ASSERT_EQUAL(server.GetDocumentCount(), 3u);
+    }
+    std::remove(tsv_path.c_str());
+}
+
+// Asynchronous search must return the same documents as the synchronous one and honour cancellation
+void TestFindTopDocumentsAsync() {
+    {
+        ThreadPool pool(3);
+        std::vector<std::future<std::future<int>>> results;
+        for (int i = 0; i < 100; ++i) {
+            results.push_back(pool.Submit([&pool, i] {
+                // Nested tasks go to the worker's own deque and may be stolen by the others
+                return pool.Submit([i] { return i * 2; });
+            }));
+        }
+        int sum = 0;
+        for (auto& result : results) {
+            sum += result.get().get();
+        }
+        ASSERT_EQUAL(sum, 100 * 99);
+    }
+
+    const SearchServer server = CreateTestServer();
+    const std::string query = "\xef\xf3\xf8\xe8\xf1\xf2\xfb\xe9 \xea\xee\xf2 \xe2\xfb\xf0\xe0\xe7\xe8\xf2\xe5\xeb\xfc\xed\xfb\xe5 \xe3\xeb\xe0\xe7\xe0";
+    std::vector<std::future<std::vector<Document>>> futures;
+    for (int i = 0; i < 16; ++i) {
+        futures.push_back(server.FindTopDocumentsAsync(query));
+    }
+    const std::vector<Document> expected = server.FindTopDocuments(query);
+    for (auto& future : futures) {
+        const std::vector<Document> found = future.get();
+        ASSERT_EQUAL(found.size(), expected.size());
+        for (size_t i = 0; i < found.size(); ++i) {
+            ASSERT_EQUAL(found[i].id, expected[i].id);
+        }
+    }
+    ASSERT_EQUAL(server.FindTopDocumentsAsync(query, DocumentStatus::IRRELEVANT).get().size(),
+                 server.FindTopDocuments(query, DocumentStatus::IRRELEVANT).size());
+
+    const CancellationToken token = CancellationToken::Create();
+    token.Cancel();
+    try {
+        (void)server.FindTopDocumentsAsync(query, DocumentStatus::ACTUAL, token).get();
+        ASSERT_HINT(false, "a cancelled query must not return results");
+    }
+    catch (const OperationCancelled&) {
+    }
+}
+
+// A budgeted search scores the rarest words first and reports when it had to stop early
+void TestSearchBudget() {
+    SearchServer server;
+    for (int id = 0; id < 100; ++id) {
+        server.AddDocument(id, id < 3 ? "rare common" : "common", DocumentStatus::ACTUAL, { id });
+    }
+    server.AddDocument(100, "rare", DocumentStatus::ACTUAL, { 0 });
+
+    const SearchResult full = server.FindTopDocuments("rare common -blocked", SearchBudget{});
+    ASSERT(!full.is_approximate);
+    const std::vector<Document> exhaustive = server.FindTopDocuments("rare common -blocked");
+    ASSERT_EQUAL(full.documents.size(), exhaustive.size());
+    for (size_t i = 0; i < exhaustive.size(); ++i) {
+        ASSERT_EQUAL(full.documents[i].id, exhaustive[i].id);
+    }
+
+    // Only the postings of 'rare' fit into the budget, and they decide the top documents anyway
+    SearchBudget budget;
+    budget.max_postings = 4;
+    const SearchResult partial = server.FindTopDocuments("rare common", budget);
+    ASSERT(partial.is_approximate);
+    ASSERT_EQUAL(partial.documents.size(), 4);
+    ASSERT_EQUAL(partial.documents[0].id, exhaustive[0].id);
+
+    budget.max_postings = 2;
+    const SearchResult excluded = server.FindTopDocuments("rare -common", budget);
+    ASSERT(excluded.is_approximate);
+    ASSERT(excluded.documents.empty());
+
+    budget = SearchBudget{};
+    budget.time = std::chrono::steady_clock::duration::zero();
+    const SearchResult expired = server.FindTopDocuments("rare common", DocumentStatus::ACTUAL, budget);
+    ASSERT(expired.is_approximate);
+    ASSERT(expired.documents.empty());
+
+    // Required words intersect under the same budget
+    const SearchResult required_expired = server.FindTopDocuments("+common rare", DocumentStatus::ACTUAL, budget);
+    ASSERT(required_expired.is_approximate);
+    ASSERT(required_expired.documents.empty());
+    budget = SearchBudget{};
+    const SearchResult required_full = server.FindTopDocuments("+common +rare", budget);
+    ASSERT(!required_full.is_approximate);
+    ASSERT_EQUAL(required_full.documents.size(), 3);
+    budget.max_postings = 4;
+    const SearchResult required_partial = server.FindTopDocuments("+common +rare", budget);
+    ASSERT(required_partial.is_approximate);
+    ASSERT_EQUAL(required_partial.documents.size(), 2);
+}
+
+// Sealing, merging and deleting across segments must not change search results
+void TestSegmentedIndex() {
+    const std::vector<std::string> words = { "cat", "dog", "rat", "pet", "fur", "tail", "paw", "nose" };
+    const auto make_text = [&words](int id) {
+        std::string text;
+        for (size_t i = 0; i < words.size(); ++i) {
+            if ((id >> i) % 3 != 0) {
+                text += words[i] + " ";
+            }
+        }
+        return text + words[id % words.size()];
+    };
+    const std::vector<std::string> queries = { "cat dog -rat", "tail paw nose", "pe* -do*", "fur", "cat -cat" };
+
+    IndexOptions tiered;
+    tiered.segment_max_documents = 4;
+    tiered.merge_factor = 3;
+    IndexOptions log_structured = tiered;
+    log_structured.merge_policy = MergePolicy::LOG_STRUCTURED;
+    log_structured.merge_factor = 2;
+    IndexOptions background = tiered;
+    background.background_merge = true;
+
+    for (const IndexOptions& options : { tiered, log_structured, background }) {
+        SearchServer reference;
+        SearchServer server(options);
+        for (int id = 0; id < 200; ++id) {
+            reference.AddDocument(id, make_text(id), DocumentStatus::ACTUAL, { id % 7 });
+            server.AddDocument(id, make_text(id), DocumentStatus::ACTUAL, { id % 7 });
+        }
+        for (int id = 0; id < 200; id += 3) {
+            reference.RemoveDocument(id);
+            server.RemoveDocument(id);
+        }
+        for (int id = 0; id < 60; id += 6) {
+            reference.AddDocument(id, make_text(id + 1), DocumentStatus::ACTUAL, { 1 });
+            server.AddDocument(id, make_text(id + 1), DocumentStatus::ACTUAL, { 1 });
+        }
+        server.WaitForMerges();
+        ASSERT(server.GetSegmentCount() > 1);
+        ASSERT(server.GetSegmentCount() < 200 / options.segment_max_documents);
+        ASSERT_EQUAL(server.GetDocumentCount(), reference.GetDocumentCount());
+
+        for (const std::string& query : queries) {
+            const std::vector<Document> expected = reference.FindTopDocuments(query);
+            const std::vector<Document> found = server.FindTopDocuments(query);
+            ASSERT_EQUAL_HINT(found.size(), expected.size(), query);
+            for (size_t i = 0; i < found.size(); ++i) {
+                ASSERT_EQUAL_HINT(found[i].id, expected[i].id, query);
+                ASSERT_EQUAL_HINT(found[i].relevance, expected[i].relevance, query);
+            }
+            for (const int id : reference) {
+                ASSERT(std::get<0>(server.MatchDocument(query, id)) == std::get<0>(reference.MatchDocument(query, id)));
+            }
+        }
+    }
+}
+
+void TestWriteAheadLog() {
+    const std::filesystem::path directory = std::filesystem::temp_directory_path() / ("search_server_wal_" + std::to_string(getpid()));
+    std::filesystem::remove_all(directory);
+    const auto check_same = [](const SearchServer& server, const SearchServer& reference) {
+        ASSERT_EQUAL(server.GetDocumentCount(), reference.GetDocumentCount());
+        for (const std::string query : { "cat in the city", "fluffy dog -cat", "well* groomed" }) {
+            const std::vector<Document> expected = reference.FindTopDocuments(query);
+            const std::vector<Document> found = server.FindTopDocuments(query);
+            ASSERT_EQUAL_HINT(found.size(), expected.size(), query);
+            for (size_t i = 0; i < found.size(); ++i) {
+                ASSERT_EQUAL_HINT(found[i].id, expected[i].id, query);
+                ASSERT_EQUAL_HINT(found[i].relevance, expected[i].relevance, query);
+                ASSERT_EQUAL_HINT(found[i].rating, expected[i].rating, query);
+            }
+        }
+    };
+
+    SearchServer reference(std::string("in the"));
+    {
+        DurableSearchServer server(directory.string());
+        server.SetStopWords("in the");
+        const std::vector<std::tuple<int, std::string, std::vector<int>>> documents = {
+            { 1, "white cat in the city", { 8, -3 } },
+            { 2, "fluffy cat fluffy tail", { 7, 2, 7 } },
+            { 3, "well groomed dog", { 5, -12, 2, 1 } },
+        };
+        for (const auto& [id, text, ratings] : documents) {
+            server.AddDocument(id, text, DocumentStatus::ACTUAL, ratings);
+            reference.AddDocument(id, text, DocumentStatus::ACTUAL, ratings);
+        }
+        server.RemoveDocument(2);
+        reference.RemoveDocument(2);
+        try {
+            server.AddDocument(1, "duplicate", DocumentStatus::ACTUAL, {});
+            ASSERT_HINT(false, "duplicate id must be rejected");
+        }
+        catch (const std::invalid_argument&) {
+        }
+    }
+    {
+        DurableSearchServer server(directory.string());
+        ASSERT_EQUAL(server.GetRecoveryStats().snapshot_documents, 0u);
+        // The rejected duplicate was never logged
+        ASSERT_EQUAL(server.GetRecoveryStats().replayed_records, 5u);
+        check_same(server.GetServer(), reference);
+
+        server.Checkpoint();
+        server.AddDocument(4, "fluffy dog in the city", DocumentStatus::ACTUAL, { 3 });
+        reference.AddDocument(4, "fluffy dog in the city", DocumentStatus::ACTUAL, { 3 });
+    }
+    {
+        // A record torn by a crash is cut off
+        std::ofstream(directory / "wal", std::ios::binary | std::ios::app) << "\x30\x00\x00\x00garbage";
+        DurableSearchServer server(directory.string());
+        ASSERT_EQUAL(server.GetRecoveryStats().snapshot_documents, 2u);
+        ASSERT_EQUAL(server.GetRecoveryStats().replayed_records, 1u);
+        check_same(server.GetServer(), reference);
+        server.AddDocument(5, "groomed cat", DocumentStatus::BANNED, { 1 });
+        reference.AddDocument(5, "groomed cat", DocumentStatus::BANNED, { 1 });
+    }
+    {
+        DurableSearchServer server(directory.string());
+        ASSERT_EQUAL(server.GetRecoveryStats().replayed_records, 2u);
+        check_same(server.GetServer(), reference);
+
+        // Concurrent writers share fsyncs
+        std::vector<std::thread> writers;
+        for (int thread = 0; thread < 4; ++thread) {
+            writers.emplace_back([&server, thread] {
+                for (int i = 0; i < 25; ++i) {
+                    server.AddDocument(100 + thread * 25 + i, "cat number " + std::to_string(i), DocumentStatus::ACTUAL, { i });
+                }
+            });
+        }
+        for (std::thread& writer : writers) {
+            writer.join();
+        }
+        ASSERT(server.GetSyncCount() <= 100u);
+    }
+    ASSERT_EQUAL(DurableSearchServer(directory.string()).GetServer().GetDocumentCount(), 104u);
+    std::filesystem::remove_all(directory);
+
+    // Every change acknowledged before the process is killed survives.
+    // Earlier tests have started the shared thread pool, whose workers don't exist in a forked child, so the
+    // children must never reach it. The only use of it on their path is the replay, which they skip since
+    // they recover from an empty directory; a child that replays anything exits at once.
+    ASSERT(!std::filesystem::exists(directory));
+    const auto is_nothing_replayed = [](const DurableSearchServer& server) {
+        return server.GetRecoveryStats().snapshot_documents == 0 && server.GetRecoveryStats().replayed_records == 0;
+    };
+    int acknowledgements[2];
+    ASSERT(pipe(acknowledgements) == 0);
+    const pid_t child = fork();
+    if (child == 0) {
+        close(acknowledgements[0]);
+        DurableSearchServer server(directory.string());
+        if (!is_nothing_replayed(server)) {
+            _exit(1);
+        }
+        for (int id = 0;; ++id) {
+            server.AddDocument(id, "document number " + std::to_string(id), DocumentStatus::ACTUAL, { id });
+            if (id % 2 == 1) {
+                server.RemoveDocument(id - 1);
+            }
+            if (write(acknowledgements[1], &id, sizeof(id)) != sizeof(id)) {
+                _exit(1);
+            }
+        }
+    }
+    close(acknowledgements[1]);
+    int last_acknowledged = -1;
+    for (int id = 0; last_acknowledged < 40 && read(acknowledgements[0], &id, sizeof(id)) == sizeof(id);) {
+        last_acknowledged = id;
+    }
+    kill(child, SIGKILL);
+    waitpid(child, nullptr, 0);
+    close(acknowledgements[0]);
+    ASSERT(last_acknowledged >= 40);
+
+    const DurableSearchServer server(directory.string());
+    for (int id = 1; id <= last_acknowledged; id += 2) {
+        ASSERT(std::get<0>(server.GetServer().MatchDocument("document", id)) == std::vector<std::string>{ "document" });
+        ASSERT(server.GetServer().GetWordFrequencies(id - 1).empty());
+    }
+    std::filesystem::remove_all(directory);
+
+    // Once the log can't be written every change and checkpoint is refused, the failed one is lost on restart
+    const pid_t failing_child = fork();
+    if (failing_child == 0) {
+        signal(SIGXFSZ, SIG_IGN);
+        DurableSearchServer failing_server(directory.string());
+        if (!is_nothing_replayed(failing_server)) {
+            _exit(1);
+        }
+        failing_server.AddDocument(1, "small document", DocumentStatus::ACTUAL, { 1 });
+        const rlimit file_size_limit{ 4096, 4096 };
+        ASSERT(setrlimit(RLIMIT_FSIZE, &file_size_limit) == 0);
+        bool is_failed = false;
+        try {
+            failing_server.AddDocument(2, std::string(8192, 'x'), DocumentStatus::ACTUAL, { 1 });
+        }
+        catch (const std::system_error&) {
+            is_failed = true;
+        }
+        ASSERT(is_failed);
+        for (const auto& change : std::vector<std::function<void()>>{
+                 [&failing_server] { failing_server.AddDocument(3, "refused document", DocumentStatus::ACTUAL, { 1 }); },
+                 [&failing_server] { failing_server.RemoveDocument(1); },
+                 [&failing_server] { failing_server.Checkpoint(); } }) {
+            try {
+                change();
+                ASSERT_HINT(false, "changes after a failed log write must be refused");
+            }
+            catch (const std::runtime_error&) {
+            }
+        }
+        ASSERT_EQUAL(failing_server.GetServer().GetDocumentCount(), 2u);
+        _exit(0);
+    }
+    int failing_status = 0;
+    waitpid(failing_child, &failing_status, 0);
+    ASSERT(WIFEXITED(failing_status) && WEXITSTATUS(failing_status) == 0);
+    ASSERT_EQUAL(DurableSearchServer(directory.string()).GetServer().GetDocumentCount(), 1u);
+    ASSERT(!std::filesystem::exists(directory / "snapshot"));
+    std::filesystem::remove_all(directory);
+}
+
+void TestRequiredWords() {
+    const std::vector<std::string> words = { "cat", "dog", "rat", "pet", "fur", "tail", "paw", "nose" };
+    IndexOptions options;
+    options.segment_max_documents = 16;
+    SearchServer server(std::string("and with"), options);
+    for (int id = 0; id < 300; ++id) {
+        std::string text = "and";
+        for (size_t i = 0; i < words.size(); ++i) {
+            if ((id * 7 + 3) % (i + 2) == 0) {
+                text += " " + words[i];
+            }
+        }
+        server.AddDocument(id, text + " " + words[id % words.size()], static_cast<DocumentStatus>(id % 3), { id % 11 });
+    }
+    for (int id = 0; id < 300; id += 5) {
+        server.RemoveDocument(id);
+    }
+
+    // The same as the union query restricted to documents having all required words
+    const std::vector<std::pair<std::string, std::vector<std::string>>> queries = {
+        { "+cat +dog", { "cat", "dog" } },
+        { "+cat dog rat -paw", { "cat" } },
+        { "+tail +paw +nose fur", { "tail", "paw", "nose" } },
+        { "+pet p* -no*", { "pet" } },
+        { "+and cat", {} },
+    };
+    for (const auto& [query, required] : queries) {
+        std::string union_query = query;
+        union_query.erase(std::remove(union_query.begin(), union_query.end(), '+'), union_query.end());
+        for (const DocumentStatus status : { DocumentStatus::ACTUAL, DocumentStatus::IRRELEVANT }) {
+            const std::vector<Document> found = server.FindTopDocuments(query, status);
+            const std::vector<Document> expected = server.FindTopDocuments(union_query, [&](int id, DocumentStatus document_status, int) {
+                const WordFrequencies word_freqs = server.GetWordFrequencies(id);
+                return document_status == status && std::all_of(required.begin(), required.end(), [&word_freqs](const std::string& word) {
+                    return std::any_of(word_freqs.begin(), word_freqs.end(), [&word](const auto& word_freq) {
+                        return word_freq.first == word;
+                    });
+                });
+            });
+            ASSERT_EQUAL_HINT(found.size(), expected.size(), query);
+            for (size_t i = 0; i < found.size(); ++i) {
+                ASSERT_EQUAL_HINT(found[i].id, expected[i].id, query);
+                ASSERT_EQUAL_HINT(found[i].relevance, expected[i].relevance, query);
+            }
+        }
+        const SearchResult budgeted = server.FindTopDocuments(query, SearchBudget{});
+        ASSERT_EQUAL_HINT(budgeted.documents.size(), server.FindTopDocuments(query).size(), query);
+    }
+    ASSERT(server.FindTopDocuments("+cat +unknown").empty());
+
+    for (const int id : server) {
+        const WordFrequencies word_freqs = server.GetWordFrequencies(id);
+        const auto [matched, status] = server.MatchDocument("+cat dog", id);
+        ASSERT_EQUAL(matched.empty(), std::none_of(word_freqs.begin(), word_freqs.end(), [](const auto& word_freq) {
+            return word_freq.first == "cat";
+        }));
+    }
+
+    for (const std::string query : { "+", "++cat", "+-cat", "-+cat", "+cat*" }) {
+        try {
+            ASSERT(server.FindTopDocuments(query).empty());
+            ASSERT_HINT(false, query);
+        }
+        catch (const std::invalid_argument&) {
+        }
+    }
+}
+
+void TestMemoryStats() {
+    IndexOptions options;
+    options.segment_max_documents = 8;
+    options.background_merge = true;
+    SearchServer server(std::string("and with"), options);
+    const MemoryStats empty = server.GetMemoryStats();
+    ASSERT(empty.stop_words.bytes > 0);
+    ASSERT_EQUAL(empty.forward_index.bytes, 0u);
+    ASSERT_EQUAL(empty.documents.allocations, 0u);
+    ASSERT_EQUAL(empty.distinct_terms, 0u);
+    ASSERT_EQUAL(empty.GetAveragePostingsPerTerm(), 0.0);
+
+    for (int id = 0; id < 100; ++id) {
+        server.AddDocument(id, "cat and dog number" + std::to_string(id % 10), DocumentStatus::ACTUAL, { id });
+    }
+    server.WaitForMerges();
+    const MemoryStats full = server.GetMemoryStats();
+    // cat, dog and ten numbers, three words in every document
+    ASSERT_EQUAL(full.distinct_terms, 12u);
+    ASSERT_EQUAL(full.total_postings, 300u);
+    ASSERT_EQUAL(full.GetAveragePostingsPerTerm(), 25.0);
+    // A node per document
+    ASSERT_EQUAL(full.documents.allocations, 100u);
+    ASSERT(full.forward_index.bytes >= 300 * sizeof(TermFrequency));
+    ASSERT(full.inverted_index.bytes >= 300 * sizeof(Posting));
+    ASSERT(full.term_dictionary.bytes > 0);
+    ASSERT(full.document_ids.bytes >= 100 * sizeof(int));
+    ASSERT_EQUAL(full.GetTotal().bytes, full.stop_words.bytes + full.term_dictionary.bytes + full.inverted_index.bytes
+                                        + full.forward_index.bytes + full.documents.bytes + full.document_ids.bytes
+                                        + full.attributes.bytes);
+
+    for (int id = 0; id < 100; ++id) {
+        server.RemoveDocument(id);
+    }
+    const MemoryStats removed = server.GetMemoryStats();
+    // Only the bucket array of the document hash table is left, the arena is released
+    ASSERT(removed.forward_index.allocations <= 1u);
+    ASSERT_EQUAL(removed.documents.bytes, 0u);
+    ASSERT_EQUAL(removed.distinct_terms, 0u);
+
+    BenchmarkOptions benchmark;
+    benchmark.document_count = 200;
+    benchmark.vocabulary_size = 100;
+    benchmark.query_count = 20;
+    std::ostringstream report;
+    const BenchmarkResult result = RunBenchmark(benchmark, report);
+    ASSERT(result.found_documents > 0);
+    ASSERT(result.memory.inverted_index.bytes > 0);
+    ASSERT(report.str().find("inverted index") != std::string::npos);
+}
+
+void TestTombstoneVacuum() {
+    IndexOptions options;
+    options.segment_max_documents = 4;
+    options.merge_factor = 8;
+    options.vacuum_threshold = 0.5;
+    {
+        SegmentedIndex index(options);
+        for (int id = 0; id < 14; ++id) {
+            index.AddDocument(id, { { 1, 0.5 }, { static_cast<TermId>(id % 2 + 2), 0.5 } });
+        }
+        ASSERT_EQUAL(index.GetSegmentCount(), 3u);
+        ASSERT_EQUAL(index.GetPostingCount(), 28u);
+        const auto count_postings = [&index](TermId term) {
+            size_t count = 0;
+            index.Read().ForEachPosting(term, [&count](int, double) {
+                ++count;
+            });
+            return count;
+        };
+
+        // Deletes only leave tombstones until a segment is half deleted
+        index.RemoveDocument(0);
+        index.RemoveDocument(1);
+        ASSERT_EQUAL(index.GetDeletedDocumentCount(), 2u);
+        ASSERT_EQUAL(index.GetPostingCount(), 28u);
+        ASSERT_EQUAL(count_postings(1), 12u);
+        ASSERT(!index.Read().HasPosting(1, 0));
+        index.RemoveDocument(2);
+        ASSERT_EQUAL(index.GetDeletedDocumentCount(), 0u);
+        ASSERT_EQUAL(index.GetPostingCount(), 22u);
+        ASSERT_EQUAL(count_postings(1), 11u);
+        ASSERT_EQUAL(index.GetSegmentCount(), 3u);
+
+        // A segment left without live documents disappears
+        index.RemoveDocument(3);
+        ASSERT_EQUAL(index.GetSegmentCount(), 2u);
+
+        // Same for the write segment, which holds documents 12 and 13
+        index.RemoveDocument(12);
+        ASSERT_EQUAL(index.GetDeletedDocumentCount(), 1u);
+        ASSERT(!index.Read().HasPosting(1, 12));
+        // A deleted document added again replaces its old postings
+        index.AddDocument(12, { { 4, 1.0 } });
+        ASSERT_EQUAL(index.GetDeletedDocumentCount(), 0u);
+        ASSERT(!index.Read().HasPosting(1, 12));
+        ASSERT(index.Read().HasPosting(4, 12));
+        ASSERT_EQUAL(count_postings(1), 9u);
+    }
+
+    // Results and IDF don't depend on when tombstones are vacuumed
+    IndexOptions never = options;
+    never.vacuum_threshold = 1;
+    IndexOptions eager = options;
+    eager.vacuum_threshold = 0;
+    IndexOptions background = options;
+    background.vacuum_threshold = 0.1;
+    background.background_merge = true;
+    std::vector<SearchServer> servers;
+    for (const IndexOptions& server_options : { never, eager, background }) {
+        servers.emplace_back(server_options);
+    }
+    const std::vector<std::string> words = { "cat", "dog", "rat", "pet", "fur" };
+    for (SearchServer& server : servers) {
+        for (int id = 0; id < 120; ++id) {
+            server.AddDocument(id, words[id % 5] + " " + words[id % 3] + " " + words[id % 2], DocumentStatus::ACTUAL, { id });
+        }
+        for (int id = 0; id < 120; id += 2) {
+            server.RemoveDocument(id);
+        }
+        for (int id = 0; id < 40; id += 4) {
+            server.AddDocument(id, "fur " + words[id % 4], DocumentStatus::ACTUAL, { 1 });
+        }
+        server.WaitForMerges();
+    }
+    for (const std::string query : { "cat", "dog rat -pet", "fur cat", "+fur +dog" }) {
+        const std::vector<Document> expected = servers[0].FindTopDocuments(query);
+        for (const SearchServer& server : servers) {
+            ASSERT_EQUAL(server.GetDocumentCount(), servers[0].GetDocumentCount());
+            const std::vector<Document> found = server.FindTopDocuments(query);
+            ASSERT_EQUAL_HINT(found.size(), expected.size(), query);
+            for (size_t i = 0; i < found.size(); ++i) {
+                ASSERT_EQUAL_HINT(found[i].id, expected[i].id, query);
+                ASSERT_EQUAL_HINT(found[i].relevance, expected[i].relevance, query);
+            }
+        }
+    }
+}
+
+void TestMatchDocuments() {
+    SearchServer server(std::string("and with"));
+    const std::vector<std::string> words = { "cat", "dog", "rat", "pet", "fur", "paw" };
+    std::vector<int> ids;
+    for (int id = 0; id < 500; ++id) {
+        std::string text = "and";
+        for (size_t i = 0; i < words.size(); ++i) {
+            if ((id >> i) & 1) {
+                text += " " + words[i];
+            }
+        }
+        server.AddDocument(id, text, static_cast<DocumentStatus>(id % 4), { id });
+        ids.push_back(id);
+    }
+    for (int id = 0; id < 500; id += 7) {
+        server.RemoveDocument(id);
+        ids.erase(std::find(ids.begin(), ids.end(), id));
+    }
+
+    for (const std::string query : { "cat dog", "cat -rat", "p* -fur", "+pet cat", "+unknown cat", "and" }) {
+        std::vector<MatchedDocument> sequential;
+        std::vector<MatchedDocument> parallel;
+        {
+            // The words don't refer to the query text
+            std::string query_copy = query;
+            sequential = server.MatchDocuments(query_copy, ids);
+            parallel = server.MatchDocuments(std::execution::par, query_copy, ids);
+        }
+        ASSERT_EQUAL(sequential.size(), ids.size());
+        ASSERT_EQUAL(parallel.size(), ids.size());
+        for (size_t i = 0; i < ids.size(); ++i) {
+            const auto [expected_words, expected_status] = server.MatchDocument(query, ids[i]);
+            for (const auto& [words_found, status] : { sequential[i], parallel[i] }) {
+                ASSERT(std::vector<std::string>(words_found.begin(), words_found.end()) == expected_words);
+                ASSERT(status == expected_status);
+            }
+        }
+    }
+
+    for (const std::vector<int>& bad_ids : { std::vector<int>{ 1, 7 }, std::vector<int>(300, 1000) }) {
+        try {
+            ASSERT(server.MatchDocuments(std::execution::par, "cat", bad_ids).empty());
+            ASSERT_HINT(false, "unknown ids must be rejected");
+        }
+        catch (const std::out_of_range&) {
+        }
+    }
+}
+
+void TestWordFrequencies() {
+    SearchServer server(std::string("and with"));
+    std::map<int, std::map<std::string, double>> expected;
+    for (int id = 0; id < 600; ++id) {
+        const std::string text = "cat and dog cat number" + std::to_string(id % 50) + " tail" + std::to_string(id % 7);
+        server.AddDocument(id, text, DocumentStatus::ACTUAL, { id });
+        for (const auto& [word, freq] : server.ComputeWordFrequencies(text)) {
+            expected[id].emplace(word, freq);
+        }
+    }
+    const auto check = [&server, &expected] {
+        for (const auto& [id, word_freqs] : expected) {
+            const WordFrequencies view = server.GetWordFrequencies(id);
+            ASSERT_EQUAL(view.size(), word_freqs.size());
+            const std::map<std::string, double> actual(view.begin(), view.end());
+            ASSERT(actual == word_freqs);
+        }
+    };
+    check();
+    ASSERT(server.GetWordFrequencies(600).empty());
+    ASSERT(server.GetWordFrequencies(-1).empty());
+
+    // Enough holes to compact the arena, the remaining documents keep their frequencies
+    for (int id = 0; id < 600; ++id) {
+        if (id % 3 != 0) {
+            server.RemoveDocument(id);
+            expected.erase(id);
+        }
+    }
+    ASSERT(server.GetWordFrequencies(1).empty());
+    check();
+    ASSERT(std::get<0>(server.MatchDocument("cat -tail3", 0)) == std::vector<std::string>{ "cat" });
+    ASSERT(std::get<0>(server.MatchDocument("cat -tail3", 3)).empty());
+
+    std::stringstream snapshot;
+    server.SaveSnapshot(snapshot);
+    SearchServer loaded;
+    loaded.LoadSnapshot(snapshot);
+    for (const auto& [id, word_freqs] : expected) {
+        const WordFrequencies view = loaded.GetWordFrequencies(id);
+        const std::map<std::string, double> actual(view.begin(), view.end());
+        ASSERT(actual == word_freqs);
+    }
+}
+
+void TestBenchmarkProfile() {
+    PerfCounters counters;
+    ASSERT(counters.IsAvailable() == counters.GetError().empty());
+    counters.Start();
+    volatile uint64_t sum = 0;
+    for (uint64_t i = 0; i < 100000; ++i) {
+        sum = sum + i;
+    }
+    const HardwareCounters measured = counters.Stop();
+    if (counters.IsAvailable()) {
+        ASSERT(measured.cycles || measured.instructions || measured.cache_misses || measured.branch_misses);
+        if (measured.instructions) {
+            ASSERT(*measured.instructions >= 100000u);
+        }
+    } else {
+        ASSERT(!measured.cycles && !measured.instructions);
+        ASSERT(!measured.GetInstructionsPerCycle());
+    }
+
+    BenchmarkOptions benchmark;
+    benchmark.document_count = 300;
+    benchmark.vocabulary_size = 100;
+    benchmark.query_count = 20;
+    benchmark.duplicate_share = 0.2;
+    benchmark.profile = true;
+    std::ostringstream report;
+    const BenchmarkResult result = RunBenchmark(benchmark, report);
+    ASSERT(result.removed_duplicates > 0);
+    ASSERT(result.removed_duplicates < benchmark.document_count);
+    ASSERT(report.str().find("RemoveDuplicates") != std::string::npos);
+    // Counters may be missing in containers and VMs, the benchmark still runs without them
+    ASSERT_EQUAL(result.query_profile.has_value(), counters.IsAvailable());
+    if (result.query_profile) {
+        ASSERT_EQUAL(result.query_profile->operations, benchmark.query_count);
+        ASSERT_EQUAL(result.add_profile->operations, benchmark.document_count);
+        ASSERT(report.str().find("IPC") != std::string::npos);
+    } else {
+        ASSERT(report.str().find("profiling skipped") != std::string::npos);
+    }
+
+    benchmark.profile = false;
+    ASSERT(!RunBenchmark(benchmark, report).add_profile);
+}
+
+void TestImpactOrderedPostings() {
+    IndexOptions exhaustive_options;
+    exhaustive_options.segment_max_documents = 16;
+    exhaustive_options.impact_ordered_postings = false;
+    IndexOptions impact_options = exhaustive_options;
+    impact_options.impact_ordered_postings = true;
+    SearchServer exhaustive(std::string("and"), exhaustive_options);
+    SearchServer impact(std::string("and"), impact_options);
+
+    // Few words and short documents make many equal term frequencies and ratings
+    const std::vector<std::string> words = { "cat", "dog", "rat", "fox", "owl", "bee" };
+    for (int id = 0; id < 300; ++id) {
+        std::string text;
+        const int word_count = 2 + id % 5;
+        for (int i = 0; i < word_count; ++i) {
+            text += words[(id * 7 + i * i * 3 + id / 11) % words.size()] + " ";
+        }
+        const DocumentStatus status = id % 9 == 0 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL;
+        const std::vector<int> ratings = { id % 4 };
+        exhaustive.AddDocument(id, text, status, ratings);
+        impact.AddDocument(id, text, status, ratings);
+    }
+    for (int id = 0; id < 300; id += 7) {
+        exhaustive.RemoveDocument(id);
+        impact.RemoveDocument(id);
+    }
+    ASSERT(impact.GetSegmentCount() > 1);
+
+    std::vector<std::string> queries = { "unknown", "cat unknown", "and cat", "cat -dog", "cat -d*", "-cat dog" };
+    for (const std::string& first : words) {
+        queries.push_back(first);
+        for (const std::string& second : words) {
+            queries.push_back(first + " " + second);
+        }
+    }
+    const auto is_even = [](int id, DocumentStatus, int) {
+        return id % 2 == 0;
+    };
+    for (const std::string& query : queries) {
+        for (const auto& [found, expected] : {
+                std::pair{ impact.FindTopDocuments(query), exhaustive.FindTopDocuments(query) },
+                std::pair{ impact.FindTopDocuments(query, DocumentStatus::BANNED), exhaustive.FindTopDocuments(query, DocumentStatus::BANNED) },
+                std::pair{ impact.FindTopDocuments(query, is_even), exhaustive.FindTopDocuments(query, is_even) } }) {
+            ASSERT_EQUAL_HINT(found.size(), expected.size(), query);
+            for (size_t i = 0; i < found.size(); ++i) {
+                ASSERT_EQUAL_HINT(found[i].id, expected[i].id, query);
+                ASSERT_EQUAL_HINT(found[i].relevance, expected[i].relevance, query);
+                ASSERT_EQUAL_HINT(found[i].rating, expected[i].rating, query);
+            }
+        }
+    }
+}
+
+void TestPerfectHashStopWords() {
+    {
+        const PerfectHashSet empty;
+        ASSERT(empty.empty());
+        ASSERT(!empty.Contains("in"));
+        ASSERT(!empty.Contains(""));
+
+        std::vector<std::string> words;
+        for (int i = 0; i < 3000; ++i) {
+            words.push_back("w" + std::to_string(i * 7));
+        }
+        std::vector<std::string_view> views(words.begin(), words.end());
+        views.push_back(words.front());
+        const PerfectHashSet set(views);
+        ASSERT_EQUAL(set.size(), words.size());
+        for (const std::string& word : words) {
+            ASSERT_HINT(set.Contains(word), word);
+        }
+        for (int i = 0; i < 3000; ++i) {
+            if (i % 7 != 0) {
+                ASSERT(!set.Contains("w" + std::to_string(i)));
+            }
+        }
+        ASSERT(!set.Contains("w"));
+        ASSERT(!set.Contains("w00"));
+        std::vector<std::string_view> stored = set.GetWords();
+        std::sort(stored.begin(), stored.end());
+        std::sort(views.begin(), views.end());
+        views.erase(std::unique(views.begin(), views.end()), views.end());
+        ASSERT(stored == views);
+    }
+    {
+        TermDictionary dictionary;
+        ASSERT(!dictionary.Find("cat"));
+        ASSERT_EQUAL(dictionary.Insert("cat"), 0u);
+        ASSERT_EQUAL(dictionary.Insert("dog"), 1u);
+        ASSERT_EQUAL(dictionary.Insert("cat"), 0u);
+        const std::string_view cat = dictionary.GetWord(0);
+        // Growing the table and filling many chunks doesn't move the words already stored
+        for (int i = 0; i < 20000; ++i) {
+            const std::string word = "term" + std::to_string(i) + std::string(i % 50, 'x');
+            ASSERT_EQUAL(dictionary.Insert(word), static_cast<TermId>(i + 2));
+        }
+        ASSERT_EQUAL(dictionary.size(), 20002u);
+        ASSERT_EQUAL(cat, std::string_view("cat"));
+        ASSERT_EQUAL(cat.data(), dictionary.GetWord(0).data());
+        for (int i = 0; i < 20000; i += 97) {
+            const std::string word = "term" + std::to_string(i) + std::string(i % 50, 'x');
+            ASSERT_EQUAL(*dictionary.Find(word), static_cast<TermId>(i + 2));
+            ASSERT_EQUAL(dictionary.GetWord(i + 2), word);
+        }
+        ASSERT(!dictionary.Find("term"));
+    }
+
+    SearchServer server(std::string("in the"));
+    server.AddDocument(1, "cat in the city", DocumentStatus::ACTUAL, { 1 });
+    server.SetStopWords("city of");
+    server.AddDocument(2, "dog of the city", DocumentStatus::ACTUAL, { 1 });
+    ASSERT_EQUAL(server.GetWordFrequencies(2).size(), 1u);
+    ASSERT(server.FindTopDocuments("in").empty());
+    std::stringstream snapshot;
+    server.SaveSnapshot(snapshot);
+    SearchServer loaded;
+    loaded.LoadSnapshot(snapshot);
+    loaded.AddDocument(3, "in the city of rats", DocumentStatus::ACTUAL, { 1 });
+    ASSERT_EQUAL(loaded.GetWordFrequencies(3).size(), 1u);
+    ASSERT_EQUAL(loaded.FindTopDocuments("cat").size(), 1u);
+}
+
+void TestQueryServer() {
+    {
+        LatencyHistogram histogram;
+        ASSERT_EQUAL(histogram.GetCount(), 0u);
+        for (int i = 1; i <= 1000; ++i) {
+            histogram.Record(std::chrono::microseconds(i));
+        }
+        ASSERT_EQUAL(histogram.GetCount(), 1000u);
+        ASSERT(histogram.GetMin() == std::chrono::microseconds(1));
+        ASSERT(histogram.GetMax() == std::chrono::microseconds(1000));
+        // Buckets are at most 1/64 wide
+        const double p50 = std::chrono::duration<double, std::micro>(histogram.GetPercentile(50)).count();
+        ASSERT_HINT(p50 >= 500 && p50 <= 500 * 1.02, std::to_string(p50));
+        ASSERT(histogram.GetPercentile(100) == std::chrono::microseconds(1000));
+        LatencyHistogram other;
+        other.Record(std::chrono::seconds(2));
+        histogram.Merge(other);
+        ASSERT_EQUAL(histogram.GetCount(), 1001u);
+        ASSERT(histogram.GetMax() == std::chrono::seconds(2));
+    }
+
+    SearchServer server(std::string("and with"));
+    server.AddDocument(1, "white cat and fashionable collar", DocumentStatus::ACTUAL, {8, -3});
+    server.AddDocument(2, "fluffy cat fluffy tail", DocumentStatus::ACTUAL, {7, 2, 7});
+    server.AddDocument(3, "groomed dog expressive eyes", DocumentStatus::BANNED, {5, -12, 2, 1});
+    QueryServerOptions options;
+    options.max_batch_size = 4;
+    QueryServer query_server(server, options);
+    ASSERT(query_server.GetPort() != 0);
+    // Queries on the pool threads don't print their durations
+    ASSERT(server.GetDurationLog() == nullptr);
+
+    // Sends 'requests' on one connection and reads the replies until the server closes it
+    const auto exchange = [port = query_server.GetPort()](const std::vector<std::string>& requests) {
+        const int fd = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+        std::vector<std::string> replies;
+        if (fd < 0 || connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+            return replies;
+        }
+        std::string output;
+        for (const std::string& request : requests) {
+            output += request + "\r\n";
+        }
+        for (size_t written = 0; written < output.size();) {
+            const ssize_t result = write(fd, output.data() + written, output.size() - written);
+            if (result <= 0) {
+                break;
+            }
+            written += result;
+        }
+        shutdown(fd, SHUT_WR);
+        std::string input;
+        char buffer[4096];
+        for (ssize_t result; (result = read(fd, buffer, sizeof(buffer))) > 0;) {
+            input.append(buffer, result);
+        }
+        close(fd);
+        std::istringstream lines(input);
+        for (std::string line; std::getline(lines, line);) {
+            replies.push_back(line);
+        }
+        return replies;
+    };
+
+    {
+        const std::vector<std::string> replies = exchange({"FIND fluffy cat", "", "FIND_STATUS BANNED dog", "MATCH 1 white cat -collar",
+                                                           "MATCH 2 fluffy cat", "FIND cat -", "MATCH 99 cat", "SEARCH cat"});
+        ASSERT_EQUAL(replies.size(), 7u);
+        const std::vector<Document> documents = server.FindTopDocuments("fluffy cat");
+        std::istringstream find_reply(replies[0]);
+        std::string ok;
+        size_t count = 0;
+        find_reply >> ok >> count;
+        ASSERT_EQUAL(ok, std::string("OK"));
+        ASSERT_EQUAL(count, documents.size());
+        for (const Document& document : documents) {
+            Document received;
+            find_reply >> received.id >> received.relevance >> received.rating;
+            ASSERT_EQUAL(received.id, document.id);
+            ASSERT(std::abs(received.relevance - document.relevance) < 1e-9);
+            ASSERT_EQUAL(received.rating, document.rating);
+        }
+        ASSERT_EQUAL(replies[1].substr(0, 7), std::string("OK 1 3 "));
+        ASSERT_EQUAL(replies[2], std::string("OK ACTUAL 0"));
+        ASSERT_EQUAL(replies[3], std::string("OK ACTUAL 2 cat fluffy"));
+        ASSERT_EQUAL(replies[4].substr(0, 6), std::string("ERROR "));
+        ASSERT_EQUAL(replies[5].substr(0, 6), std::string("ERROR "));
+        ASSERT_EQUAL(replies[6], std::string("ERROR Unknown command 'SEARCH'"));
+    }
+    {
+        // A change is applied before the queries sent after it
+        const std::vector<std::string> replies = exchange({"FIND parrot", "ADD 4 ACTUAL 2 3 5 grey parrot", "FIND parrot",
+                                                           "ADD 4 ACTUAL 0 parrot again", "ADD 5 LOST 0 parrot",
+                                                           "ADD 6 ACTUAL 2000000000 1 parrot", "ADD 6 ACTUAL -1 parrot"});
+        ASSERT_EQUAL(replies.size(), 7u);
+        ASSERT_EQUAL(replies[0], std::string("OK 0"));
+        ASSERT_EQUAL(replies[1], std::string("OK"));
+        ASSERT_EQUAL(replies[2].substr(0, 7), std::string("OK 1 4 "));
+        ASSERT_EQUAL(replies[2].substr(replies[2].rfind(' ')), std::string(" 4"));
+        ASSERT_EQUAL(replies[3].substr(0, 6), std::string("ERROR "));
+        ASSERT_EQUAL(replies[4].substr(0, 6), std::string("ERROR "));
+        // A ratings count larger than the line is rejected without allocating for it
+        ASSERT_EQUAL(replies[5].substr(0, 6), std::string("ERROR "));
+        ASSERT_EQUAL(replies[6].substr(0, 6), std::string("ERROR "));
+        ASSERT_EQUAL(server.GetDocumentCount(), 4u);
+    }
+    {
+        // Pipelined requests of concurrent clients are answered in order per connection
+        const int client_count = 8;
+        const int request_count = 50;
+        std::vector<std::vector<std::string>> replies(client_count);
+        std::vector<std::thread> clients;
+        for (int client = 0; client < client_count; ++client) {
+            clients.emplace_back([&, client] {
+                std::vector<std::string> requests;
+                for (int i = 0; i < request_count; ++i) {
+                    requests.push_back(i % 2 == 0 ? "MATCH 2 fluffy" : "FIND parrot");
+                }
+                replies[client] = exchange(requests);
+            });
+        }
+        for (std::thread& client : clients) {
+            client.join();
+        }
+        for (const std::vector<std::string>& client_replies : replies) {
+            ASSERT_EQUAL(client_replies.size(), static_cast<size_t>(request_count));
+            for (int i = 0; i < request_count; ++i) {
+                ASSERT_EQUAL(client_replies[i].substr(0, 6), std::string(i % 2 == 0 ? "OK ACT" : "OK 1 4"));
+            }
+        }
+    }
+    const std::vector<std::string> stats_reply = exchange({"STATS"});
+    ASSERT_EQUAL(stats_reply.size(), 1u);
+    ASSERT_EQUAL(stats_reply[0].substr(0, 18), std::string("OK connections=11 "));
+
+    const QueryServerStats stats = query_server.GetStats();
+    ASSERT_EQUAL(stats.connections, 11u);
+    ASSERT_EQUAL(stats.requests, 7u + 7u + 8u * 50u + 1u);
+    ASSERT_EQUAL(stats.latencies.GetCount(), stats.requests);
+    ASSERT(stats.batches <= stats.requests);
+    ASSERT(stats.batches >= (stats.requests + options.max_batch_size - 1) / options.max_batch_size);
+    query_server.Stop();
+    query_server.Stop();
+    ASSERT(server.GetDurationLog() == &std::cout);
+
+    // A connection that keeps sending without a line break is closed once it passes the limit,
+    // without the client closing its side
+    options.max_line_length = 64;
+    QueryServer limited_server(server, options);
+    const int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(limited_server.GetPort());
+    inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+    ASSERT(fd >= 0 && connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0);
+    const std::string output = "FIND cat\n" + std::string(1 << 20, 'x');
+    for (size_t written = 0; written < output.size();) {
+        const ssize_t result = send(fd, output.data() + written, output.size() - written, MSG_NOSIGNAL);
+        if (result <= 0) {
+            break;
+        }
+        written += result;
+    }
+    char buffer[4096];
+    ssize_t result;
+    while ((result = read(fd, buffer, sizeof(buffer))) > 0) {
+    }
+    close(fd);
+    ASSERT(result <= 0);
+}
+
+void TestQueryReplay() {
+    std::istringstream log("FIND fluffy cat\r\n\nFIND_STATUS BANNED groomed dog\nwhite -cat\nparrot\nFIND cat -\n");
+    const std::vector<ReplayQuery> queries = ReadQueryLog(log);
+    ASSERT_EQUAL(queries.size(), 5u);
+    ASSERT_EQUAL(queries[0].query, std::string("fluffy cat"));
+    ASSERT(!queries[0].status);
+    ASSERT_EQUAL(queries[1].query, std::string("groomed dog"));
+    ASSERT(queries[1].status == DocumentStatus::BANNED);
+    ASSERT_EQUAL(queries[2].query, std::string("white -cat"));
+    try {
+        std::istringstream bad_log("FIND_STATUS LOST cat\n");
+        ReadQueryLog(bad_log);
+        ASSERT_HINT(false, "unknown status must be rejected");
+    } catch (const std::invalid_argument&) {
+    }
+
+    SearchServer server(std::string("and with"));
+    server.AddDocument(1, "white cat and fashionable collar", DocumentStatus::ACTUAL, {8, -3});
+    server.AddDocument(2, "fluffy cat fluffy tail", DocumentStatus::ACTUAL, {7, 2, 7});
+    server.AddDocument(3, "groomed dog expressive eyes", DocumentStatus::BANNED, {5, -12, 2, 1});
+
+    ReplayOptions options;
+    options.client_count = 3;
+    options.request_count = 100;
+    {
+        const ReplayResult result = ReplayQueries(server, queries, options);
+        ASSERT_EQUAL(result.requests, 100u);
+        ASSERT_EQUAL(result.latencies.GetCount(), 100u);
+        // Every fifth request is the malformed query, the minus-word and the unknown word find nothing
+        ASSERT_EQUAL(result.errors, 20u);
+        ASSERT_EQUAL(result.empty_results, 40u);
+        ASSERT(result.GetThroughput() > 0);
+    }
+    {
+        // Arrivals are spread over 99 / 2000 s no matter how fast the server is
+        options.mode = ReplayMode::OPEN_LOOP;
+        options.requests_per_second = 2000;
+        const ReplayResult result = ReplayQueries(server, queries, options);
+        ASSERT_EQUAL(result.requests, 100u);
+        ASSERT_HINT(result.seconds >= 0.049, std::to_string(result.seconds));
+        options.requests_per_second = 0;
+        try {
+            ReplayQueries(server, queries, options);
+            ASSERT_HINT(false, "open loop needs a rate");
+        } catch (const std::invalid_argument&) {
+        }
+        // The duration log is off only while the replay runs
+        ASSERT(server.GetDurationLog() == &std::cout);
+    }
+    {
+        QueryServer query_server(server);
+        options.mode = ReplayMode::CLOSED_LOOP;
+        const ReplayResult result = ReplayQueries("127.0.0.1", query_server.GetPort(), queries, options);
+        ASSERT_EQUAL(result.requests, 100u);
+        ASSERT_EQUAL(result.errors, 20u);
+        ASSERT_EQUAL(result.empty_results, 40u);
+        ASSERT_EQUAL(query_server.GetStats().connections, 3u);
+        options.mode = ReplayMode::OPEN_LOOP;
+        options.requests_per_second = 5000;
+        ASSERT_EQUAL(ReplayQueries("127.0.0.1", query_server.GetPort(), queries, options).errors, 20u);
+    }
+    ASSERT_EQUAL(ReplayQueries(server, {}, options).requests, 0u);
+}
+
+void TestDocumentFilter() {
+    {
+        DocumentBitmap bitmap;
+        std::set<int> expected;
+        // Sparse ids, a container past the array limit and ids beyond the first 65536
+        for (int i = 0; i < 10000; ++i) {
+            const int document_id = i % 3 == 0 ? i * 40 : 70000 + i;
+            bitmap.Add(document_id);
+            expected.insert(document_id);
+        }
+        bitmap.Add(70001);
+        ASSERT_EQUAL(bitmap.size(), expected.size());
+        for (int i = 0; i < 9000; i += 2) {
+            bitmap.Remove(70000 + i);
+            expected.erase(70000 + i);
+        }
+        bitmap.Remove(5);
+        ASSERT_EQUAL(bitmap.size(), expected.size());
+        std::vector<int> ids;
+        bitmap.ForEach([&ids](int document_id) {
+            ids.push_back(document_id);
+        });
+        ASSERT(ids == std::vector<int>(expected.begin(), expected.end()));
+        ASSERT(bitmap.Contains(70001));
+        ASSERT(!bitmap.Contains(70002));
+
+        DocumentBitmap other;
+        for (int document_id = 0; document_id < 200000; document_id += 7) {
+            other.Add(document_id);
+        }
+        DocumentBitmap intersection = bitmap;
+        intersection.IntersectWith(other);
+        DocumentBitmap unification = bitmap;
+        unification.UniteWith(other);
+        size_t intersection_size = 0;
+        for (int document_id = 0; document_id < 200000; ++document_id) {
+            const bool in_bitmap = expected.count(document_id) > 0;
+            const bool in_other = document_id % 7 == 0;
+            ASSERT_EQUAL(intersection.Contains(document_id), in_bitmap && in_other);
+            ASSERT_EQUAL(unification.Contains(document_id), in_bitmap || in_other);
+            intersection_size += in_bitmap && in_other;
+        }
+        ASSERT_EQUAL(intersection.size(), intersection_size);
+        ASSERT_EQUAL(unification.size(), expected.size() + other.size() - intersection_size);
+    }
+
+    SearchServer server(std::string("and with"));
+    const std::vector<std::string> words = {"cat", "dog", "parrot", "tail", "collar", "fluffy", "grey", "white", "eyes", "nose"};
+    const std::vector<DocumentStatus> statuses = {DocumentStatus::ACTUAL, DocumentStatus::ACTUAL, DocumentStatus::ACTUAL,
+                                                  DocumentStatus::IRRELEVANT, DocumentStatus::BANNED};
+    for (int document_id = 0; document_id < 3000; ++document_id) {
+        std::string text;
+        for (int i = 0; i < 6; ++i) {
+            text += words[(document_id * 7 + i * i * 3 + i * document_id / 11) % words.size()] + " ";
+        }
+        server.AddDocument(document_id, text, statuses[document_id % statuses.size()], {document_id % 21 - 10});
+    }
+    for (int document_id = 0; document_id < 3000; document_id += 9) {
+        server.RemoveDocument(document_id);
+    }
+    ASSERT(server.GetMemoryStats().attributes.bytes > 0);
+
+    DocumentFilter selective;
+    selective.statuses = {DocumentStatus::ACTUAL};
+    selective.min_rating = 9;
+    DocumentFilter rating_range;
+    rating_range.min_rating = -2;
+    rating_range.max_rating = 3;
+    DocumentFilter banned;
+    banned.statuses = {DocumentStatus::BANNED, DocumentStatus::IRRELEVANT};
+    DocumentFilter empty_range;
+    empty_range.min_rating = 5;
+    empty_range.max_rating = 4;
+    // Candidates galloped through the postings, a few scored from the forward index and no candidates at all
+    DocumentFilter banned_only;
+    banned_only.statuses = {DocumentStatus::BANNED};
+    DocumentFilter top_rated;
+    top_rated.statuses = {DocumentStatus::ACTUAL, DocumentStatus::BANNED};
+    top_rated.min_rating = 10;
+    DocumentFilter few_banned;
+    few_banned.statuses = {DocumentStatus::BANNED};
+    few_banned.max_rating = -10;
+    DocumentFilter actual_only;
+    actual_only.statuses = {DocumentStatus::ACTUAL};
+    for (const DocumentFilter& filter : {selective, rating_range, banned, empty_range, DocumentFilter{}, banned_only, top_rated,
+                                         few_banned, actual_only}) {
+        for (const std::string query : {"cat", "cat dog -tail", "fluffy grey white eyes", "+cat nose", "par* -nose", "cat -d*", "lion"}) {
+            const std::vector<Document> expected = server.FindTopDocuments(query, [&filter](int document_id, DocumentStatus status, int rating) {
+                return filter(document_id, status, rating);
+            });
+            const std::vector<Document> found = server.FindTopDocuments(query, filter);
+            ASSERT_EQUAL_HINT(found.size(), expected.size(), query);
+            for (size_t i = 0; i < found.size(); ++i) {
+                ASSERT_EQUAL_HINT(found[i].id, expected[i].id, query);
+                ASSERT_EQUAL_HINT(found[i].rating, expected[i].rating, query);
+                ASSERT_HINT(std::abs(found[i].relevance - expected[i].relevance) < 1e-9, query);
+                ASSERT(filter(found[i].id, DocumentStatus::ACTUAL, found[i].rating) || !filter.statuses.empty());
+            }
+        }
+    }
+    ASSERT(server.FindTopDocuments("cat", empty_range).empty());
+
+    AttributeIndex attributes;
+    for (int document_id = 0; document_id < 1000; ++document_id) {
+        attributes.AddDocument(document_id, statuses[document_id % statuses.size()], document_id % 21 - 10);
+    }
+    attributes.RemoveDocument(0, DocumentStatus::ACTUAL, -10);
+    for (const DocumentFilter& filter : {selective, rating_range, banned, empty_range, DocumentFilter{}, top_rated, few_banned}) {
+        const DocumentBitmap selected = attributes.Select(filter);
+        ASSERT(selected.size() <= std::min(attributes.CountByStatus(filter), attributes.CountByRating(filter)));
+        for (int document_id = 0; document_id < 1000; ++document_id) {
+            ASSERT_EQUAL(selected.Contains(document_id), document_id > 0
+                         && filter(document_id, statuses[document_id % statuses.size()], document_id % 21 - 10));
+        }
+    }
+}
+
+void TestSharedVocabulary() {
+    const SharedVocabulary vocabulary = SearchServer::CreateVocabulary("and with");
+    SearchServer first(vocabulary);
+    first.AddDocument(1, "white cat and fashionable collar", DocumentStatus::ACTUAL, {8, -3});
+    first.AddDocument(2, "fluffy cat fluffy tail", DocumentStatus::ACTUAL, {7, 2, 7});
+    SearchServer second(first.GetVocabulary());
+    second.AddDocument(1, "groomed dog with expressive eyes", DocumentStatus::ACTUAL, {5, -12, 2, 1});
+    second.AddDocument(3, "fluffy dog", DocumentStatus::ACTUAL, {1});
+
+    // Terms are shared, documents and document counts are not
+    ASSERT_EQUAL(vocabulary.terms->size(), 10u);
+    ASSERT_EQUAL(first.FindTopDocuments("cat").size(), 2u);
+    ASSERT(second.FindTopDocuments("cat").empty());
+    ASSERT(first.FindTopDocuments("dog").empty());
+    ASSERT_EQUAL(second.FindTopDocuments("fluffy dog").front().id, 3);
+    const std::vector<std::string> matched_words = std::get<0>(second.MatchDocument("fluffy with dog", 1));
+    ASSERT(matched_words == std::vector<std::string>{"dog"});
+    ASSERT_EQUAL(second.GetWordFrequencies(3).size(), 2u);
+    ASSERT_EQUAL(first.GetMemoryStats().distinct_terms, 6u);
+    ASSERT_EQUAL(second.GetMemoryStats().stop_words.bytes, 0u);
+
+    // Stop words added to one server are its own
+    second.SetStopWords("dog");
+    ASSERT(second.FindTopDocuments("dog").empty());
+    ASSERT(vocabulary.stop_words == first.GetVocabulary().stop_words);
+    ASSERT(!vocabulary.stop_words->Contains("dog"));
+    ASSERT(second.GetVocabulary().stop_words->Contains("dog"));
+    ASSERT(second.GetVocabulary().stop_words->Contains("with"));
+    ASSERT(second.GetVocabulary().terms == vocabulary.terms);
+
+    try {
+        SearchServer::CreateVocabulary("in t\x01he");
+        ASSERT_HINT(false, "stop words with control characters must be rejected");
+    } catch (const std::invalid_argument&) {
+    }
+    try {
+        SearchServer server(SharedVocabulary{vocabulary.stop_words, nullptr});
+        ASSERT_HINT(false, "vocabulary without a dictionary must be rejected");
+    } catch (const std::invalid_argument&) {
+    }
+
+    // A vocabulary taken from a server stays usable after the server is gone
+    SharedVocabulary orphan;
+    {
+        SearchServer owner(std::string("in the"));
+        owner.AddDocument(1, "cat in the city", DocumentStatus::ACTUAL, {1});
+        orphan = owner.GetVocabulary();
+    }
+    SearchServer heir(orphan);
+    heir.AddDocument(5, "the city of dogs", DocumentStatus::ACTUAL, {1});
+    ASSERT_EQUAL(heir.FindTopDocuments("city the").size(), 1u);
+    ASSERT_EQUAL(*orphan.terms->Find("city"), 1u);
+
+    // Tenants filling the dictionary concurrently rank like a server of their own
+    const int tenant_count = 4;
+    std::vector<SearchServer> tenants;
+    for (int i = 0; i < tenant_count; ++i) {
+        tenants.emplace_back(vocabulary);
+    }
+    const auto make_text = [](int tenant, int document_id) {
+        std::string text;
+        for (int i = 0; i < 8; ++i) {
+            text += "word" + std::to_string((document_id * 13 + i * 7 + tenant) % 500) + " ";
+        }
+        return text;
+    };
+    std::vector<std::thread> threads;
+    for (int tenant = 0; tenant < tenant_count; ++tenant) {
+        threads.emplace_back([&, tenant] {
+            for (int document_id = 0; document_id < 300; ++document_id) {
+                tenants[tenant].AddDocument(document_id, make_text(tenant, document_id), DocumentStatus::ACTUAL, {document_id % 7});
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    for (int tenant = 0; tenant < tenant_count; ++tenant) {
+        SearchServer alone(std::string("and with"));
+        for (int document_id = 0; document_id < 300; ++document_id) {
+            alone.AddDocument(document_id, make_text(tenant, document_id), DocumentStatus::ACTUAL, {document_id % 7});
+        }
+        for (const std::string query : {"word1 word2", "word7 -word14", "word3*", "+word100 word200"}) {
+            const std::vector<Document> expected = alone.FindTopDocuments(query);
+            const std::vector<Document> found = tenants[tenant].FindTopDocuments(query);
+            ASSERT_EQUAL_HINT(found.size(), expected.size(), query);
+            for (size_t i = 0; i < found.size(); ++i) {
+                ASSERT_EQUAL_HINT(found[i].id, expected[i].id, query);
+                ASSERT_HINT(std::abs(found[i].relevance - expected[i].relevance) < 1e-9, query);
+            }
+        }
+    }
+    ASSERT_EQUAL(vocabulary.terms->size(), 10u + 500u);
+}
+
+void TestArenaAllocation() {
+    IndexOptions heap_options;
+    heap_options.segment_max_documents = 64;
+    IndexOptions arena_options = heap_options;
+    arena_options.arena_allocation = true;
+    arena_options.background_merge = true;
+    const auto make_text = [](int document_id) {
+        std::string text;
+        for (int i = 0; i < 10; ++i) {
+            text += "word" + std::to_string((document_id * 31 + i * i * 17) % 300) + " ";
+        }
+        return text;
+    };
+    const auto assert_same_results = [](const SearchServer& expected_server, const SearchServer& server) {
+        for (const std::string query : {"word1 word2 word3", "word17 -word34", "word2*"}) {
+            const std::vector<Document> expected = expected_server.FindTopDocuments(query);
+            const std::vector<Document> found = server.FindTopDocuments(query);
+            ASSERT_EQUAL_HINT(found.size(), expected.size(), query);
+            for (size_t i = 0; i < found.size(); ++i) {
+                ASSERT_EQUAL_HINT(found[i].id, expected[i].id, query);
+            }
+        }
+    };
+
+    SearchServer heap_server(std::string("and with"), heap_options);
+    SearchServer arena_server(std::string("and with"), arena_options);
+    for (int document_id = 0; document_id < 1000; ++document_id) {
+        heap_server.AddDocument(document_id, make_text(document_id), DocumentStatus::ACTUAL, {document_id % 11});
+        arena_server.AddDocument(document_id, make_text(document_id), DocumentStatus::ACTUAL, {document_id % 11});
+    }
+    for (int document_id = 0; document_id < 1000; document_id += 3) {
+        heap_server.RemoveDocument(document_id);
+        arena_server.RemoveDocument(document_id);
+    }
+    arena_server.WaitForMerges();
+    assert_same_results(heap_server, arena_server);
+    // The arena is below the counters, the structures ask for the same memory either way
+    ASSERT_EQUAL(arena_server.GetMemoryStats().forward_index.bytes, heap_server.GetMemoryStats().forward_index.bytes);
+    ASSERT_EQUAL(arena_server.GetMemoryStats().documents.allocations, heap_server.GetMemoryStats().documents.allocations);
+    ASSERT_EQUAL(heap_server.GetMemoryStats().arena_blocks, 0u);
+
+    // Clear drops the documents and keeps the server usable
+    heap_server.Clear();
+    arena_server.Clear();
+    for (const SearchServer* server : {&heap_server, &arena_server}) {
+        ASSERT_EQUAL(server->GetDocumentCount(), 0u);
+        ASSERT(server->FindTopDocuments("word1 word2*").empty());
+        ASSERT_EQUAL(server->GetMemoryStats().documents.allocations, 0u);
+        ASSERT_EQUAL(server->GetMemoryStats().distinct_terms, 0u);
+    }
+    for (int document_id = 500; document_id < 700; ++document_id) {
+        heap_server.AddDocument(document_id, make_text(document_id), DocumentStatus::ACTUAL, {document_id % 7});
+        arena_server.AddDocument(document_id, make_text(document_id), DocumentStatus::ACTUAL, {document_id % 7});
+    }
+    assert_same_results(heap_server, arena_server);
+
+    // Destroying an arena server frees the arena's chunks and large blocks, the nodes in them are never visited.
+    // The arena takes its blocks from the default resource when it is created, counted here.
+    const auto count_teardown_frees = [&](int document_count, size_t& nodes) {
+        TrackingMemoryResource upstream;
+        std::pmr::memory_resource* const previous = std::pmr::set_default_resource(&upstream);
+        auto server = std::make_unique<SearchServer>(std::string("and with"), arena_options);
+        std::pmr::set_default_resource(previous);
+        for (int document_id = 0; document_id < document_count; ++document_id) {
+            server->AddDocument(document_id, make_text(document_id), DocumentStatus::ACTUAL, {document_id % 11});
+        }
+        const MemoryStats stats = server->GetMemoryStats();
+        ASSERT_EQUAL(upstream.GetAllocationCount(), stats.arena_blocks);
+        nodes = stats.forward_index.allocations + stats.documents.allocations + stats.document_ids.allocations
+                + stats.attributes.allocations;
+        server.reset();
+        ASSERT_EQUAL(upstream.GetAllocationCount(), 0u);
+        return stats.arena_blocks;
+    };
+    size_t small_nodes = 0;
+    size_t large_nodes = 0;
+    const size_t small_frees = count_teardown_frees(2000, small_nodes);
+    const size_t large_frees = count_teardown_frees(20000, large_nodes);
+    ASSERT(large_nodes >= 9 * small_nodes);
+    ASSERT(large_frees <= 3 * small_frees);
+    ASSERT(large_frees * 100 < large_nodes);
+
+    BenchmarkOptions benchmark;
+    benchmark.document_count = 300;
+    benchmark.vocabulary_size = 100;
+    benchmark.query_count = 20;
+    benchmark.allocation_rounds = 2;
+    std::ostringstream report;
+    const AllocationBenchmarkResult result = RunAllocationBenchmark(benchmark, report);
+    ASSERT_EQUAL(result.arena.found_documents, result.heap.found_documents);
+    ASSERT(result.arena.found_documents > 0);
+    ASSERT_EQUAL(result.arena.memory.bytes, result.heap.memory.bytes);
+    ASSERT(result.arena.build_seconds > 0 && result.heap.teardown_seconds > 0);
+    ASSERT(report.str().find("arena: build = ") != std::string::npos);
+}
+
 //  TestSearchServer      
 void TestSearchServer() {
     RUN_TEST(TestExcludeStopWordsFromAddedDocumentContent);
@@ -250,4 +1771,24 @@ void TestSearchServer() {
     RUN_TEST(TestFindCorrectStatus);
     RUN_TEST(TestComputeRelevance);
     RUN_TEST(TestRemoveDuplicates);
+    RUN_TEST(TestSplitIntoWords);
+    RUN_TEST(TestPrefixQuery);
+    RUN_TEST(TestLoadCorpus);
+    RUN_TEST(TestFindTopDocumentsAsync);
+    RUN_TEST(TestSearchBudget);
+    RUN_TEST(TestSegmentedIndex);
+    RUN_TEST(TestWriteAheadLog);
+    RUN_TEST(TestRequiredWords);
+    RUN_TEST(TestMemoryStats);
+    RUN_TEST(TestTombstoneVacuum);
+    RUN_TEST(TestMatchDocuments);
+    RUN_TEST(TestWordFrequencies);
+    RUN_TEST(TestBenchmarkProfile);
+    RUN_TEST(TestImpactOrderedPostings);
+    RUN_TEST(TestPerfectHashStopWords);
+    RUN_TEST(TestQueryServer);
+    RUN_TEST(TestQueryReplay);
+    RUN_TEST(TestDocumentFilter);
+    RUN_TEST(TestSharedVocabulary);
+    RUN_TEST(TestArenaAllocation);
 }
\ No newline at end of file
@@ -151,5 +151,45 @@ void TestComputeRelevance();
 
 void TestRemoveDuplicates();
 
+void TestSplitIntoWords();
+
+void TestPrefixQuery();
+
+void TestLoadCorpus();
+
+void TestFindTopDocumentsAsync();
+
+void TestSearchBudget();
+
+void TestSegmentedIndex();
+
+void TestWriteAheadLog();
+
+void TestRequiredWords();
+
+void TestMemoryStats();
+
+void TestTombstoneVacuum();
+
+void TestMatchDocuments();
+
+void TestWordFrequencies();
+
+void TestBenchmarkProfile();
+
+void TestImpactOrderedPostings();
+
+void TestPerfectHashStopWords();
+
+void TestQueryServer();
+
+void TestQueryReplay();
+
+void TestDocumentFilter();
+
+void TestSharedVocabulary();
+
+void TestArenaAllocation();
+
 //  TestSearchServer      
 void TestSearchServer();
\ No newline at end of file
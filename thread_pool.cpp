@@ -0,0 +1,163 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <exception>
+
+namespace {
+
+thread_local const ThreadPool* current_pool = nullptr;
+thread_local size_t current_worker = 0;
+
+// ParallelFor splits the work into this many chunks per thread, so faster threads take more of them
+const size_t PARALLEL_CHUNKS_PER_THREAD = 4;
+
+} // namespace
+
+ThreadPool::ThreadPool(size_t thread_count) {
+    thread_count = std::max<size_t>(thread_count, 1);
+    queues_.reserve(thread_count);
+    for (size_t i = 0; i < thread_count; ++i) {
+        queues_.push_back(std::make_unique<WorkerQueue>());
+    }
+    threads_.reserve(thread_count);
+    for (size_t i = 0; i < thread_count; ++i) {
+        threads_.emplace_back([this, i] {
+            WorkerLoop(i);
+        });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard lock(sleep_mutex_);
+        stop_ = true;
+    }
+    wake_up_.notify_all();
+    for (std::thread& thread : threads_) {
+        thread.join();
+    }
+}
+
+void ThreadPool::ParallelFor(size_t count, const std::function<void(size_t, size_t)>& body) {
+    if (count == 0) {
+        return;
+    }
+    const size_t chunk_size = std::max<size_t>(1, count / (threads_.size() * PARALLEL_CHUNKS_PER_THREAD));
+    const size_t chunk_count = (count + chunk_size - 1) / chunk_size;
+
+    // Helpers may start after the caller has finished everything, so they only touch shared state
+    // and claim chunks before looking at 'body'
+    struct State {
+        const std::function<void(size_t, size_t)>* body;
+        std::atomic<size_t> next_chunk{0};
+        std::mutex mutex;
+        std::condition_variable chunk_finished;
+        size_t finished_count = 0;
+        std::exception_ptr error;
+    };
+    auto state = std::make_shared<State>();
+    state->body = &body;
+    const auto run_chunks = [state, count, chunk_size, chunk_count] {
+        for (size_t chunk = state->next_chunk.fetch_add(1); chunk < chunk_count; chunk = state->next_chunk.fetch_add(1)) {
+            std::exception_ptr error;
+            try {
+                (*state->body)(chunk * chunk_size, std::min(count, (chunk + 1) * chunk_size));
+            } catch (...) {
+                error = std::current_exception();
+            }
+            std::lock_guard lock(state->mutex);
+            if (error && !state->error) {
+                state->error = error;
+            }
+            if (++state->finished_count == chunk_count) {
+                state->chunk_finished.notify_all();
+            }
+        }
+    };
+
+    for (size_t i = 0; i + 1 < std::min(threads_.size() + 1, chunk_count); ++i) {
+        Push(run_chunks);
+    }
+    run_chunks();
+    std::unique_lock lock(state->mutex);
+    state->chunk_finished.wait(lock, [&state, chunk_count] {
+        return state->finished_count == chunk_count;
+    });
+    if (state->error) {
+        std::rethrow_exception(state->error);
+    }
+}
+
+size_t ThreadPool::GetThreadCount() const {
+    return threads_.size();
+}
+
+ThreadPool& ThreadPool::GetShared() {
+    static ThreadPool shared_pool;
+    return shared_pool;
+}
+
+size_t ThreadPool::GetDefaultThreadCount() {
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+void ThreadPool::Push(Task task) {
+    const size_t queue_index = current_pool == this
+            ? current_worker
+            : next_queue_.fetch_add(1, std::memory_order_relaxed) % queues_.size();
+    {
+        // Counted under the queue lock before the task is visible, so a worker that pops it
+        // can't decrement first and wrap the counter below zero
+        std::lock_guard lock(queues_[queue_index]->mutex);
+        pending_count_.fetch_add(1);
+        queues_[queue_index]->tasks.push_back(std::move(task));
+    }
+    {
+        // Taking the lock orders the increment with a worker that is about to sleep
+        std::lock_guard lock(sleep_mutex_);
+    }
+    wake_up_.notify_one();
+}
+
+bool ThreadPool::TryPop(size_t worker, Task& task) {
+    {
+        WorkerQueue& own = *queues_[worker];
+        std::lock_guard lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            pending_count_.fetch_sub(1);
+            return true;
+        }
+    }
+    for (size_t offset = 1; offset < queues_.size(); ++offset) {
+        WorkerQueue& victim = *queues_[(worker + offset) % queues_.size()];
+        std::lock_guard lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            pending_count_.fetch_sub(1);
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::WorkerLoop(size_t worker) {
+    current_pool = this;
+    current_worker = worker;
+    while (true) {
+        Task task;
+        if (TryPop(worker, task)) {
+            task();
+            continue;
+        }
+        std::unique_lock lock(sleep_mutex_);
+        wake_up_.wait(lock, [this] {
+            return stop_ || pending_count_.load() > 0;
+        });
+        if (stop_ && pending_count_.load() == 0) {
+            return;
+        }
+    }
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Work-stealing thread pool: every worker owns a deque, takes its own tasks from the back
+// and steals from the front of the other deques when its own is empty.
+// Tasks submitted from a worker go to that worker's deque.
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t thread_count = GetDefaultThreadCount());
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Runs the tasks that are already queued, then stops the workers
+    ~ThreadPool();
+
+    template <typename Func>
+    std::future<std::invoke_result_t<Func>> Submit(Func func) {
+        using Result = std::invoke_result_t<Func>;
+        auto task = std::make_shared<std::packaged_task<Result()>>(std::move(func));
+        std::future<Result> result = task->get_future();
+        Push([task] {
+            (*task)();
+        });
+        return result;
+    }
+
+    // Calls 'body(begin, end)' for consecutive chunks covering [0, count) on the workers and the calling thread,
+    // returns when all chunks are done. The caller works through the chunks too, so it doesn't wait for a free
+    // worker and may itself be a worker. The first exception thrown by 'body' is rethrown.
+    void ParallelFor(size_t count, const std::function<void(size_t, size_t)>& body);
+
+    [[nodiscard]] size_t GetThreadCount() const;
+
+    // Process-wide pool sized to the hardware. Asynchronous and parallel code paths use it
+    // by default, so concurrent callers share the cores instead of oversubscribing them.
+    static ThreadPool& GetShared();
+
+    static size_t GetDefaultThreadCount();
+
+private:
+    using Task = std::function<void()>;
+
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<WorkerQueue>> queues_;
+    std::vector<std::thread> threads_;
+    std::atomic<size_t> pending_count_{0};
+    std::atomic<size_t> next_queue_{0};
+    std::mutex sleep_mutex_;
+    std::condition_variable wake_up_;
+    bool stop_ = false;
+
+    void Push(Task task);
+    bool TryPop(size_t worker, Task& task);
+    void WorkerLoop(size_t worker);
+};
@@ -0,0 +1,273 @@
+#include "write_ahead_log.h"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <system_error>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+const size_t RECORD_HEADER_SIZE = 2 * sizeof(uint32_t);
+
+uint32_t ComputeCrc32(std::string_view data) {
+    static const std::array<uint32_t, 256> table = [] {
+        std::array<uint32_t, 256> result{};
+        for (uint32_t i = 0; i < result.size(); ++i) {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; ++bit) {
+                crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320u : crc >> 1;
+            }
+            result[i] = crc;
+        }
+        return result;
+    }();
+    uint32_t crc = 0xFFFFFFFFu;
+    for (const char c : data) {
+        crc = table[(crc ^ static_cast<uint8_t>(c)) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+template <typename T>
+void Put(std::string& output, T value) {
+    output.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+// Reads from a record payload, 'is_valid' turns false on reading past its end
+class PayloadReader {
+public:
+    explicit PayloadReader(std::string_view payload)
+            : payload_(payload) {
+    }
+
+    template <typename T>
+    T Get() {
+        T value{};
+        if (payload_.size() < sizeof(value)) {
+            is_valid_ = false;
+            return value;
+        }
+        std::memcpy(&value, payload_.data(), sizeof(value));
+        payload_.remove_prefix(sizeof(value));
+        return value;
+    }
+
+    std::string GetString() {
+        const uint32_t size = Get<uint32_t>();
+        if (payload_.size() < size) {
+            is_valid_ = false;
+            return {};
+        }
+        std::string result(payload_.substr(0, size));
+        payload_.remove_prefix(size);
+        return result;
+    }
+
+    [[nodiscard]] bool IsValid() const {
+        return is_valid_ && payload_.empty();
+    }
+
+private:
+    std::string_view payload_;
+    bool is_valid_ = true;
+};
+
+void EncodeRecord(const LogRecord& record, std::string& output) {
+    std::string payload;
+    Put(payload, record.sequence_number);
+    Put(payload, static_cast<uint8_t>(record.type));
+    switch (record.type) {
+        case LogRecordType::ADD_DOCUMENT:
+            Put(payload, static_cast<int32_t>(record.document_id));
+            Put(payload, static_cast<int32_t>(record.status));
+            Put(payload, static_cast<uint32_t>(record.ratings.size()));
+            for (const int rating : record.ratings) {
+                Put(payload, static_cast<int32_t>(rating));
+            }
+            Put(payload, static_cast<uint32_t>(record.text.size()));
+            payload += record.text;
+            break;
+        case LogRecordType::REMOVE_DOCUMENT:
+            Put(payload, static_cast<int32_t>(record.document_id));
+            break;
+        case LogRecordType::SET_STOP_WORDS:
+            Put(payload, static_cast<uint32_t>(record.text.size()));
+            payload += record.text;
+            break;
+    }
+    Put(output, static_cast<uint32_t>(payload.size()));
+    Put(output, ComputeCrc32(payload));
+    output += payload;
+}
+
+bool DecodeRecord(std::string_view payload, LogRecord& record) {
+    PayloadReader reader(payload);
+    record.sequence_number = reader.Get<uint64_t>();
+    record.type = static_cast<LogRecordType>(reader.Get<uint8_t>());
+    switch (record.type) {
+        case LogRecordType::ADD_DOCUMENT:
+            record.document_id = reader.Get<int32_t>();
+            record.status = static_cast<DocumentStatus>(reader.Get<int32_t>());
+            record.ratings.resize(std::min<size_t>(reader.Get<uint32_t>(), payload.size()));
+            for (int& rating : record.ratings) {
+                rating = reader.Get<int32_t>();
+            }
+            record.text = reader.GetString();
+            break;
+        case LogRecordType::REMOVE_DOCUMENT:
+            record.document_id = reader.Get<int32_t>();
+            break;
+        case LogRecordType::SET_STOP_WORDS:
+            record.text = reader.GetString();
+            break;
+        default:
+            return false;
+    }
+    return reader.IsValid();
+}
+
+[[noreturn]] void ThrowSystemError(const std::string& what) {
+    throw std::system_error(errno, std::generic_category(), what);
+}
+
+} // namespace
+
+WriteAheadLog::WriteAheadLog(const std::string& path, uint64_t last_sequence_number)
+        : fd_(open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644))
+        , appended_sequence_number_(last_sequence_number)
+        , durable_sequence_number_(last_sequence_number) {
+    if (fd_ < 0) {
+        ThrowSystemError("Can't open write-ahead log " + path);
+    }
+}
+
+WriteAheadLog::~WriteAheadLog() {
+    try {
+        WaitDurable(appended_sequence_number_);
+    } catch (const std::exception&) {
+        // Records that didn't reach the disk were never acknowledged
+    }
+    close(fd_);
+}
+
+uint64_t WriteAheadLog::Append(LogRecord& record) {
+    std::lock_guard lock(mutex_);
+    record.sequence_number = ++appended_sequence_number_;
+    EncodeRecord(record, buffer_);
+    return record.sequence_number;
+}
+
+void WriteAheadLog::WaitDurable(uint64_t sequence_number) {
+    std::unique_lock lock(mutex_);
+    while (durable_sequence_number_ < sequence_number) {
+        if (is_failed_) {
+            // The failed batch is lost, later records can't be made durable after it
+            throw std::runtime_error("Write-ahead log is unusable after a failed write");
+        }
+        if (is_flushing_) {
+            flushed_.wait(lock);
+            continue;
+        }
+        // This thread becomes the leader and writes out everything appended so far,
+        // including the records of the threads now waiting for it
+        is_flushing_ = true;
+        std::string batch;
+        batch.swap(buffer_);
+        const uint64_t batch_sequence_number = appended_sequence_number_;
+        lock.unlock();
+        try {
+            WriteBuffer(batch);
+        } catch (...) {
+            lock.lock();
+            is_failed_ = true;
+            is_flushing_ = false;
+            flushed_.notify_all();
+            throw;
+        }
+        lock.lock();
+        durable_sequence_number_ = batch_sequence_number;
+        ++sync_count_;
+        is_flushing_ = false;
+        flushed_.notify_all();
+    }
+}
+
+void WriteAheadLog::Truncate() {
+    WaitDurable(GetLastSequenceNumber());
+    std::lock_guard lock(mutex_);
+    if (ftruncate(fd_, 0) != 0 || fsync(fd_) != 0) {
+        ThrowSystemError("Can't truncate write-ahead log");
+    }
+}
+
+uint64_t WriteAheadLog::GetLastSequenceNumber() const {
+    std::lock_guard lock(mutex_);
+    return appended_sequence_number_;
+}
+
+bool WriteAheadLog::IsFailed() const {
+    std::lock_guard lock(mutex_);
+    return is_failed_;
+}
+
+uint64_t WriteAheadLog::GetSyncCount() const {
+    std::lock_guard lock(mutex_);
+    return sync_count_;
+}
+
+void WriteAheadLog::WriteBuffer(const std::string& buffer) {
+    for (size_t written = 0; written < buffer.size();) {
+        const ssize_t result = write(fd_, buffer.data() + written, buffer.size() - written);
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ThrowSystemError("Can't write to write-ahead log");
+        }
+        written += static_cast<size_t>(result);
+    }
+    if (fdatasync(fd_) != 0) {
+        ThrowSystemError("Can't sync write-ahead log");
+    }
+}
+
+std::vector<LogRecord> WriteAheadLog::Recover(const std::string& path) {
+    std::vector<LogRecord> records;
+    std::ifstream input(path, std::ios::binary);
+    if (!input) {
+        return records;
+    }
+    const std::string content{std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>()};
+    input.close();
+
+    std::string_view rest = content;
+    while (rest.size() >= RECORD_HEADER_SIZE) {
+        uint32_t payload_size = 0;
+        uint32_t crc = 0;
+        std::memcpy(&payload_size, rest.data(), sizeof(payload_size));
+        std::memcpy(&crc, rest.data() + sizeof(payload_size), sizeof(crc));
+        if (rest.size() - RECORD_HEADER_SIZE < payload_size) {
+            break;
+        }
+        const std::string_view payload = rest.substr(RECORD_HEADER_SIZE, payload_size);
+        LogRecord record;
+        if (ComputeCrc32(payload) != crc || !DecodeRecord(payload, record)) {
+            break;
+        }
+        records.push_back(std::move(record));
+        rest.remove_prefix(RECORD_HEADER_SIZE + payload_size);
+    }
+
+    // Whatever follows the last intact record was being written when the process died
+    if (!rest.empty() && truncate(path.c_str(), static_cast<off_t>(content.size() - rest.size())) != 0) {
+        ThrowSystemError("Can't truncate write-ahead log " + path);
+    }
+    return records;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "document.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+enum class LogRecordType : uint8_t {
+    ADD_DOCUMENT = 1,
+    REMOVE_DOCUMENT = 2,
+    SET_STOP_WORDS = 3,
+};
+
+struct LogRecord {
+    uint64_t sequence_number = 0;
+    LogRecordType type = LogRecordType::ADD_DOCUMENT;
+    int document_id = 0;
+    DocumentStatus status = DocumentStatus::ACTUAL;
+    std::vector<int> ratings;
+    // Document text or stop words
+    std::string text;
+};
+
+// Append-only log of index changes. Every record is framed as
+// <payload size><CRC-32 of payload><payload>, so a record torn by a crash is detected on recovery.
+// Append only buffers the record; WaitDurable writes the buffer out and fsyncs it. Threads waiting
+// at the same time share a single fsync (group commit).
+class WriteAheadLog {
+public:
+    // Opens 'path' for appending, creating it if needed. Sequence numbers continue after 'last_sequence_number'.
+    // Throws std::runtime_error if the file can't be opened.
+    WriteAheadLog(const std::string& path, uint64_t last_sequence_number);
+
+    WriteAheadLog(const WriteAheadLog&) = delete;
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+
+    // Flushes whatever is still buffered
+    ~WriteAheadLog();
+
+    // Assigns the next sequence number to 'record' and buffers it
+    uint64_t Append(LogRecord& record);
+
+    // Blocks until every record up to 'sequence_number' is on disk
+    void WaitDurable(uint64_t sequence_number);
+
+    // Flushes and empties the log, used once its records are covered by a snapshot
+    void Truncate();
+
+    [[nodiscard]] uint64_t GetLastSequenceNumber() const;
+
+    // True once a write or fsync has failed, WaitDurable throws from then on
+    [[nodiscard]] bool IsFailed() const;
+
+    // Number of fsync calls made so far; less than the number of records when commits were grouped
+    [[nodiscard]] uint64_t GetSyncCount() const;
+
+    /// Reads the records of the log at 'path' and cuts the file after the last intact one
+    /// @return Records in log order, empty if the file doesn't exist
+    static std::vector<LogRecord> Recover(const std::string& path);
+
+private:
+    void WriteBuffer(const std::string& buffer);
+
+    int fd_ = -1;
+    mutable std::mutex mutex_;
+    std::condition_variable flushed_;
+    std::string buffer_;
+    uint64_t appended_sequence_number_ = 0;
+    uint64_t durable_sequence_number_ = 0;
+    uint64_t sync_count_ = 0;
+    bool is_flushing_ = false;
+    bool is_failed_ = false;
+};